@@ -0,0 +1,370 @@
+/*
+ * Example program to show a team-scoped symmetric heap arena
+ *
+ * SYNOPSIS:
+ * void   team_arena_pool_init( size_t pool_size )
+ *
+ * void   team_arena_create(    shmem_team_t  team,
+ *                              size_t        arena_size,
+ *                              team_arena_t *arena )
+ *
+ * void  *team_arena_malloc(    team_arena_t *arena,
+ *                              size_t        size )
+ *
+ * void   team_arena_free(      team_arena_t *arena,
+ *                              void         *ptr )
+ *
+ * void   team_arena_sync(      team_arena_t *arena )
+ *
+ * void   team_arena_destroy(   team_arena_t *arena )
+ *
+ * DESCRIPTION:
+ * Symmetric allocation with shmem_malloc and shmem_free is collective
+ * over all PEs and implies a global barrier. Codes which need short-lived
+ * symmetric buffers for collectives on a team created by one of the
+ * shmemx_team_split_* routines pay that barrier for every temporary.
+ *
+ * The team arena replaces those calls with a single reservation per team.
+ * team_arena_pool_init is called once by all PEs after shmem_init and
+ * allocates the symmetric pool from which every arena is carved. It also
+ * calls team_map_init from shmemx-team-map.h, whose per-team pSync
+ * arrays the arenas use.
+ * team_arena_create is a collective routine over the members of team,
+ * normally called right after the team has been split. The members agree
+ * on a common offset in the pool with one reduction on the new team; no
+ * PE outside the team takes part.
+ *
+ * team_arena_malloc and team_arena_free are local routines. Blocks are
+ * served from per size class free lists first, then by bumping the arena
+ * top. Since no communication takes place, the returned buffer is only
+ * symmetric across the team if all members allocate and free the same
+ * sizes in the same order. This is the same rule shmem_malloc imposes
+ * across all PEs.
+ *
+ * Unlike shmem_free, team_arena_free does not wait for the other members,
+ * which may still be reading the block in a collective. A freed block is
+ * therefore only put back on a free list by the next team_arena_sync, a
+ * collective routine over the members of the team which returns once all
+ * of them have called it, and so have finished the collectives they
+ * issued before. Until then, team_arena_malloc takes new space instead.
+ *
+ * team_arena_destroy is a collective routine over the members of the
+ * team. It releases all blocks of the arena at once, returns the
+ * reservation to the pool and destroys the team with team_map_destroy.
+ * The pool is a stack: only the most recently created arena gives its
+ * space back, so arenas should be destroyed in reverse order of creation.
+ *
+ * Running out of pool space in team_arena_create, or of local memory for
+ * the free lists in team_arena_free, is considered fatal and will result
+ * in the job aborting with an informative error message.
+ * team_arena_malloc returns NULL when the arena is exhausted.
+ *
+ * The team arena routines support the following options:
+ *
+ * pool_size
+ *          Number of bytes of symmetric memory reserved for all arenas.
+ *          Must be the same on all PEs.
+ *
+ * team
+ *          A valid PE team created by a split team routine.
+ *
+ * arena_size
+ *          Number of bytes reserved for this arena. Must be the same on
+ *          all members of the team.
+ *
+ * arena
+ *          Arena handle, filled in by team_arena_create.
+ *
+ * size
+ *          Number of bytes requested from the arena.
+ *
+ * ptr
+ *          A block returned by team_arena_malloc on the same arena.
+ *
+ * EXAMPLE DETAILS:
+ * The example program splits SHMEM_TEAM_WORLD into odd and even teams
+ * and runs a number of timesteps. Each timestep allocates a few
+ * temporaries of different sizes, uses them in a team reduction and frees
+ * them again. Consecutive timesteps alternate between two pSync and pWrk
+ * arrays. In the arena loop, each timestep ends with team_arena_sync so
+ * that the next one can reuse the freed temporaries. The loop is timed
+ * once with shmem_malloc/shmem_free and once with a team arena, and the
+ * per-timestep cost is printed by PE 0.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+#include "shmemx-team-map.h"
+
+#define ARENA_ALIGN     64
+#define ARENA_NCLASS    32
+#define ARENA_HDR_SIZE  ARENA_ALIGN
+
+typedef struct team_arena_blk {
+    size_t                 offset;
+    struct team_arena_blk *next;
+} team_arena_blk_t;
+
+typedef struct {
+    shmem_team_t      team;
+    char             *base;
+    size_t            size;
+    size_t            top;
+    team_arena_blk_t *free_list[ARENA_NCLASS];
+    team_arena_blk_t *pending[ARENA_NCLASS];
+} team_arena_t;
+
+static char   *pool;
+static size_t  pool_size;
+static size_t  pool_cursor;
+
+long arena_offset_src;
+long arena_offset_dst;
+long arena_sync_src;
+long arena_sync_dst;
+
+void team_arena_pool_init(size_t size) {
+    team_map_init();
+
+    pool        = shmem_malloc(size);
+    pool_size   = size;
+    pool_cursor = 0;
+    if (pool == NULL) {
+        fprintf(stderr, "team_arena_pool_init: cannot allocate %zu bytes\n",
+                size);
+        shmem_global_exit(1);
+    }
+}
+
+void team_arena_create(shmem_team_t team, size_t size, team_arena_t *arena) {
+    size_t offset;
+    long *pWrk, *pSync;
+
+    memset(arena, 0, sizeof(*arena));
+    arena->team = team;
+    size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+
+    /* all members agree on the highest cursor as the common offset */
+    team_map_sync(team, &pWrk, &pSync);
+    arena_offset_src = (long) pool_cursor;
+    shmemx_team_long_max_to_all(team, &arena_offset_dst, &arena_offset_src,
+                                1, pWrk, pSync);
+    offset = (size_t) arena_offset_dst;
+
+    if (offset + size > pool_size) {
+        fprintf(stderr, "team_arena_create: pool exhausted, %zu of %zu "
+                "bytes in use, %zu requested\n", offset, pool_size, size);
+        shmem_global_exit(1);
+    }
+
+    arena->base = pool + offset;
+    arena->size = size;
+    pool_cursor = offset + size;
+}
+
+static int arena_class(size_t size) {
+    int c = 0;
+
+    while (((size_t) ARENA_ALIGN << c) < size) {
+        c++;
+    }
+    return c;
+}
+
+void *team_arena_malloc(team_arena_t *arena, size_t size) {
+    int c = arena_class(size + ARENA_HDR_SIZE);
+    size_t block = (size_t) ARENA_ALIGN << c;
+    size_t offset;
+    team_arena_blk_t *blk;
+
+    if (c >= ARENA_NCLASS) {
+        return NULL;
+    }
+
+    if (arena->free_list[c] != NULL) {
+        blk    = arena->free_list[c];
+        offset = blk->offset;
+        arena->free_list[c] = blk->next;
+        free(blk);
+    } else {
+        if (arena->top + block > arena->size) {
+            return NULL;
+        }
+        offset = arena->top;
+        arena->top += block;
+    }
+
+    /* the header is only ever touched by the local PE */
+    *(int *) (arena->base + offset) = c;
+    return arena->base + offset + ARENA_HDR_SIZE;
+}
+
+void team_arena_free(team_arena_t *arena, void *ptr) {
+    char *hdr;
+    team_arena_blk_t *blk;
+    int c;
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    hdr = (char *) ptr - ARENA_HDR_SIZE;
+    c   = *(int *) hdr;
+    blk = malloc(sizeof(*blk));
+    if (blk == NULL) {
+        /* dropping the block would make the members' arenas diverge */
+        fprintf(stderr, "team_arena_free: cannot allocate free list entry\n");
+        shmem_global_exit(1);
+    }
+    blk->offset = hdr - arena->base;
+    blk->next   = arena->pending[c];
+    arena->pending[c] = blk;
+}
+
+void team_arena_sync(team_arena_t *arena) {
+    team_arena_blk_t *blk;
+    long *pWrk, *pSync;
+    int c;
+
+    team_map_sync(arena->team, &pWrk, &pSync);
+    arena_sync_src = 0;
+    shmemx_team_long_max_to_all(arena->team, &arena_sync_dst,
+                                &arena_sync_src, 1, pWrk, pSync);
+
+    /* no member reads the freed blocks any more */
+    for (c = 0; c < ARENA_NCLASS; c++) {
+        while ((blk = arena->pending[c]) != NULL) {
+            arena->pending[c] = blk->next;
+            blk->next = arena->free_list[c];
+            arena->free_list[c] = blk;
+        }
+    }
+}
+
+void team_arena_destroy(team_arena_t *arena) {
+    team_arena_blk_t *blk;
+    int c;
+
+    for (c = 0; c < ARENA_NCLASS; c++) {
+        while ((blk = arena->free_list[c]) != NULL) {
+            arena->free_list[c] = blk->next;
+            free(blk);
+        }
+        while ((blk = arena->pending[c]) != NULL) {
+            arena->pending[c] = blk->next;
+            free(blk);
+        }
+    }
+
+    if (arena->base + arena->size == pool + pool_cursor) {
+        pool_cursor = arena->base - pool;
+    }
+
+    team_map_destroy(&arena->team);
+    arena->base = NULL;
+    arena->size = 0;
+}
+
+#define NSTEPS  200
+#define NTEMPS  4
+#define N       64
+
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+
+#define MAX(a, b) ((a > b) ? a : b)
+#define PWRK_MAX_SIZE MAX(N/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE)
+double pWrk[2][PWRK_MAX_SIZE];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+static double timestep(shmem_team_t team, double **tmp, int me, int step) {
+    int i, j;
+
+    for (j = 0; j < NTEMPS; j++) {
+        for (i = 0; i < N; i++) {
+            tmp[j][i] = me;
+        }
+    }
+
+    /* reduce the first temporary into the second one */
+    shmemx_team_double_sum_to_all(team, tmp[1], tmp[0], N, pWrk[step % 2],
+                                  pSync[step % 2]);
+    return tmp[1][0];
+}
+
+int main(int argc, char *argv[]) {
+    int i, j, step;
+    int me, npes;
+    double t_malloc, t_arena, result = 0.0;
+    double *tmp[NTEMPS];
+    shmem_team_t new_team;
+    team_arena_t arena;
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+
+    team_arena_pool_init(1 << 20);
+
+    shmemx_team_split_color(SHMEM_TEAM_WORLD, me % 2, me, &new_team);
+
+    /* every timestep allocates NTEMPS symmetric temporaries */
+    shmem_barrier_all();
+    t_malloc = wtime();
+    for (step = 0; step < NSTEPS; step++) {
+        for (j = 0; j < NTEMPS; j++) {
+            tmp[j] = shmem_malloc((j + 1) * N * sizeof(double));
+        }
+        timestep(new_team, tmp, me, step);
+        for (j = NTEMPS - 1; j >= 0; j--) {
+            shmem_free(tmp[j]);
+        }
+    }
+    t_malloc = (wtime() - t_malloc) / NSTEPS;
+
+    /* the same temporaries carved out of one team arena */
+    team_arena_create(new_team, 16 * NTEMPS * N * sizeof(double), &arena);
+    shmem_barrier_all();
+    t_arena = wtime();
+    for (step = 0; step < NSTEPS; step++) {
+        for (j = 0; j < NTEMPS; j++) {
+            tmp[j] = team_arena_malloc(&arena, (j + 1) * N * sizeof(double));
+        }
+        result = timestep(arena.team, tmp, me, step);
+        for (j = NTEMPS - 1; j >= 0; j--) {
+            team_arena_free(&arena, tmp[j]);
+        }
+        team_arena_sync(&arena);
+    }
+    t_arena = (wtime() - t_arena) / NSTEPS;
+
+    printf("[PE:%d] team result %g\n", me, result);
+    team_arena_destroy(&arena);
+
+    shmem_barrier_all();
+    if (me == 0) {
+        printf("npes %d, %d temporaries per timestep\n", npes, NTEMPS);
+        printf("shmem_malloc/shmem_free: %10.2f us per timestep\n",
+               t_malloc * 1.0e6);
+        printf("team arena:              %10.2f us per timestep\n",
+               t_arena * 1.0e6);
+    }
+
+    shmem_barrier_all();
+    shmem_free(pool);
+    shmem_finalize();
+    return 0;
+}
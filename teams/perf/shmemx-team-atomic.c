@@ -0,0 +1,345 @@
+/*
+ * Example program to show an atomic fast path for small team reductions
+ *
+ * SYNOPSIS:
+ * void team_<datatype>_<op>_to_all(  shmem_team_t  team,
+ *                                    <datatype>   *dest,
+ *                                    <datatype>   *source,
+ *                                    int           nreduce,
+ *                                    <datatype>   *pWrk,
+ *                                    long         *pSync )
+ *
+ * where <op> is one from sum, prod, max, min, and, or and xor for
+ * <datatype> int, long and longlong.
+ *
+ * DESCRIPTION:
+ * The routines compute the same reductions as
+ * shmemx_team_<datatype>_<op>_to_all. Reductions of up to
+ * TEAM_ATOMIC_MAX_NREDUCE elements on teams of up to TEAM_ATOMIC_MAX_PES
+ * PEs are done with remote atomics instead of a tree of messages: every
+ * PE applies its elements to an accumulator held in pSync on team PE 0,
+ * with atomic add for sum, atomic and, or and xor for the bitwise
+ * operations, and a compare and swap loop for prod, max and min. It
+ * then increments an arrival counter on team PE 0. Once all PEs have
+ * arrived, team PE 0 puts the result into dest on every PE and signals
+ * them. A PE waits for two messages per call whatever the team size.
+ *
+ * Larger reductions call shmemx_team_<datatype>_<op>_to_all. The choice
+ * depends only on nreduce and the team size, so it is the same on all
+ * members. These calls alternate between two halves of pWrk and two
+ * regions at the start of pSync, as do the reductions that set up the
+ * accumulator.
+ *
+ * Team PE 0 resets the accumulator to the identity of the operation
+ * before it signals the result, so consecutive calls may use the same
+ * pWrk and pSync without other synchronization, whichever path they
+ * take. A pSync must not be shared between teams. The first
+ * call on a team gathers the mapping from team PE numbers to global PE
+ * numbers. The first call and every call with another datatype or
+ * operation than the previous one on the same pSync synchronize the
+ * members while team PE 0 sets up the accumulator, and are therefore
+ * slower than the following ones.
+ *
+ * The routines support the following options:
+ *
+ * team, dest, source, nreduce
+ *          As for shmemx_team_<datatype>_<op>_to_all.
+ *
+ * pWrk
+ *          A symmetric work array of at least
+ *          TEAM_ATOMIC_WRK_SIZE(nreduce) elements, twice the size needed
+ *          by shmemx_team_<datatype>_<op>_to_all.
+ *
+ * pSync
+ *          A symmetric work array of TEAM_ATOMIC_SYNC_SIZE longs. Every
+ *          element must be initialized with SHMEM_SYNC_VALUE before the
+ *          first call.
+ *
+ * EXAMPLE DETAILS:
+ * The example program runs int sum, long max and long or reductions of
+ * N elements on SHMEM_TEAM_WORLD and on the teams of odd and even PEs,
+ * once with shmemx_team_<datatype>_<op>_to_all and once with the atomic
+ * routines, and checks the result of every atomic call against the
+ * general one. Team PE 0 of every team prints the latencies.
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+#include "shmemx-team-map.h"
+
+#define TEAM_ATOMIC_MAX_NREDUCE 8
+#define TEAM_ATOMIC_MAX_PES     64
+
+#define MAX(a, b) ((a > b) ? a : b)
+#define TEAM_ATOMIC_WRK_SIZE(nreduce)                                        \
+    (2 * MAX((nreduce)/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE))
+
+/* pSync layout, the two regions up front are left to general reductions */
+#define TEAM_ATOMIC_SEQ         (2 * SHMEM_REDUCE_SYNC_SIZE)
+#define TEAM_ATOMIC_COUNT       (TEAM_ATOMIC_SEQ + 1)
+#define TEAM_ATOMIC_RELEASE     (TEAM_ATOMIC_SEQ + 2)
+#define TEAM_ATOMIC_OP          (TEAM_ATOMIC_SEQ + 3)
+#define TEAM_ATOMIC_PARITY      (TEAM_ATOMIC_SEQ + 4)
+#define TEAM_ATOMIC_ACC         (TEAM_ATOMIC_SEQ + 5)
+#define TEAM_ATOMIC_SYNC_SIZE   (TEAM_ATOMIC_ACC + TEAM_ATOMIC_MAX_NREDUCE)
+
+
+int  atomic_bar_src, atomic_bar_dst;
+int  atomic_bar_pWrk[2][SHMEM_REDUCE_MIN_WRKDATA_SIZE];
+
+/*
+ * Returns the pSync region and pWrk half for the next general reduction
+ * on pSync, 0 or 1. TEAM_ATOMIC_PARITY is only read locally; it starts
+ * out as SHMEM_SYNC_VALUE, which is neither 0 nor 1 after the first call.
+ */
+static int team_atomic_next(long *pSync) {
+    int idx = (pSync[TEAM_ATOMIC_PARITY] == 1);
+
+    pSync[TEAM_ATOMIC_PARITY] = !idx;
+    return idx;
+}
+
+/*
+ * Called when pSync was last used for another operation, or never: team
+ * PE 0 clears the arrival counter, and the accumulator is set to the
+ * identity of op by the caller, before any member can apply its elements
+ * to it. TEAM_ATOMIC_OP is only read locally; it is the same on all
+ * members since they make the same calls.
+ */
+static void team_atomic_setup(shmem_team_t team, long *pSync, long op) {
+    int idx = team_atomic_next(pSync);
+
+    pSync[TEAM_ATOMIC_COUNT] = 0;
+    shmemx_team_int_sum_to_all(team, &atomic_bar_dst, &atomic_bar_src, 1,
+                               atomic_bar_pWrk[idx],
+                               &pSync[idx * SHMEM_REDUCE_SYNC_SIZE]);
+    pSync[TEAM_ATOMIC_OP] = op;
+}
+
+/*
+ * Called by team PE 0 once all contributions have arrived and the result
+ * has been taken out of the accumulator and the accumulator reset: puts
+ * the result to every member and signals it. Members only start the
+ * next call after the signal, so they always find a clean accumulator.
+ */
+static void team_atomic_release(int *pe_map, int t_size, void *dest,
+                                const void *result, size_t bytes,
+                                long *pSync, long seq) {
+    int i;
+
+    pSync[TEAM_ATOMIC_COUNT] = 0;
+
+    for (i = 1; i < t_size; i++) {
+        shmem_putmem(dest, result, bytes, pe_map[i]);
+    }
+    shmem_fence();
+    for (i = 1; i < t_size; i++) {
+        shmem_long_p(&pSync[TEAM_ATOMIC_RELEASE], seq, pe_map[i]);
+    }
+    memcpy(dest, result, bytes);
+}
+
+static void team_atomic_arrive(int *pe_map, long *pSync, long seq) {
+    shmem_fence();
+    shmem_long_atomic_inc(&pSync[TEAM_ATOMIC_COUNT], pe_map[0]);
+    shmem_long_wait_until(&pSync[TEAM_ATOMIC_RELEASE], SHMEM_CMP_EQ, seq);
+}
+
+#define ATOMIC_ADD(TYPE, NAME, UTYPE, UNAME, target, value, pe)              \
+    shmem_##NAME##_atomic_add(target, value, pe)
+
+#define ATOMIC_BITWISE(UTYPE, UNAME, OPNAME, target, value, pe)              \
+    shmem_##UNAME##_atomic_##OPNAME((UTYPE *) (target), (UTYPE) (value), pe)
+#define ATOMIC_AND(TYPE, NAME, UTYPE, UNAME, target, value, pe)              \
+    ATOMIC_BITWISE(UTYPE, UNAME, and, target, value, pe)
+#define ATOMIC_OR(TYPE, NAME, UTYPE, UNAME, target, value, pe)               \
+    ATOMIC_BITWISE(UTYPE, UNAME, or, target, value, pe)
+#define ATOMIC_XOR(TYPE, NAME, UTYPE, UNAME, target, value, pe)              \
+    ATOMIC_BITWISE(UTYPE, UNAME, xor, target, value, pe)
+
+/* compare and swap until the combined value is in place or unchanged */
+#define ATOMIC_CSWAP(TYPE, NAME, target, value, pe, EXPR)                    \
+    do {                                                                     \
+        TYPE x = shmem_##NAME##_atomic_fetch(target, pe), y = (value);       \
+        for (;;) {                                                           \
+            TYPE next = (EXPR), prev;                                        \
+            if (next == x) {                                                 \
+                break;                                                       \
+            }                                                                \
+            prev = shmem_##NAME##_atomic_compare_swap(target, x, next, pe);  \
+            if (prev == x) {                                                 \
+                break;                                                       \
+            }                                                                \
+            x = prev;                                                        \
+        }                                                                    \
+    } while (0)
+#define ATOMIC_PROD(TYPE, NAME, UTYPE, UNAME, target, value, pe)             \
+    ATOMIC_CSWAP(TYPE, NAME, target, value, pe, x * y)
+#define ATOMIC_MAX(TYPE, NAME, UTYPE, UNAME, target, value, pe)              \
+    ATOMIC_CSWAP(TYPE, NAME, target, value, pe, (x > y) ? x : y)
+#define ATOMIC_MIN(TYPE, NAME, UTYPE, UNAME, target, value, pe)              \
+    ATOMIC_CSWAP(TYPE, NAME, target, value, pe, (x < y) ? x : y)
+
+#define DEFINE_ATOMIC(TYPE, NAME, UTYPE, UNAME, OPNAME, IDENT, APPLY, OP)    \
+void team_##NAME##_##OPNAME##_to_all(shmem_team_t team, TYPE *dest,          \
+                                     TYPE *source, int nreduce, TYPE *pWrk,  \
+                                     long *pSync) {                          \
+    TYPE *acc = (TYPE *) &pSync[TEAM_ATOMIC_ACC];                            \
+    TYPE  result[TEAM_ATOMIC_MAX_NREDUCE];                                   \
+    int   t_pe   = shmemx_team_my_pe(team);                                  \
+    int   t_size = shmemx_team_n_pes(team);                                  \
+    int  *pe_map, i;                                                         \
+    long  seq;                                                               \
+                                                                             \
+    if (nreduce > TEAM_ATOMIC_MAX_NREDUCE || t_size > TEAM_ATOMIC_MAX_PES) { \
+        i = team_atomic_next(pSync);                                         \
+        shmemx_team_##NAME##_##OPNAME##_to_all(team, dest, source, nreduce,  \
+            pWrk + i * (TEAM_ATOMIC_WRK_SIZE(nreduce) / 2),                  \
+            &pSync[i * SHMEM_REDUCE_SYNC_SIZE]);                             \
+        return;                                                              \
+    }                                                                        \
+                                                                             \
+    if (pSync[TEAM_ATOMIC_OP] != (OP)) {                                     \
+        for (i = 0; t_pe == 0 && i < TEAM_ATOMIC_MAX_NREDUCE; i++) {         \
+            acc[i] = (IDENT);                                                \
+        }                                                                    \
+        team_atomic_setup(team, pSync, (OP));                                \
+    }                                                                        \
+    pe_map = team_pe_map(team);                                              \
+    seq = ++pSync[TEAM_ATOMIC_SEQ];                                          \
+                                                                             \
+    for (i = 0; i < nreduce; i++) {                                          \
+        APPLY(TYPE, NAME, UTYPE, UNAME, &acc[i], source[i], pe_map[0]);      \
+    }                                                                        \
+    if (t_pe != 0) {                                                         \
+        team_atomic_arrive(pe_map, pSync, seq);                              \
+        return;                                                              \
+    }                                                                        \
+                                                                             \
+    shmem_long_wait_until(&pSync[TEAM_ATOMIC_COUNT], SHMEM_CMP_EQ,           \
+                          t_size - 1);                                       \
+    /* this PE's own non-fetching atomics may still be in flight */          \
+    shmem_quiet();                                                           \
+    for (i = 0; i < nreduce; i++) {                                          \
+        result[i] = ((volatile TYPE *) acc)[i];                              \
+        acc[i] = (IDENT);                                                    \
+    }                                                                        \
+    team_atomic_release(pe_map, t_size, dest, result,                        \
+                        nreduce * sizeof(TYPE), pSync, seq);                 \
+}
+
+/* operations are numbered from 1 up, 8 per datatype */
+#define DEFINE_ATOMIC_ALL(TYPE, NAME, UTYPE, UNAME, TMIN, TMAX, T)           \
+    DEFINE_ATOMIC(TYPE, NAME, UTYPE, UNAME, sum,  0,    ATOMIC_ADD,  T + 1)  \
+    DEFINE_ATOMIC(TYPE, NAME, UTYPE, UNAME, prod, 1,    ATOMIC_PROD, T + 2)  \
+    DEFINE_ATOMIC(TYPE, NAME, UTYPE, UNAME, max,  TMIN, ATOMIC_MAX,  T + 3)  \
+    DEFINE_ATOMIC(TYPE, NAME, UTYPE, UNAME, min,  TMAX, ATOMIC_MIN,  T + 4)  \
+    DEFINE_ATOMIC(TYPE, NAME, UTYPE, UNAME, and,  ~0,   ATOMIC_AND,  T + 5)  \
+    DEFINE_ATOMIC(TYPE, NAME, UTYPE, UNAME, or,   0,    ATOMIC_OR,   T + 6)  \
+    DEFINE_ATOMIC(TYPE, NAME, UTYPE, UNAME, xor,  0,    ATOMIC_XOR,  T + 7)
+
+DEFINE_ATOMIC_ALL(int, int, unsigned int, uint, INT_MIN, INT_MAX, 0)
+DEFINE_ATOMIC_ALL(long, long, unsigned long, ulong, LONG_MIN, LONG_MAX, 8)
+DEFINE_ATOMIC_ALL(long long, longlong, unsigned long long, ulonglong,
+                  LLONG_MIN, LLONG_MAX, 16)
+
+#define NITER   1000
+#define N       3
+
+#define PWRK_MAX_SIZE MAX(N/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE)
+
+/* the reference loop uses the two halves of the pWrk arrays in turn */
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+long atomic_pSync[2][TEAM_ATOMIC_SYNC_SIZE];
+int  int_pWrk[TEAM_ATOMIC_WRK_SIZE(N)];
+long long_pWrk[TEAM_ATOMIC_WRK_SIZE(N)];
+int  int_src[N], int_dst[N], int_check[N];
+long long_src[N], long_dst[N], long_check[N];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+#define RUN(NAME, OPNAME, PREFIX)                                            \
+    do {                                                                     \
+        shmem_barrier_all();                                                 \
+        t_general = wtime();                                                 \
+        for (iter = 0; iter < NITER; iter++) {                               \
+            shmemx_team_##NAME##_##OPNAME##_to_all(team, PREFIX##_check,     \
+                PREFIX##_src, N, PREFIX##_pWrk + (iter % 2) * PWRK_MAX_SIZE, \
+                pSync[iter % 2]);                                            \
+        }                                                                    \
+        t_general = (wtime() - t_general) / NITER;                           \
+                                                                             \
+        shmem_barrier_all();                                                 \
+        t_atomic = wtime();                                                  \
+        for (iter = 0; iter < NITER; iter++) {                               \
+            team_##NAME##_##OPNAME##_to_all(team, PREFIX##_dst,              \
+                PREFIX##_src, N, PREFIX##_pWrk, team_pSync);                 \
+            for (i = 0; i < N; i++) {                                        \
+                errors += (PREFIX##_dst[i] != PREFIX##_check[i]);            \
+            }                                                                \
+        }                                                                    \
+        t_atomic = (wtime() - t_atomic) / NITER;                             \
+                                                                             \
+        if (errors != 0) {                                                   \
+            printf("[PE:%d] %s %s_%s: %d mismatches\n", shmem_my_pe(),       \
+                   name, #NAME, #OPNAME, errors);                            \
+            errors = 0;                                                      \
+        }                                                                    \
+        if (shmemx_team_my_pe(team) == 0) {                                  \
+            printf("%-16s size %4d %-12s to_all %8.2f us, atomic "           \
+                   "%8.2f us\n", name, shmemx_team_n_pes(team),              \
+                   #NAME "_" #OPNAME, t_general * 1.0e6, t_atomic * 1.0e6);  \
+        }                                                                    \
+    } while (0)
+
+static void run(shmem_team_t team, const char *name, long *team_pSync) {
+    int i, iter, errors = 0;
+    double t_general, t_atomic;
+
+    RUN(int, sum, int);
+    RUN(long, max, long);
+    RUN(long, or, long);
+}
+
+int main(int argc, char *argv[]) {
+    int i;
+    int me;
+    shmem_team_t new_team;
+
+    shmem_init();
+    me = shmem_my_pe();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    for (i = 0; i < TEAM_ATOMIC_SYNC_SIZE; i++) {
+        atomic_pSync[0][i] = SHMEM_SYNC_VALUE;
+        atomic_pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    team_map_init();
+    for (i = 0; i < N; i++) {
+        int_src[i]  = me + i;
+        long_src[i] = (long) (me * 7 % 5) << (i * 4);
+    }
+
+    run(SHMEM_TEAM_WORLD, "SHMEM_TEAM_WORLD", atomic_pSync[0]);
+
+    /* the odd and even teams need their own atomic pSync */
+    shmemx_team_split_color(SHMEM_TEAM_WORLD, me % 2, me, &new_team);
+    run(new_team, (me % 2) ? "odd team" : "even team", atomic_pSync[1]);
+
+    team_map_destroy(&new_team);
+    shmem_barrier_all();
+    shmem_finalize();
+    return 0;
+}
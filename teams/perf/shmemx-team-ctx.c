@@ -0,0 +1,246 @@
+/*
+ * Example program to show per-team communication contexts
+ *
+ * SYNOPSIS:
+ * int  team_ctx_create(  shmem_team_t  team,
+ *                        long          options,
+ *                        team_ctx_t   *ctx )
+ *
+ * void team_ctx_putmem_nbi( team_ctx_t *ctx,
+ *                           void       *dest,
+ *                           const void *source,
+ *                           size_t      nelems,
+ *                           int         team_pe )
+ *
+ * void team_ctx_getmem(  team_ctx_t   *ctx,
+ *                        void         *dest,
+ *                        const void   *source,
+ *                        size_t        nelems,
+ *                        int           team_pe )
+ *
+ * void team_ctx_fence(   team_ctx_t   *ctx )
+ * void team_ctx_quiet(   team_ctx_t   *ctx )
+ * void team_ctx_destroy( team_ctx_t   *ctx )
+ *
+ * DESCRIPTION:
+ * shmem_quiet and shmem_fence order and complete all communication the
+ * calling PE issued on the default context. A PE that works on several
+ * teams, for example the two axis teams returned by shmemx_team_split_2d,
+ * waits in every shmem_quiet for the traffic of all of them.
+ *
+ * team_ctx_create is a collective routine over the members of team. It
+ * creates a communication context with shmem_ctx_create and binds it to
+ * the team. Communication on the team context addresses PEs by their
+ * number in the team, and team_ctx_fence and team_ctx_quiet only order
+ * and complete the operations issued on that context. Each context has
+ * its own injection resources where the implementation provides them.
+ * The mapping from team PE numbers to global PE numbers is the one kept
+ * by team_pe_map from shmemx-team-map.h, so team_map_init must have been
+ * called and the team is destroyed with team_map_destroy after its
+ * contexts.
+ *
+ * team_ctx_create returns 0 on success and nonzero if no context could be
+ * created; the return value is the same on all members. The remaining
+ * routines are local and accept the same arguments as their shmem_ctx_*
+ * counterparts, except that team_pe is a PE number in the team.
+ *
+ * The team context routines support the following options:
+ *
+ * team
+ *          A valid PE team. A predefined team constant or any team
+ *          created by a split team routine may be used.
+ *
+ * options
+ *          Options passed to shmem_ctx_create, for example
+ *          SHMEM_CTX_PRIVATE or SHMEM_CTX_SERIALIZED.
+ *
+ * ctx
+ *          Team context handle, filled in by team_ctx_create.
+ *
+ * EXAMPLE DETAILS:
+ * The example program splits SHMEM_TEAM_WORLD with shmemx_team_split_2d.
+ * Every iteration starts a large halo exchange with both neighbours on
+ * the yaxis_team and a small one on the xaxis_team, then waits for the
+ * xaxis_team exchange to complete. The completion latency of the small
+ * exchange is measured with one shared default context, and with one
+ * context per axis team. PE 0 prints both.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+#include "shmemx-team-map.h"
+
+typedef struct {
+    shmem_ctx_t  ctx;
+    shmem_team_t team;
+    int          n_pes;
+    int         *pe_map;
+} team_ctx_t;
+
+long ctx_failed_src;
+long ctx_failed_dst;
+
+int team_ctx_create(shmem_team_t team, long options, team_ctx_t *ctx) {
+    long *pWrk, *pSync;
+
+    ctx->team   = team;
+    ctx->n_pes  = shmemx_team_n_pes(team);
+    ctx->pe_map = team_pe_map(team);
+
+    /* count the members that failed to create a context */
+    team_map_sync(team, &pWrk, &pSync);
+    ctx_failed_src = (shmem_ctx_create(options, &ctx->ctx) != 0);
+    shmemx_team_long_sum_to_all(team, &ctx_failed_dst, &ctx_failed_src, 1,
+                                pWrk, pSync);
+
+    if (ctx_failed_dst != 0) {
+        if (ctx_failed_src == 0) {
+            shmem_ctx_destroy(ctx->ctx);
+        }
+        ctx->pe_map = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+void team_ctx_putmem_nbi(team_ctx_t *ctx, void *dest, const void *source,
+                         size_t nelems, int team_pe) {
+    shmem_ctx_putmem_nbi(ctx->ctx, dest, source, nelems,
+                         ctx->pe_map[team_pe]);
+}
+
+void team_ctx_getmem(team_ctx_t *ctx, void *dest, const void *source,
+                     size_t nelems, int team_pe) {
+    shmem_ctx_getmem(ctx->ctx, dest, source, nelems, ctx->pe_map[team_pe]);
+}
+
+void team_ctx_fence(team_ctx_t *ctx) {
+    shmem_ctx_fence(ctx->ctx);
+}
+
+void team_ctx_quiet(team_ctx_t *ctx) {
+    shmem_ctx_quiet(ctx->ctx);
+}
+
+void team_ctx_destroy(team_ctx_t *ctx) {
+    shmem_ctx_destroy(ctx->ctx);
+    ctx->pe_map = NULL;
+}
+
+#define NITER       200
+#define SMALL_HALO  64
+#define LARGE_HALO  (1 << 20)
+
+char small_halo[2][SMALL_HALO];
+char large_halo[2][LARGE_HALO];
+char small_send[SMALL_HALO];
+char large_send[LARGE_HALO];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/* start a halo exchange with both neighbours of the team */
+static void halo_start(team_ctx_t *ctx, char *from_right, char *from_left,
+                       char *send, size_t len, int shared) {
+    int t_pe   = shmemx_team_my_pe(ctx->team);
+    int left   = (t_pe + ctx->n_pes - 1) % ctx->n_pes;
+    int right  = (t_pe + 1) % ctx->n_pes;
+
+    if (shared) {
+        shmem_putmem_nbi(from_right, send, len, ctx->pe_map[left]);
+        shmem_putmem_nbi(from_left, send, len, ctx->pe_map[right]);
+    } else {
+        team_ctx_putmem_nbi(ctx, from_right, send, len, left);
+        team_ctx_putmem_nbi(ctx, from_left, send, len, right);
+    }
+}
+
+static double exchange(team_ctx_t *xctx, team_ctx_t *yctx, int shared) {
+    double t, t_small = 0.0;
+    int iter;
+
+    for (iter = 0; iter < NITER; iter++) {
+        shmem_barrier_all();
+        t = wtime();
+        halo_start(yctx, large_halo[1], large_halo[0], large_send,
+                   LARGE_HALO, shared);
+        halo_start(xctx, small_halo[1], small_halo[0], small_send,
+                   SMALL_HALO, shared);
+        if (shared) {
+            shmem_quiet();
+        } else {
+            team_ctx_quiet(xctx);
+        }
+        t_small += wtime() - t;
+
+        if (!shared) {
+            team_ctx_quiet(yctx);
+        }
+    }
+    return t_small / NITER;
+}
+
+int main(int argc, char *argv[]) {
+    int rank, npes;
+    int xrange, yrange;
+    int failed;
+    double t_shared = 0.0, t_team = 0.0;
+    shmem_team_t xaxis_team;
+    shmem_team_t yaxis_team;
+    team_ctx_t xctx, yctx;
+
+    shmem_init();
+    rank = shmem_my_pe();
+    npes = shmem_n_pes();
+    team_map_init();
+
+    xrange = (npes != 1) ? floor(log(npes)/log(2)) : 1;
+    yrange = (npes != 1) ? floor(log(npes)/log(2)) : 1;
+    shmemx_team_split_2d(SHMEM_TEAM_WORLD, xrange, yrange,
+                         &xaxis_team, &yaxis_team);
+
+    /* PEs outside the cartesian space only take part in the barriers */
+    if (xaxis_team != SHMEM_TEAM_NULL && yaxis_team != SHMEM_TEAM_NULL) {
+        failed  = team_ctx_create(xaxis_team, SHMEM_CTX_PRIVATE, &xctx);
+        failed |= team_ctx_create(yaxis_team, SHMEM_CTX_PRIVATE, &yctx);
+        if (failed) {
+            fprintf(stderr, "[PE:%d] no team contexts available\n", rank);
+            shmem_global_exit(1);
+        }
+
+        t_shared = exchange(&xctx, &yctx, 1);
+        t_team   = exchange(&xctx, &yctx, 0);
+
+        team_ctx_destroy(&xctx);
+        team_ctx_destroy(&yctx);
+        team_map_destroy(&xaxis_team);
+        team_map_destroy(&yaxis_team);
+    } else {
+        int iter;
+
+        for (iter = 0; iter < 2 * NITER; iter++) {
+            shmem_barrier_all();
+        }
+    }
+
+    shmem_barrier_all();
+    if (rank == 0) {
+        printf("npes %d, xaxis halo %d bytes, yaxis halo %d bytes\n",
+               npes, SMALL_HALO, LARGE_HALO);
+        printf("shared default context: %10.2f us to complete xaxis halo\n",
+               t_shared * 1.0e6);
+        printf("per-team contexts:      %10.2f us to complete xaxis halo\n",
+               t_team * 1.0e6);
+    }
+
+    shmem_barrier_all();
+    shmem_finalize();
+    return 0;
+}
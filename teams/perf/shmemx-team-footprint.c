@@ -0,0 +1,351 @@
+/*
+ * Example program to show per-team memory accounting
+ *
+ * SYNOPSIS:
+ * void team_mem_split_color(   shmem_team_t   parent_team,
+ *                              int            color,
+ *                              int            key,
+ *                              shmem_team_t  *new_team )
+ *
+ * void team_mem_split_strided( shmem_team_t   parent_team,
+ *                              int            PE_start,
+ *                              int            PE_stride,
+ *                              int            PE_size,
+ *                              shmem_team_t  *new_team )
+ *
+ * void team_mem_split_2d(      shmem_team_t   parent_team,
+ *                              int            xrange,
+ *                              int            yrange,
+ *                              shmem_team_t  *xaxis_team,
+ *                              shmem_team_t  *yaxis_team )
+ *
+ * void team_mem_split_3d(      shmem_team_t   parent_team,
+ *                              int            xrange,
+ *                              int            yrange,
+ *                              int            zrange,
+ *                              shmem_team_t  *xaxis_team,
+ *                              shmem_team_t  *yaxis_team,
+ *                              shmem_team_t  *zaxis_team )
+ *
+ * void team_mem_add(           shmem_team_t   team,
+ *                              int            category,
+ *                              long           bytes )
+ *
+ * int  team_mem_query(         shmem_team_t   team,
+ *                              team_mem_t    *mem )
+ *
+ * int  team_mem_total(         team_mem_t    *mem )
+ *
+ * void team_mem_destroy(       shmem_team_t  *team )
+ *
+ * DESCRIPTION:
+ * Every team created by a shmemx_team_split_* routine holds memory on
+ * each of its members, and codes which create thousands of teams can run
+ * out of memory without any way to tell how much of it went to teams.
+ * The team_mem routines keep a per-PE record of that memory, split in
+ * three categories:
+ *
+ * TEAM_MEM_METADATA
+ *          Local memory taken by the SHMEM library for the team. The
+ *          team_mem_split_* routines call the matching shmemx_team_split_*
+ *          routine and measure the growth of the malloc heap of the PE
+ *          across the call, shared evenly among the teams it creates.
+ *          Memory the library maps by other means is not seen.
+ *
+ * TEAM_MEM_SYNC
+ *          pSync and pWrk arrays set aside for collectives on the team.
+ *
+ * TEAM_MEM_SYMMETRIC
+ *          Other symmetric memory, which is registered with the network,
+ *          set aside for the team, for example a team arena.
+ *
+ * The library does not know which pSync, pWrk or symmetric buffers
+ * belong to a team, so the code that allocates them records them with
+ * team_mem_add. All routines except the splits are local.
+ *
+ * team_mem_query fills mem with the memory of team and returns 0, or
+ * returns -1 if the team is not known. team_mem_total fills mem with the
+ * sum over all live teams of the PE and returns their number.
+ * team_mem_destroy drops the record and destroys the team with
+ * shmemx_team_destroy; the sync and symmetric buffers recorded for the
+ * team remain owned by the caller.
+ *
+ * The team_mem routines support the following options:
+ *
+ * parent_team, color, key, PE_start, PE_stride, PE_size, xrange, yrange,
+ * zrange, new_team, xaxis_team, yaxis_team, zaxis_team
+ *          As for the corresponding shmemx_team_split_* routine.
+ *
+ * team
+ *          A team created by a team_mem_split_* routine.
+ *
+ * category
+ *          TEAM_MEM_METADATA, TEAM_MEM_SYNC or TEAM_MEM_SYMMETRIC.
+ *
+ * bytes
+ *          Number of bytes to add to the category of the team.
+ *
+ * mem
+ *          Byte counts of each category, indexed by category.
+ *
+ * EXAMPLE DETAILS:
+ * The example program creates 1, 10, 100 and 10000 teams with
+ * team_mem_split_color, with the PEs spread over half as many colors as
+ * there are PEs, and records the size of the pSync and pWrk arrays a
+ * code would set aside for every team. PE 0 prints the creation time, the
+ * memory of each category per team and in total, and the growth of its
+ * resident memory.
+ */
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+
+#define TEAM_MEM_METADATA    0
+#define TEAM_MEM_SYNC        1
+#define TEAM_MEM_SYMMETRIC   2
+#define TEAM_MEM_NCATEGORIES 3
+
+typedef struct {
+    long bytes[TEAM_MEM_NCATEGORIES];
+} team_mem_t;
+
+typedef struct {
+    shmem_team_t team;
+    team_mem_t   mem;
+} team_mem_entry_t;
+
+static team_mem_entry_t *team_mem_table = NULL;
+static int               team_mem_count = 0;
+static int               team_mem_max   = 0;
+
+/* bytes in use in the malloc heap of the PE */
+static long team_mem_in_use(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 mi = mallinfo2();
+#else
+    struct mallinfo mi = mallinfo();
+#endif
+
+    return (long) mi.uordblks + (long) mi.hblkhd;
+}
+
+static team_mem_entry_t *team_mem_find(shmem_team_t team) {
+    int i;
+
+    for (i = team_mem_count - 1; i >= 0; i--) {
+        if (team_mem_table[i].team == team) {
+            return &team_mem_table[i];
+        }
+    }
+    return NULL;
+}
+
+/* record the teams of one split, sharing the metadata bytes among them */
+static void team_mem_record(shmem_team_t *teams, int nteams, long bytes) {
+    int i, created = 0;
+
+    for (i = 0; i < nteams; i++) {
+        created += (teams[i] != SHMEM_TEAM_NULL);
+    }
+    for (i = 0; i < nteams; i++) {
+        if (teams[i] == SHMEM_TEAM_NULL) {
+            continue;
+        }
+        if (team_mem_count == team_mem_max) {
+            team_mem_max = team_mem_max ? 2 * team_mem_max : 64;
+            team_mem_table = realloc(team_mem_table,
+                                     team_mem_max * sizeof(*team_mem_table));
+            if (team_mem_table == NULL) {
+                fprintf(stderr, "team_mem: cannot grow the team table\n");
+                shmem_global_exit(1);
+            }
+        }
+        memset(&team_mem_table[team_mem_count], 0, sizeof(team_mem_entry_t));
+        team_mem_table[team_mem_count].team = teams[i];
+        team_mem_table[team_mem_count].mem.bytes[TEAM_MEM_METADATA] =
+            (bytes > 0) ? bytes / created : 0;
+        team_mem_count++;
+    }
+}
+
+void team_mem_split_color(shmem_team_t parent_team, int color, int key,
+                          shmem_team_t *new_team) {
+    long in_use = team_mem_in_use();
+
+    shmemx_team_split_color(parent_team, color, key, new_team);
+    team_mem_record(new_team, 1, team_mem_in_use() - in_use);
+}
+
+void team_mem_split_strided(shmem_team_t parent_team, int PE_start,
+                            int PE_stride, int PE_size,
+                            shmem_team_t *new_team) {
+    long in_use = team_mem_in_use();
+
+    shmemx_team_split_strided(parent_team, PE_start, PE_stride, PE_size,
+                              new_team);
+    team_mem_record(new_team, 1, team_mem_in_use() - in_use);
+}
+
+void team_mem_split_2d(shmem_team_t parent_team, int xrange, int yrange,
+                       shmem_team_t *xaxis_team, shmem_team_t *yaxis_team) {
+    shmem_team_t teams[2];
+    long in_use = team_mem_in_use();
+
+    shmemx_team_split_2d(parent_team, xrange, yrange, xaxis_team,
+                         yaxis_team);
+    teams[0] = *xaxis_team;
+    teams[1] = *yaxis_team;
+    team_mem_record(teams, 2, team_mem_in_use() - in_use);
+}
+
+void team_mem_split_3d(shmem_team_t parent_team, int xrange, int yrange,
+                       int zrange, shmem_team_t *xaxis_team,
+                       shmem_team_t *yaxis_team, shmem_team_t *zaxis_team) {
+    shmem_team_t teams[3];
+    long in_use = team_mem_in_use();
+
+    shmemx_team_split_3d(parent_team, xrange, yrange, zrange, xaxis_team,
+                         yaxis_team, zaxis_team);
+    teams[0] = *xaxis_team;
+    teams[1] = *yaxis_team;
+    teams[2] = *zaxis_team;
+    team_mem_record(teams, 3, team_mem_in_use() - in_use);
+}
+
+void team_mem_add(shmem_team_t team, int category, long bytes) {
+    team_mem_entry_t *e = team_mem_find(team);
+
+    if (e == NULL || category < 0 || category >= TEAM_MEM_NCATEGORIES) {
+        fprintf(stderr, "team_mem_add: unknown team or category %d\n",
+                category);
+        shmem_global_exit(1);
+    }
+    e->mem.bytes[category] += bytes;
+}
+
+int team_mem_query(shmem_team_t team, team_mem_t *mem) {
+    team_mem_entry_t *e = team_mem_find(team);
+
+    if (e == NULL) {
+        return -1;
+    }
+    *mem = e->mem;
+    return 0;
+}
+
+int team_mem_total(team_mem_t *mem) {
+    int i, c;
+
+    memset(mem, 0, sizeof(*mem));
+    for (i = 0; i < team_mem_count; i++) {
+        for (c = 0; c < TEAM_MEM_NCATEGORIES; c++) {
+            mem->bytes[c] += team_mem_table[i].mem.bytes[c];
+        }
+    }
+    return team_mem_count;
+}
+
+void team_mem_destroy(shmem_team_t *team) {
+    team_mem_entry_t *e = team_mem_find(*team);
+
+    if (e != NULL) {
+        *e = team_mem_table[--team_mem_count];
+    }
+    shmemx_team_destroy(team);
+}
+
+#define NCOUNTS 4
+#define N       1
+
+#define MAX(a, b) ((a > b) ? a : b)
+#define PWRK_MAX_SIZE MAX(N/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE)
+
+static const int counts[NCOUNTS] = { 1, 10, 100, 10000 };
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/* resident set size of the PE in KB */
+static long rss_kb(void) {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f != NULL) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char *argv[]) {
+    int i, k;
+    int me, npes, ncolors, nteams;
+    long rss;
+    double t;
+    shmem_team_t *teams;
+    team_mem_t mem, first;
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+    ncolors = MAX(npes / 2, 1);
+
+    teams = malloc(counts[NCOUNTS - 1] * sizeof(shmem_team_t));
+
+    if (me == 0) {
+        printf("npes %d, %d colors, bytes per team and in total on PE 0\n",
+               npes, ncolors);
+        printf("%6s %12s %10s %10s %10s %12s %10s\n", "teams", "create us",
+               "metadata", "sync", "symmetric", "total", "RSS KB");
+    }
+
+    for (k = 0; k < NCOUNTS; k++) {
+        shmem_barrier_all();
+        rss = rss_kb();
+        t = wtime();
+        for (nteams = 0; nteams < counts[k]; nteams++) {
+            team_mem_split_color(SHMEM_TEAM_WORLD, me % ncolors, me,
+                                 &teams[nteams]);
+            team_mem_add(teams[nteams], TEAM_MEM_SYNC,
+                         SHMEM_REDUCE_SYNC_SIZE * sizeof(long) +
+                         PWRK_MAX_SIZE * sizeof(double));
+        }
+        t = wtime() - t;
+        rss = rss_kb() - rss;
+
+        team_mem_total(&mem);
+        if (team_mem_query(teams[0], &first) != 0) {
+            memset(&first, 0, sizeof(first));
+        }
+
+        if (me == 0) {
+            printf("%6d %12.2f %10ld %10ld %10ld %12ld %10ld\n", nteams,
+                   t * 1.0e6, first.bytes[TEAM_MEM_METADATA],
+                   first.bytes[TEAM_MEM_SYNC],
+                   first.bytes[TEAM_MEM_SYMMETRIC],
+                   mem.bytes[TEAM_MEM_METADATA] + mem.bytes[TEAM_MEM_SYNC] +
+                   mem.bytes[TEAM_MEM_SYMMETRIC], rss);
+        }
+
+        shmem_barrier_all();
+        for (i = 0; i < nteams; i++) {
+            team_mem_destroy(&teams[i]);
+        }
+    }
+
+    shmem_barrier_all();
+    free(teams);
+    shmem_finalize();
+    return 0;
+}
@@ -0,0 +1,412 @@
+/*
+ * Example program to show a world reduction over the axis teams of a
+ * two or three dimensional grid
+ *
+ * SYNOPSIS:
+ * void team_grid_init(   int            ndims,
+ *                        const int     *dims,
+ *                        int            max_nreduce )
+ *
+ * void team_grid_dims(   int           *ndims,
+ *                        int           *dims )
+ *
+ * void team_grid_<datatype>_<op>_to_all( <datatype>  *dest,
+ *                                        <datatype>  *source,
+ *                                        int          nreduce )
+ *
+ * void team_grid_finalize( void )
+ *
+ * DESCRIPTION:
+ * A reduction over SHMEM_TEAM_WORLD on a large machine funnels all of
+ * its traffic through the same links. Laying the PEs out on a grid and
+ * reducing along the xaxis_team, then along the yaxis_team, and for
+ * three dimensions along the zaxis_team, gives the same result with
+ * every pass confined to one dimension of the grid. When the x dimension
+ * matches the PEs of a node, the first pass stays inside the node and
+ * the later ones only carry one contribution per node over the network.
+ *
+ * team_grid_init is called once by all PEs after shmem_init. It chooses
+ * the grid and allocates two pWrk arrays per axis and the symmetric
+ * buffers carrying the partial results from one pass to the next, all
+ * large enough for max_nreduce elements of any type. The axis teams are
+ * created with shmemx_team_split_2d or shmemx_team_split_3d by the first
+ * grid reduction and kept for all later ones.
+ *
+ * The grid is taken from the environment variable TEAM_GRID_DIMS if it
+ * is set, for example 16x8 or 8x4x4, which describes a synthetic
+ * topology. Otherwise the dimensions given in dims are used, and the
+ * ones left 0 are chosen: the x dimension is the number of PEs per node
+ * when the PEs of each node are numbered consecutively, and the other
+ * dimensions split the remaining PEs as evenly as possible. The product
+ * of the dimensions must be the number of PEs. team_grid_dims returns
+ * the grid in use.
+ *
+ * team_grid_<datatype>_<op>_to_all is a collective routine over all PEs
+ * and has the semantics of shmemx_team_<datatype>_<op>_to_all on
+ * SHMEM_TEAM_WORLD. Each pass but the last reduces into an intermediate
+ * buffer which is the source of the next pass, and only the last one
+ * writes dest. Each axis has its own pWrk and pSync arrays, and
+ * consecutive calls alternate between two pairs of them and two sets of
+ * intermediate buffers. A buffer is thus only written again two calls
+ * later, once every PE reading it has finished, so neither the passes
+ * nor consecutive calls need a barrier between them. It is available
+ * for the same datatypes and operations as the team reductions.
+ *
+ * team_grid_finalize destroys the axis teams and frees the pWrk arrays
+ * and intermediate buffers. It is called by all PEs.
+ *
+ * The grid reduction routines support the following options:
+ *
+ * ndims
+ *          2 or 3.
+ *
+ * dims
+ *          Size of each dimension, 0 to have it chosen.
+ *
+ * max_nreduce
+ *          Largest nreduce of any grid reduction.
+ *
+ * dest, source, nreduce
+ *          As for shmemx_team_<datatype>_<op>_to_all.
+ *
+ * EXAMPLE DETAILS:
+ * The example program runs double sum reductions of 1 to 65536 elements
+ * on all PEs, once with shmemx_team_double_sum_to_all on
+ * SHMEM_TEAM_WORLD and once with team_grid_double_sum_to_all on a two
+ * dimensional grid, and checks that both give the same result. PE 0
+ * prints the grid and the time per reduction of both.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+
+#define TEAM_GRID_MAX_DIMS  3
+
+static int           grid_ndims;
+static int           grid_dims[TEAM_GRID_MAX_DIMS];
+static int           grid_max_nreduce;
+static long          grid_calls;
+static shmem_team_t  grid_axis[TEAM_GRID_MAX_DIMS];
+static void         *grid_pWrk[2][TEAM_GRID_MAX_DIMS];
+static void         *grid_buf[2][TEAM_GRID_MAX_DIMS - 1];
+
+long grid_pSync[TEAM_GRID_MAX_DIMS][2][SHMEM_REDUCE_SYNC_SIZE];
+long grid_pWrk_small[SHMEM_REDUCE_MIN_WRKDATA_SIZE];
+long grid_long_src, grid_long_dst;
+long grid_host;
+
+static long grid_host_id(void) {
+    char name[256];
+    unsigned long h = 5381;
+    char *c;
+
+    if (gethostname(name, sizeof(name)) != 0) {
+        return 0;
+    }
+    name[sizeof(name) - 1] = '\0';
+    for (c = name; *c; c++) {
+        h = h * 33 + (unsigned char) *c;
+    }
+    return (long) (h & 0x7fffffffffffL);
+}
+
+static long grid_max_all(long value) {
+    grid_long_src = value;
+    shmem_barrier_all();
+    shmemx_team_long_max_to_all(SHMEM_TEAM_WORLD, &grid_long_dst,
+                                &grid_long_src, 1, grid_pWrk_small,
+                                grid_pSync[0][grid_calls++ & 1]);
+    return grid_long_dst;
+}
+
+/* PEs per node if the PEs of every node are numbered consecutively */
+static int grid_node_size(void) {
+    int me = shmem_my_pe(), npes = shmem_n_pes();
+    long ppn = 0, bad;
+
+    grid_host = grid_host_id();
+    shmem_barrier_all();
+    if (me == 0) {
+        for (ppn = 1; ppn < npes; ppn++) {
+            if (shmem_long_g(&grid_host, ppn) != grid_host) {
+                break;
+            }
+        }
+    }
+    ppn = grid_max_all(ppn);
+
+    bad = (npes % ppn != 0) ||
+          ((me % ppn != 0) != (me > 0 &&
+                               shmem_long_g(&grid_host, me - 1) == grid_host));
+    return grid_max_all(bad) ? 1 : (int) ppn;
+}
+
+/* the largest divisor of n not above its k-th root */
+static int grid_divisor(int n, int k) {
+    int d, i, best = 1;
+    long p;
+
+    for (d = 1; ; d++) {
+        for (p = 1, i = 0; i < k; i++) {
+            p *= d;
+        }
+        if (p > n) {
+            break;
+        }
+        if (n % d == 0) {
+            best = d;
+        }
+    }
+    return best;
+}
+
+void team_grid_init(int ndims, const int *dims, int max_nreduce) {
+    int npes = shmem_n_pes();
+    int d, i, j, rest, open, product;
+    char *env = getenv("TEAM_GRID_DIMS");
+    size_t pwrk_size;
+
+    for (d = 0; d < TEAM_GRID_MAX_DIMS; d++) {
+        for (i = 0; i < 2; i++) {
+            for (j = 0; j < SHMEM_REDUCE_SYNC_SIZE; j++) {
+                grid_pSync[d][i][j] = SHMEM_SYNC_VALUE;
+            }
+        }
+        grid_axis[d] = SHMEM_TEAM_NULL;
+        grid_dims[d] = 1;
+    }
+    grid_calls = 0;
+
+    if (env != NULL) {
+        ndims = sscanf(env, "%dx%dx%d", &grid_dims[0], &grid_dims[1],
+                       &grid_dims[2]);
+    } else if (ndims >= 2 && ndims <= TEAM_GRID_MAX_DIMS) {
+        for (d = 0; d < ndims; d++) {
+            grid_dims[d] = dims[d];
+        }
+        if (grid_dims[0] == 0) {
+            grid_dims[0] = grid_node_size();
+            if (grid_dims[0] == 1 || grid_dims[0] == npes) {
+                grid_dims[0] = 0;
+            }
+        }
+        rest = npes;
+        open = 0;
+        for (d = 0; d < ndims; d++) {
+            if (grid_dims[d] > 0) {
+                rest /= grid_dims[d];
+            } else {
+                open++;
+            }
+        }
+        for (d = 0; d < ndims; d++) {
+            if (grid_dims[d] == 0) {
+                grid_dims[d] = grid_divisor(rest, open--);
+                rest /= grid_dims[d];
+            }
+        }
+    }
+
+    product = 1;
+    for (d = 0; d < TEAM_GRID_MAX_DIMS; d++) {
+        product *= grid_dims[d];
+    }
+    if (ndims < 2 || ndims > TEAM_GRID_MAX_DIMS || product != npes) {
+        fprintf(stderr, "team_grid_init: invalid %d dimensional grid "
+                "%d x %d x %d for %d PEs\n", ndims, grid_dims[0],
+                grid_dims[1], grid_dims[2], npes);
+        shmem_global_exit(1);
+    }
+    grid_ndims = ndims;
+    grid_max_nreduce = max_nreduce;
+
+    pwrk_size = ((max_nreduce / 2 + 1 > SHMEM_REDUCE_MIN_WRKDATA_SIZE) ?
+                 max_nreduce / 2 + 1 : SHMEM_REDUCE_MIN_WRKDATA_SIZE) *
+                sizeof(long double);
+    for (i = 0; i < 2; i++) {
+        for (d = 0; d < grid_ndims; d++) {
+            grid_pWrk[i][d] = shmem_malloc(pwrk_size);
+        }
+        for (d = 0; d < grid_ndims - 1; d++) {
+            grid_buf[i][d] = shmem_malloc(max_nreduce * sizeof(long double));
+        }
+    }
+}
+
+void team_grid_dims(int *ndims, int *dims) {
+    int d;
+
+    *ndims = grid_ndims;
+    for (d = 0; d < grid_ndims; d++) {
+        dims[d] = grid_dims[d];
+    }
+}
+
+static void team_grid_build(void) {
+    if (grid_axis[0] != SHMEM_TEAM_NULL) {
+        return;
+    }
+    if (grid_ndims == 2) {
+        shmemx_team_split_2d(SHMEM_TEAM_WORLD, grid_dims[0], grid_dims[1],
+                             &grid_axis[0], &grid_axis[1]);
+    } else {
+        shmemx_team_split_3d(SHMEM_TEAM_WORLD, grid_dims[0], grid_dims[1],
+                             grid_dims[2], &grid_axis[0], &grid_axis[1],
+                             &grid_axis[2]);
+    }
+}
+
+void team_grid_finalize(void) {
+    int d, i;
+
+    shmem_barrier_all();
+    for (d = 0; d < grid_ndims; d++) {
+        if (grid_axis[d] != SHMEM_TEAM_NULL) {
+            shmemx_team_destroy(&grid_axis[d]);
+        }
+    }
+    for (i = 0; i < 2; i++) {
+        for (d = 0; d < grid_ndims; d++) {
+            shmem_free(grid_pWrk[i][d]);
+        }
+        for (d = 0; d < grid_ndims - 1; d++) {
+            shmem_free(grid_buf[i][d]);
+        }
+    }
+}
+
+#define DEFINE_GRID(TYPE, NAME, OPNAME)                                      \
+void team_grid_##NAME##_##OPNAME##_to_all(TYPE *dest, TYPE *source,          \
+                                          int nreduce) {                     \
+    int d;                                                                   \
+    void **buf = grid_buf[grid_calls & 1];                                   \
+                                                                             \
+    if (nreduce > grid_max_nreduce) {                                        \
+        fprintf(stderr, "team_grid_" #NAME "_" #OPNAME "_to_all: nreduce "   \
+                "%d above %d\n", nreduce, grid_max_nreduce);                 \
+        shmem_global_exit(1);                                                \
+    }                                                                        \
+    team_grid_build();                                                       \
+    for (d = 0; d < grid_ndims; d++) {                                       \
+        shmemx_team_##NAME##_##OPNAME##_to_all(grid_axis[d],                 \
+            (d == grid_ndims - 1) ? dest : (TYPE *) buf[d],                  \
+            d ? (TYPE *) buf[d - 1] : source, nreduce,                       \
+            (TYPE *) grid_pWrk[grid_calls & 1][d],                           \
+            grid_pSync[d][grid_calls & 1]);                                  \
+    }                                                                        \
+    grid_calls++;                                                            \
+}
+
+#define DEFINE_GRID_ARITH(TYPE, NAME)                                        \
+    DEFINE_GRID(TYPE, NAME, sum)                                             \
+    DEFINE_GRID(TYPE, NAME, prod)                                            \
+    DEFINE_GRID(TYPE, NAME, max)                                             \
+    DEFINE_GRID(TYPE, NAME, min)
+
+#define DEFINE_GRID_BITWISE(TYPE, NAME)                                      \
+    DEFINE_GRID(TYPE, NAME, and)                                             \
+    DEFINE_GRID(TYPE, NAME, or)                                              \
+    DEFINE_GRID(TYPE, NAME, xor)
+
+DEFINE_GRID_ARITH(short, short)
+DEFINE_GRID_ARITH(int, int)
+DEFINE_GRID_ARITH(long, long)
+DEFINE_GRID_ARITH(long long, longlong)
+DEFINE_GRID_ARITH(float, float)
+DEFINE_GRID_ARITH(double, double)
+DEFINE_GRID_ARITH(long double, longdouble)
+DEFINE_GRID_BITWISE(short, short)
+DEFINE_GRID_BITWISE(int, int)
+DEFINE_GRID_BITWISE(long, long)
+DEFINE_GRID_BITWISE(long long, longlong)
+
+#define NSIZES  5
+#define NITER   50
+#define MAX_N   65536
+
+#define MAX(a, b) ((a > b) ? a : b)
+#define PWRK_MAX_SIZE MAX(MAX_N/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE)
+
+static const int sizes[NSIZES] = { 1, 16, 256, 4096, MAX_N };
+
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+double pWrk[2][PWRK_MAX_SIZE];
+double source[MAX_N], flat[MAX_N], grid[MAX_N];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+int main(int argc, char *argv[]) {
+    int i, k, iter;
+    int me, npes, ndims, errors = 0;
+    int dims[TEAM_GRID_MAX_DIMS] = { 0, 0, 0 };
+    double t_flat, t_grid;
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    for (i = 0; i < MAX_N; i++) {
+        source[i] = me + i % 7;
+    }
+
+    team_grid_init(2, dims, MAX_N);
+    team_grid_dims(&ndims, dims);
+    if (me == 0) {
+        printf("npes %d, grid %d x %d", npes, dims[0], dims[1]);
+        if (ndims == 3) {
+            printf(" x %d", dims[2]);
+        }
+        printf("\n");
+    }
+
+    for (k = 0; k < NSIZES; k++) {
+        shmem_barrier_all();
+        t_flat = wtime();
+        for (iter = 0; iter < NITER; iter++) {
+            shmemx_team_double_sum_to_all(SHMEM_TEAM_WORLD, flat, source,
+                                          sizes[k], pWrk[iter % 2],
+                                          pSync[iter % 2]);
+        }
+        t_flat = (wtime() - t_flat) / NITER;
+
+        shmem_barrier_all();
+        t_grid = wtime();
+        for (iter = 0; iter < NITER; iter++) {
+            team_grid_double_sum_to_all(grid, source, sizes[k]);
+        }
+        t_grid = (wtime() - t_grid) / NITER;
+
+        for (i = 0; i < sizes[k]; i++) {
+            if (grid[i] != flat[i]) {
+                errors++;
+            }
+        }
+
+        if (me == 0) {
+            printf("nreduce %6d: world %10.2f us, grid %10.2f us\n",
+                   sizes[k], t_flat * 1.0e6, t_grid * 1.0e6);
+        }
+    }
+
+    if (errors) {
+        printf("Global PE %d has %d grid results differing from world\n",
+               me, errors);
+    }
+
+    team_grid_finalize();
+    shmem_finalize();
+    return 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * Example program to show huge page backing of team reduction buffers
+ *
+ * SYNOPSIS:
+ * size_t team_huge_advise(    void         *addr,
+ *                             size_t        len,
+ *                             int           enable )
+ *
+ * size_t team_huge_page_size( const void   *addr,
+ *                             size_t        len )
+ *
+ * DESCRIPTION:
+ * Large source, dest and pWrk arrays of shmemx_team_<datatype>_<op>_to_all
+ * spread over many base pages, which costs TLB misses in the local
+ * combine step and page entries in the network registration. Backing
+ * them with huge pages removes most of that cost.
+ *
+ * With Cray SHMEM, the symmetric heap is placed on huge pages when the
+ * program is linked with one of the craype-hugepages modules, for
+ * example craype-hugepages2M or craype-hugepages1G. Otherwise the
+ * symmetric heap is built from base pages, and the kernel may still back
+ * it with transparent huge pages.
+ *
+ * team_huge_advise asks for transparent huge pages on the whole huge
+ * pages inside the range, with enable set, or for base pages with enable
+ * cleared, and returns the page size then backing the range. It is a hint:
+ * if transparent huge pages are disabled or not available for the
+ * memory, the range keeps its pages, so the call can be left in place on
+ * every system. Pages which are already in memory are only changed by
+ * the kernel later, so it is best called right after the buffer has been
+ * allocated and before it is first written.
+ *
+ * team_huge_page_size returns the size of the pages backing most of the
+ * range: the huge page size for memory on huge pages set up at link
+ * time, the transparent huge page size when at least half of the
+ * resident memory of the range is on transparent huge pages, and the
+ * base page size otherwise. The kernel only reports huge pages per
+ * mapping, so every mapping overlapping the range counts in proportion
+ * to the part of it inside the range; madvise splits mappings at the
+ * boundaries of the advised range, so an advised buffer is measured on
+ * its own. Both routines are local and read /proc/self/smaps.
+ *
+ * The huge page routines support the following options:
+ *
+ * addr, len
+ *          Range of memory of the calling PE, symmetric or not.
+ *
+ * enable
+ *          Nonzero to ask for huge pages, zero to ask for base pages.
+ *
+ * EXAMPLE DETAILS:
+ * The example program runs shmemx_team_double_sum_to_all on
+ * SHMEM_TEAM_WORLD for vectors of 1 MB up to MAX_MB MB, 1024 unless
+ * another size is given on the command line. This is done once with
+ * source, dest and pWrk advised to base pages and once advised to huge
+ * pages. Each mode has its own buffers, all allocated and advised before
+ * any of them is written, since the kernel does not change the pages of
+ * memory already in use. PE 0 prints the page size obtained and the
+ * bandwidth of every size.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE   14
+#endif
+#ifndef MADV_NOHUGEPAGE
+#define MADV_NOHUGEPAGE 15
+#endif
+
+/* the transparent huge page size, 2 MB on x86-64 */
+static size_t team_huge_thp_size(void) {
+    unsigned long size = 0;
+    FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size",
+                    "r");
+
+    if (f != NULL) {
+        if (fscanf(f, "%lu", &size) != 1) {
+            size = 0;
+        }
+        fclose(f);
+    }
+    return size ? size : 2UL << 20;
+}
+
+size_t team_huge_page_size(const void *addr, size_t len) {
+    char line[512];
+    unsigned long start, end, kb;
+    unsigned long lo = (unsigned long) addr, hi = lo + len;
+    unsigned long kernel_kb = 0;
+    double frac = 0.0, rss_kb = 0.0, huge_kb = 0.0;
+    FILE *f = fopen("/proc/self/smaps", "r");
+
+    if (f == NULL) {
+        return sysconf(_SC_PAGESIZE);
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            /* share of this mapping inside the range */
+            frac = (start < hi && end > lo) ?
+                   (double) ((end < hi ? end : hi) - (start > lo ? start : lo))
+                   / (end - start) : 0.0;
+        } else if (frac > 0.0) {
+            if (sscanf(line, "KernelPageSize: %lu kB", &kb) == 1) {
+                kernel_kb = (kb > kernel_kb) ? kb : kernel_kb;
+            } else if (sscanf(line, "Rss: %lu kB", &kb) == 1) {
+                rss_kb += frac * kb;
+            } else if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+                       sscanf(line, "ShmemPmdMapped: %lu kB", &kb) == 1 ||
+                       sscanf(line, "FilePmdMapped: %lu kB", &kb) == 1) {
+                huge_kb += frac * kb;
+            }
+        }
+    }
+    fclose(f);
+
+    if (kernel_kb * 1024 > (unsigned long) sysconf(_SC_PAGESIZE)) {
+        return kernel_kb * 1024;
+    }
+    if (huge_kb > 0.0 && 2.0 * huge_kb >= rss_kb) {
+        return team_huge_thp_size();
+    }
+    return sysconf(_SC_PAGESIZE);
+}
+
+size_t team_huge_advise(void *addr, size_t len, int enable) {
+    size_t huge  = team_huge_thp_size();
+    char  *start = (char *) (((unsigned long) addr + huge - 1) & ~(huge - 1));
+    char  *end   = (char *) (((unsigned long) addr + len) & ~(huge - 1));
+
+    if (end > start) {
+        madvise(start, end - start, enable ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+    }
+    return team_huge_page_size(addr, len);
+}
+
+#define MAX_MB  1024
+#define NITER   3
+
+#define MAX(a, b) ((a > b) ? a : b)
+
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+int main(int argc, char *argv[]) {
+    int i, iter, mode;
+    int me;
+    long max_mb = (argc > 1) ? atol(argv[1]) : MAX_MB;
+    long mb, n, max_n, pwrk_size;
+    size_t page[3], wrk_bytes;
+    double *source[2], *dest[2], *pWrk[2], t;
+
+    shmem_init();
+    me = shmem_my_pe();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+
+    max_n     = (max_mb << 20) / sizeof(double);
+    pwrk_size = MAX(max_n/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE);
+    /* two halves, alternated between consecutive reductions */
+    wrk_bytes = 2 * pwrk_size * sizeof(double);
+
+    /* no buffer may be touched before all of them have been advised */
+    for (mode = 0; mode < 2; mode++) {
+        source[mode] = shmem_malloc(max_n * sizeof(double));
+        dest[mode]   = shmem_malloc(max_n * sizeof(double));
+        pWrk[mode]   = shmem_malloc(wrk_bytes);
+        if (source[mode] == NULL || dest[mode] == NULL ||
+            pWrk[mode] == NULL) {
+            if (me == 0) {
+                printf("cannot allocate %ld MB vectors\n", max_mb);
+            }
+            shmem_global_exit(1);
+        }
+
+        team_huge_advise(source[mode], max_n * sizeof(double), mode);
+        team_huge_advise(dest[mode], max_n * sizeof(double), mode);
+        team_huge_advise(pWrk[mode], wrk_bytes, mode);
+    }
+
+    for (mode = 0; mode < 2; mode++) {
+        for (n = 0; n < max_n; n++) {
+            source[mode][n] = me + n;
+            dest[mode][n] = 0.0;
+        }
+        memset(pWrk[mode], 0, wrk_bytes);
+        page[0] = team_huge_page_size(source[mode], max_n * sizeof(double));
+        page[1] = team_huge_page_size(dest[mode], max_n * sizeof(double));
+        page[2] = team_huge_page_size(pWrk[mode], wrk_bytes);
+
+        if (me == 0) {
+            printf("%s pages requested: source %zu KB, dest %zu KB, "
+                   "pWrk %zu KB pages obtained\n", mode ? "huge" : "base",
+                   page[0] >> 10, page[1] >> 10, page[2] >> 10);
+        }
+
+        for (mb = 1; mb <= max_mb; mb *= 4) {
+            n = (mb << 20) / sizeof(double);
+
+            shmem_barrier_all();
+            t = wtime();
+            for (iter = 0; iter < NITER; iter++) {
+                shmemx_team_double_sum_to_all(SHMEM_TEAM_WORLD, dest[mode],
+                                              source[mode], n,
+                                              pWrk[mode] +
+                                              (iter % 2) * pwrk_size,
+                                              pSync[iter % 2]);
+            }
+            t = (wtime() - t) / NITER;
+
+            if (me == 0) {
+                printf("  %5ld MB: %10.2f ms, %8.2f MB/s\n", mb, t * 1.0e3,
+                       mb / t);
+            }
+        }
+    }
+
+    shmem_barrier_all();
+    for (mode = 1; mode >= 0; mode--) {
+        shmem_free(pWrk[mode]);
+        shmem_free(dest[mode]);
+        shmem_free(source[mode]);
+    }
+
+    shmem_finalize();
+    return 0;
+}
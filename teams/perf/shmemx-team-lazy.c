@@ -0,0 +1,337 @@
+/*
+ * Example program to show lazy materialization of split teams
+ *
+ * SYNOPSIS:
+ * void team_lazy_split_strided( shmem_team_t   parent_team,
+ *                               int            PE_start,
+ *                               int            PE_stride,
+ *                               int            PE_size,
+ *                               team_lazy_t  **new_team )
+ *
+ * void team_lazy_split_2d(      shmem_team_t   parent_team,
+ *                               int            xrange,
+ *                               int            yrange,
+ *                               team_lazy_t  **xaxis_team,
+ *                               team_lazy_t  **yaxis_team )
+ *
+ * void team_lazy_split_3d(      shmem_team_t   parent_team,
+ *                               int            xrange,
+ *                               int            yrange,
+ *                               int            zrange,
+ *                               team_lazy_t  **xaxis_team,
+ *                               team_lazy_t  **yaxis_team,
+ *                               team_lazy_t  **zaxis_team )
+ *
+ * int          team_lazy_my_pe(   team_lazy_t  *team )
+ * int          team_lazy_n_pes(   team_lazy_t  *team )
+ * shmem_team_t team_lazy_get(     team_lazy_t  *team )
+ * void         team_lazy_destroy( team_lazy_t **team )
+ *
+ * DESCRIPTION:
+ * Every team returned by a shmemx_team_split_* routine carries its
+ * metadata and resources from the moment it is created, whether it is
+ * used or not. The lazy split routines only record what the calling PE
+ * needs to know about its membership: the PE triplet of the new team in
+ * the parent team and its own position in it. They involve no
+ * communication. PEs that are not members get a NULL handle.
+ *
+ * team_lazy_my_pe and team_lazy_n_pes are answered from the record and
+ * never create the team. The team is created on the first call to
+ * team_lazy_get, which returns a team handle that can be passed to any
+ * team routine. team_lazy_get is a collective routine over the members
+ * of the team, so all of them must make their first call to it for the
+ * same collective; the simplest rule is to call it as the team argument
+ * of every collective on the team. The team is created with
+ * shmemx_team_split_strided, which is only called by the PEs in the
+ * triplet; the parent team must still be valid at that point.
+ *
+ * The axis teams of team_lazy_split_2d and team_lazy_split_3d are the
+ * same as those of shmemx_team_split_2d and shmemx_team_split_3d: the
+ * parent team PEs are laid out with x varying fastest, and each axis
+ * team is a strided subset of the parent team.
+ *
+ * team_lazy_destroy destroys the team if it has been created and
+ * releases the record.
+ *
+ * The lazy split routines support the following options:
+ *
+ * parent_team, PE_start, PE_stride, PE_size, xrange, yrange, zrange
+ *          As for the corresponding shmemx_team_split_* routine.
+ *
+ * new_team, xaxis_team, yaxis_team, zaxis_team
+ *          New lazy team handles, or NULL if the calling PE is not a
+ *          member.
+ *
+ * EXAMPLE DETAILS:
+ * The example program creates NSETS sets of split_3d axis teams and then
+ * runs one reduction on the xaxis_team and yaxis_team of every set, the
+ * zaxis_team is never used. This is done once with shmemx_team_split_3d
+ * and once with team_lazy_split_3d. PE 0 prints the creation time, the
+ * time to the end of the reductions and the growth of the resident
+ * memory of the PE.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+
+typedef struct {
+    shmem_team_t parent;
+    int          start;
+    int          stride;
+    int          size;
+    int          my_pe;
+    shmem_team_t team;
+} team_lazy_t;
+
+static team_lazy_t *team_lazy_new(shmem_team_t parent, int start,
+                                  int stride, int size, int my_pe) {
+    team_lazy_t *t = malloc(sizeof(*t));
+
+    t->parent = parent;
+    t->start  = start;
+    t->stride = stride;
+    t->size   = size;
+    t->my_pe  = my_pe;
+    t->team   = SHMEM_TEAM_NULL;
+    return t;
+}
+
+void team_lazy_split_strided(shmem_team_t parent_team, int PE_start,
+                             int PE_stride, int PE_size,
+                             team_lazy_t **new_team) {
+    int p_pe = shmemx_team_my_pe(parent_team);
+    int p_size = shmemx_team_n_pes(parent_team);
+
+    if (PE_start < 0 || PE_stride < 1 || PE_size < 1 ||
+        PE_start + (PE_size - 1) * PE_stride >= p_size) {
+        fprintf(stderr, "team_lazy_split_strided: invalid triplet "
+                "(%d, %d, %d)\n", PE_start, PE_stride, PE_size);
+        shmem_global_exit(1);
+    }
+
+    if (p_pe < PE_start || (p_pe - PE_start) % PE_stride != 0 ||
+        (p_pe - PE_start) / PE_stride >= PE_size) {
+        *new_team = NULL;
+        return;
+    }
+    *new_team = team_lazy_new(parent_team, PE_start, PE_stride, PE_size,
+                              (p_pe - PE_start) / PE_stride);
+}
+
+void team_lazy_split_2d(shmem_team_t parent_team, int xrange, int yrange,
+                        team_lazy_t **xaxis_team, team_lazy_t **yaxis_team) {
+    int p_pe = shmemx_team_my_pe(parent_team);
+    int x = p_pe % xrange;
+    int y = p_pe / xrange;
+
+    if (p_pe >= xrange * yrange) {
+        *xaxis_team = NULL;
+        *yaxis_team = NULL;
+        return;
+    }
+    *xaxis_team = team_lazy_new(parent_team, y * xrange, 1, xrange, x);
+    *yaxis_team = team_lazy_new(parent_team, x, xrange, yrange, y);
+}
+
+void team_lazy_split_3d(shmem_team_t parent_team, int xrange, int yrange,
+                        int zrange, team_lazy_t **xaxis_team,
+                        team_lazy_t **yaxis_team, team_lazy_t **zaxis_team) {
+    int p_pe  = shmemx_team_my_pe(parent_team);
+    int plane = xrange * yrange;
+    int x = p_pe % xrange;
+    int y = (p_pe / xrange) % yrange;
+    int z = p_pe / plane;
+
+    if (p_pe >= plane * zrange) {
+        *xaxis_team = NULL;
+        *yaxis_team = NULL;
+        *zaxis_team = NULL;
+        return;
+    }
+    *xaxis_team = team_lazy_new(parent_team, y * xrange + z * plane, 1,
+                                xrange, x);
+    *yaxis_team = team_lazy_new(parent_team, x + z * plane, xrange,
+                                yrange, y);
+    *zaxis_team = team_lazy_new(parent_team, x + y * xrange, plane,
+                                zrange, z);
+}
+
+int team_lazy_my_pe(team_lazy_t *t) {
+    return t->my_pe;
+}
+
+int team_lazy_n_pes(team_lazy_t *t) {
+    return t->size;
+}
+
+shmem_team_t team_lazy_get(team_lazy_t *t) {
+    if (t->team == SHMEM_TEAM_NULL) {
+        shmemx_team_split_strided(t->parent, t->start, t->stride, t->size,
+                                  &t->team);
+    }
+    return t->team;
+}
+
+void team_lazy_destroy(team_lazy_t **t) {
+    if (*t == NULL) {
+        return;
+    }
+    if ((*t)->team != SHMEM_TEAM_NULL) {
+        shmemx_team_destroy(&(*t)->team);
+    }
+    free(*t);
+    *t = NULL;
+}
+
+#define NSETS   32
+#define N       3
+
+#define MAX(a, b) ((a > b) ? a : b)
+#define PWRK_MAX_SIZE MAX(N/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE)
+
+/* one pair per axis team, alternated between consecutive sets */
+long pSync[2][2][SHMEM_REDUCE_SYNC_SIZE];
+double pWrk[2][2][PWRK_MAX_SIZE];
+double dest[N], source[N];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/* resident set size of the PE in KB */
+static long rss_kb(void) {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f != NULL) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char *argv[]) {
+    int i, s;
+    int me, npes;
+    int xrange, yrange, zrange;
+    long rss_eager, rss_lazy;
+    int created = 0;
+    double t_start, t_eager_create, t_eager_total;
+    double t_lazy_create, t_lazy_total;
+    shmem_team_t eager[NSETS][3];
+    team_lazy_t *lazy[NSETS][3];
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][0][i] = SHMEM_SYNC_VALUE;
+        pSync[0][1][i] = SHMEM_SYNC_VALUE;
+        pSync[1][0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][1][i] = SHMEM_SYNC_VALUE;
+    }
+    for (i = 0; i < N; i++) {
+        source[i] = me;
+    }
+
+    xrange = (npes > 4) ? floor(log(npes)/log(2))-1 : 1;
+    yrange = (npes > 4) ? floor(log(npes)/log(2))-1 : 1;
+    zrange = (npes / (xrange*yrange));
+
+    /* eager: every team is created up front */
+    shmem_barrier_all();
+    rss_eager = rss_kb();
+    t_start = wtime();
+    for (s = 0; s < NSETS; s++) {
+        shmemx_team_split_3d(SHMEM_TEAM_WORLD, xrange, yrange, zrange,
+                             &eager[s][0], &eager[s][1], &eager[s][2]);
+    }
+    t_eager_create = wtime() - t_start;
+    for (s = 0; s < NSETS; s++) {
+        for (i = 0; i < 2; i++) {
+            if (eager[s][i] != SHMEM_TEAM_NULL) {
+                shmemx_team_double_sum_to_all(eager[s][i], dest, source, N,
+                                              pWrk[s % 2][i],
+                                              pSync[s % 2][i]);
+            }
+        }
+    }
+    t_eager_total = wtime() - t_start;
+    rss_eager = rss_kb() - rss_eager;
+
+    shmem_barrier_all();
+    for (s = 0; s < NSETS; s++) {
+        for (i = 0; i < 3; i++) {
+            if (eager[s][i] != SHMEM_TEAM_NULL) {
+                shmemx_team_destroy(&eager[s][i]);
+            }
+        }
+    }
+
+    /* lazy: teams are created by their first collective */
+    shmem_barrier_all();
+    rss_lazy = rss_kb();
+    t_start = wtime();
+    for (s = 0; s < NSETS; s++) {
+        team_lazy_split_3d(SHMEM_TEAM_WORLD, xrange, yrange, zrange,
+                           &lazy[s][0], &lazy[s][1], &lazy[s][2]);
+    }
+    t_lazy_create = wtime() - t_start;
+    for (s = 0; s < NSETS; s++) {
+        for (i = 0; i < 2; i++) {
+            if (lazy[s][i] != NULL) {
+                shmemx_team_double_sum_to_all(team_lazy_get(lazy[s][i]),
+                                              dest, source, N,
+                                              pWrk[s % 2][i],
+                                              pSync[s % 2][i]);
+            }
+        }
+    }
+    t_lazy_total = wtime() - t_start;
+    rss_lazy = rss_kb() - rss_lazy;
+
+    for (s = 0; s < NSETS; s++) {
+        for (i = 0; i < 3; i++) {
+            if (lazy[s][i] != NULL && lazy[s][i]->team != SHMEM_TEAM_NULL) {
+                created++;
+            }
+        }
+    }
+
+    if (lazy[0][0] != NULL) {
+        printf("Global PE %d has team_pe of %d out of %d in xaxis_team\n",
+               me, team_lazy_my_pe(lazy[0][0]), team_lazy_n_pes(lazy[0][0]));
+    }
+
+    shmem_barrier_all();
+    for (s = 0; s < NSETS; s++) {
+        for (i = 0; i < 3; i++) {
+            team_lazy_destroy(&lazy[s][i]);
+        }
+    }
+
+    if (me == 0) {
+        printf("npes %d, %d split_3d sets, 2 of 3 axis teams used\n",
+               npes, NSETS);
+        printf("eager: create %10.2f us, create and use %10.2f us, "
+               "%6ld KB\n", t_eager_create * 1.0e6, t_eager_total * 1.0e6,
+               rss_eager);
+        printf("lazy:  create %10.2f us, create and use %10.2f us, "
+               "%6ld KB, %d of %d teams created\n", t_lazy_create * 1.0e6,
+               t_lazy_total * 1.0e6, rss_lazy, created, 3 * NSETS);
+    }
+
+    shmem_barrier_all();
+    shmem_finalize();
+    return 0;
+}
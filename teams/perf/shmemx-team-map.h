@@ -0,0 +1,172 @@
+/*
+ * Team PE mapping and per-team sync arrays shared by the example programs
+ *
+ * SYNOPSIS:
+ * void  team_map_init(    void )
+ *
+ * int  *team_pe_map(      shmem_team_t  team )
+ *
+ * void  team_map_sync(    shmem_team_t  team,
+ *                         long        **pWrk,
+ *                         long        **pSync )
+ *
+ * void  team_map_destroy( shmem_team_t *team )
+ *
+ * DESCRIPTION:
+ * Routines built on puts and atomics need the global PE number of every
+ * team PE, and routines running small reductions of their own on a team
+ * need pSync arrays no other team uses at the same time. A pSync shared
+ * by all teams and alternated on every call is only safe when all PEs
+ * visit the teams in the same order; otherwise two members of a team
+ * pick different arrays for the same reduction.
+ *
+ * team_map_init sets up the symmetric sync arrays used by the other
+ * routines and ends with a barrier over all PEs, so that no PE starts
+ * using them before every PE has initialized its own. It is called by
+ * all PEs once, after shmem_init and before any other of these routines.
+ *
+ * The first call of any of these routines on a team is collective over
+ * the team. It gathers the mapping from team PE numbers to global PE
+ * numbers, and the members agree on a free slot of a symmetric pool,
+ * which holds two pairs of pWrk and pSync arrays owned by the team until
+ * it is destroyed. Both steps use a pSync pair reserved for them, and
+ * the second one only completes when all members have finished the
+ * first. PEs belonging to several teams make their first calls on them
+ * in the same order, as for any collective. Later calls are local.
+ *
+ * team_pe_map returns the mapping, indexed by team PE number.
+ *
+ * team_map_sync returns the team's two pairs of pWrk and pSync arrays
+ * in turn, so that consecutive reductions on the team alternate between
+ * them. Each pWrk array holds SHMEM_REDUCE_MIN_WRKDATA_SIZE longs, enough
+ * for reductions of a few elements.
+ *
+ * team_map_destroy forgets the team and frees its slot, then destroys it
+ * with shmemx_team_destroy. Teams used with these routines are destroyed
+ * with it, so that a later team given the same handle is not mistaken
+ * for the destroyed one. It is collective over the team.
+ *
+ * Running out of slots or mapping a team of more than TEAM_MAP_MAX_PES
+ * PEs is considered fatal.
+ */
+#ifndef SHMEMX_TEAM_MAP_H
+#define SHMEMX_TEAM_MAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <shmem.h>
+#include <shmemx.h>
+
+#define TEAM_MAP_CACHE_SIZE     64
+#define TEAM_MAP_MAX_PES        8192
+
+/* mapping and sync slot of every team in use */
+static struct {
+    shmem_team_t team;
+    int         *pe_map;
+    int          slot;
+    int          sync_idx;
+} map_cache[TEAM_MAP_CACHE_SIZE];
+static int           map_cache_used;
+static unsigned long map_slots_used;
+
+long map_boot_pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+int  map_pWrk[TEAM_MAP_MAX_PES/2+1 + SHMEM_REDUCE_MIN_WRKDATA_SIZE];
+long map_lpWrk[SHMEM_REDUCE_MIN_WRKDATA_SIZE];
+int  map_src[TEAM_MAP_MAX_PES];
+int  map_dst[TEAM_MAP_MAX_PES];
+long map_free_src, map_free_dst;
+
+long map_team_pSync[TEAM_MAP_CACHE_SIZE][2][SHMEM_REDUCE_SYNC_SIZE];
+long map_team_pWrk[TEAM_MAP_CACHE_SIZE][2][SHMEM_REDUCE_MIN_WRKDATA_SIZE];
+
+static inline void team_map_init(void) {
+    int i, j;
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        map_boot_pSync[0][i] = SHMEM_SYNC_VALUE;
+        map_boot_pSync[1][i] = SHMEM_SYNC_VALUE;
+        for (j = 0; j < TEAM_MAP_CACHE_SIZE; j++) {
+            map_team_pSync[j][0][i] = SHMEM_SYNC_VALUE;
+            map_team_pSync[j][1][i] = SHMEM_SYNC_VALUE;
+        }
+    }
+    shmem_barrier_all();
+}
+
+static inline int team_map_entry(shmem_team_t team) {
+    int i, t_size, slot, entry;
+
+    for (entry = 0; entry < map_cache_used; entry++) {
+        if (map_cache[entry].team == team) {
+            return entry;
+        }
+    }
+
+    t_size = shmemx_team_n_pes(team);
+    if (entry == TEAM_MAP_CACHE_SIZE || t_size > TEAM_MAP_MAX_PES) {
+        fprintf(stderr, "team_pe_map: too many teams or team too large\n");
+        shmem_global_exit(1);
+    }
+
+    for (i = 0; i < t_size; i++) {
+        map_src[i] = 0;
+    }
+    map_src[shmemx_team_my_pe(team)] = shmem_my_pe();
+    shmemx_team_int_sum_to_all(team, map_dst, map_src, t_size,
+                               map_pWrk, map_boot_pSync[0]);
+
+    /* the lowest slot free on all members */
+    map_free_src = (long) ~map_slots_used;
+    shmemx_team_long_and_to_all(team, &map_free_dst, &map_free_src, 1,
+                                map_lpWrk, map_boot_pSync[1]);
+    for (slot = 0; slot < TEAM_MAP_CACHE_SIZE; slot++) {
+        if ((unsigned long) map_free_dst & (1UL << slot)) {
+            break;
+        }
+    }
+    if (slot == TEAM_MAP_CACHE_SIZE) {
+        fprintf(stderr, "team_pe_map: no sync slot free on all members\n");
+        shmem_global_exit(1);
+    }
+    map_slots_used |= 1UL << slot;
+
+    map_cache[entry].team      = team;
+    map_cache[entry].pe_map    = malloc(t_size * sizeof(int));
+    map_cache[entry].slot      = slot;
+    map_cache[entry].sync_idx = 0;
+    memcpy(map_cache[entry].pe_map, map_dst, t_size * sizeof(int));
+    map_cache_used++;
+    return entry;
+}
+
+static inline int *team_pe_map(shmem_team_t team) {
+    return map_cache[team_map_entry(team)].pe_map;
+}
+
+static inline void team_map_sync(shmem_team_t team, long **pWrk,
+                                 long **pSync) {
+    int entry = team_map_entry(team);
+    int idx   = map_cache[entry].sync_idx;
+
+    map_cache[entry].sync_idx = !idx;
+    *pWrk  = map_team_pWrk[map_cache[entry].slot][idx];
+    *pSync = map_team_pSync[map_cache[entry].slot][idx];
+}
+
+static inline void team_map_destroy(shmem_team_t *team) {
+    int entry;
+
+    for (entry = 0; entry < map_cache_used; entry++) {
+        if (map_cache[entry].team == *team) {
+            map_slots_used &= ~(1UL << map_cache[entry].slot);
+            free(map_cache[entry].pe_map);
+            map_cache[entry] = map_cache[--map_cache_used];
+            break;
+        }
+    }
+    shmemx_team_destroy(team);
+}
+
+#endif /* SHMEMX_TEAM_MAP_H */
@@ -0,0 +1,341 @@
+/*
+ * Example program to show MAXLOC/MINLOC and user-defined team reductions
+ *
+ * SYNOPSIS:
+ * void team_op_create(   team_combine_fn  combine,
+ *                        size_t           elem_size,
+ *                        team_op_t       *op )
+ *
+ * void team_reduce_to_all( shmem_team_t  team,
+ *                          void         *dest,
+ *                          const void   *source,
+ *                          int           nreduce,
+ *                          team_op_t    *op,
+ *                          void         *pWrk,
+ *                          long         *pSync )
+ *
+ * void team_<pairtype>_maxloc_to_all( shmem_team_t team,
+ *                                     <pairtype>  *dest,
+ *                                     <pairtype>  *source,
+ *                                     int          nreduce,
+ *                                     void        *pWrk,
+ *                                     long        *pSync )
+ *
+ * void team_<pairtype>_minloc_to_all( ... same arguments ... )
+ *
+ * where <pairtype> is one from float_int, double_int, long_int and
+ * int_int, a struct of a value of the first type and an int location.
+ *
+ * DESCRIPTION:
+ * shmemx_team_<datatype>_max_to_all and min_to_all only return the
+ * extreme value. Finding the PE or index that holds it takes a second
+ * reduction over the locations of all candidates.
+ *
+ * The <pairtype> maxloc and minloc routines reduce value/location pairs
+ * in one collective. The result holds the extreme value and the smallest
+ * location among the elements that hold it.
+ *
+ * team_reduce_to_all reduces elements of any type with a combine function
+ * that is registered once with team_op_create. The combine function is
+ *
+ *     void combine(void *inout, const void *in, int n)
+ *
+ * and must set inout[i] = inout[i] op in[i] for n elements of elem_size
+ * bytes. op has to be associative, it does not have to be commutative:
+ * inout always holds the contribution of lower numbered team PEs. The
+ * reduction runs a binomial tree to team PE 0 followed by a binomial
+ * broadcast, with data and flags written by one-sided puts.
+ *
+ * team_reduce_to_all and the pair routines are collective routines over
+ * the members of team, with the same rules as
+ * shmemx_team_<datatype>_<op>_to_all. The first call on a team gathers
+ * the mapping from team PE numbers to global PE numbers and is therefore
+ * slower than the following ones.
+ *
+ * The routines support the following options:
+ *
+ * combine, elem_size
+ *          Combine function and size in bytes of one element.
+ *
+ * op
+ *          Reduction operator, filled in by team_op_create.
+ *
+ * team, dest, source, nreduce
+ *          As for shmemx_team_<datatype>_<op>_to_all.
+ *
+ * pWrk
+ *          A symmetric work array of at least
+ *          team_reduce_wrk_size(team, nreduce, elem_size) bytes.
+ *
+ * pSync
+ *          A symmetric work array of TEAM_REDUCE_SYNC_SIZE longs. Every
+ *          element must be initialized with SHMEM_SYNC_VALUE before the
+ *          first call. Unlike the pSync of shmemx_team_<datatype>_<op>_to_all,
+ *          it may be passed to consecutive calls on the same team without
+ *          synchronization in between, but must not be shared between
+ *          teams.
+ *
+ * EXAMPLE DETAILS:
+ * The example program looks for the largest residual over
+ * SHMEM_TEAM_WORLD together with the PE holding it. It is done once with
+ * shmemx_team_double_max_to_all followed by shmemx_team_int_min_to_all
+ * over the locations of the maximum, and once with
+ * team_double_int_maxloc_to_all. A user-defined operator computes the
+ * minimum, maximum and sum of the residuals in one reduction. PE 0 prints
+ * the results and the latency of both ways.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+#include "shmemx-team-map.h"
+
+#define TEAM_REDUCE_MAX_STEPS   32
+#define TEAM_REDUCE_BCAST       TEAM_REDUCE_MAX_STEPS
+#define TEAM_REDUCE_SEQ         (TEAM_REDUCE_MAX_STEPS + 1)
+#define TEAM_REDUCE_SYNC_SIZE   (TEAM_REDUCE_MAX_STEPS + 2)
+
+typedef void (*team_combine_fn)(void *inout, const void *in, int n);
+
+typedef struct {
+    team_combine_fn combine;
+    size_t          elem_size;
+} team_op_t;
+
+void team_op_create(team_combine_fn combine, size_t elem_size,
+                    team_op_t *op) {
+    op->combine   = combine;
+    op->elem_size = elem_size;
+}
+
+size_t team_reduce_wrk_size(shmem_team_t team, int nreduce,
+                            size_t elem_size) {
+    int steps = 0, t_size = shmemx_team_n_pes(team);
+
+    while ((1 << steps) < t_size) {
+        steps++;
+    }
+    return (steps ? steps : 1) * nreduce * elem_size;
+}
+
+void team_reduce_to_all(shmem_team_t team, void *dest, const void *source,
+                        int nreduce, team_op_t *op, void *pWrk,
+                        long *pSync) {
+    int *pe_map  = team_pe_map(team);
+    int  t_pe    = shmemx_team_my_pe(team);
+    int  t_size  = shmemx_team_n_pes(team);
+    size_t bytes = nreduce * op->elem_size;
+    char *acc    = malloc(bytes ? bytes : 1);
+    char *wrk    = pWrk;
+    long  seq    = ++pSync[TEAM_REDUCE_SEQ];
+    int   mask, step;
+
+    memcpy(acc, source, bytes);
+
+    /* binomial reduction, lower team PEs keep the left operand */
+    for (mask = 1, step = 0; mask < t_size; mask <<= 1, step++) {
+        if (t_pe & mask) {
+            int parent = pe_map[t_pe - mask];
+
+            shmem_putmem(wrk + step * bytes, acc, bytes, parent);
+            shmem_fence();
+            shmem_long_p(&pSync[step], seq, parent);
+            break;
+        }
+        if (t_pe + mask < t_size) {
+            shmem_long_wait_until(&pSync[step], SHMEM_CMP_EQ, seq);
+            op->combine(acc, wrk + step * bytes, nreduce);
+        }
+    }
+
+    /* binomial broadcast of the result from team PE 0 */
+    if (t_pe == 0) {
+        memcpy(dest, acc, bytes);
+        for (mask = 1; mask < t_size; mask <<= 1)
+            ;
+    } else {
+        shmem_long_wait_until(&pSync[TEAM_REDUCE_BCAST], SHMEM_CMP_EQ, seq);
+    }
+    for (mask >>= 1; mask > 0; mask >>= 1) {
+        if (t_pe + mask < t_size) {
+            shmem_putmem(dest, dest, bytes, pe_map[t_pe + mask]);
+            shmem_fence();
+            shmem_long_p(&pSync[TEAM_REDUCE_BCAST], seq, pe_map[t_pe + mask]);
+        }
+    }
+
+    free(acc);
+}
+
+#define DEFINE_LOC_PAIR(NAME, TYPE)                                          \
+typedef struct {                                                             \
+    TYPE value;                                                              \
+    int  loc;                                                                \
+} team_##NAME##_t;                                                           \
+                                                                             \
+static void NAME##_maxloc(void *inout, const void *in, int n) {             \
+    team_##NAME##_t *a = inout;                                              \
+    const team_##NAME##_t *b = in;                                           \
+    int i;                                                                   \
+    for (i = 0; i < n; i++) {                                                \
+        if (b[i].value > a[i].value ||                                       \
+            (b[i].value == a[i].value && b[i].loc < a[i].loc)) {             \
+            a[i] = b[i];                                                     \
+        }                                                                    \
+    }                                                                        \
+}                                                                            \
+                                                                             \
+static void NAME##_minloc(void *inout, const void *in, int n) {             \
+    team_##NAME##_t *a = inout;                                              \
+    const team_##NAME##_t *b = in;                                           \
+    int i;                                                                   \
+    for (i = 0; i < n; i++) {                                                \
+        if (b[i].value < a[i].value ||                                       \
+            (b[i].value == a[i].value && b[i].loc < a[i].loc)) {             \
+            a[i] = b[i];                                                     \
+        }                                                                    \
+    }                                                                        \
+}                                                                            \
+                                                                             \
+static team_op_t NAME##_maxloc_op = { NAME##_maxloc, sizeof(team_##NAME##_t) }; \
+static team_op_t NAME##_minloc_op = { NAME##_minloc, sizeof(team_##NAME##_t) }; \
+                                                                             \
+void team_##NAME##_maxloc_to_all(shmem_team_t team, team_##NAME##_t *dest,   \
+                                 team_##NAME##_t *source, int nreduce,       \
+                                 void *pWrk, long *pSync) {                  \
+    team_reduce_to_all(team, dest, source, nreduce, &NAME##_maxloc_op,       \
+                       pWrk, pSync);                                         \
+}                                                                            \
+                                                                             \
+void team_##NAME##_minloc_to_all(shmem_team_t team, team_##NAME##_t *dest,   \
+                                 team_##NAME##_t *source, int nreduce,       \
+                                 void *pWrk, long *pSync) {                  \
+    team_reduce_to_all(team, dest, source, nreduce, &NAME##_minloc_op,       \
+                       pWrk, pSync);                                         \
+}
+
+DEFINE_LOC_PAIR(float_int, float)
+DEFINE_LOC_PAIR(double_int, double)
+DEFINE_LOC_PAIR(long_int, long)
+DEFINE_LOC_PAIR(int_int, int)
+
+/* user-defined operator: minimum, maximum and sum in one pass */
+typedef struct {
+    double min;
+    double max;
+    double sum;
+} stats_t;
+
+static void stats_combine(void *inout, const void *in, int n) {
+    stats_t *a = inout;
+    const stats_t *b = in;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        a[i].min  = (b[i].min < a[i].min) ? b[i].min : a[i].min;
+        a[i].max  = (b[i].max > a[i].max) ? b[i].max : a[i].max;
+        a[i].sum += b[i].sum;
+    }
+}
+
+#define NITER       1000
+#define N           3
+
+#define MAX(a, b) ((a > b) ? a : b)
+#define PWRK_MAX_SIZE MAX(N/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE)
+
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+double dpWrk[PWRK_MAX_SIZE];
+int ipWrk[PWRK_MAX_SIZE];
+double residual[N], max_residual[N];
+int loc[N], max_loc[N];
+
+long team_pSync[TEAM_REDUCE_SYNC_SIZE];
+char team_pWrk[TEAM_REDUCE_MAX_STEPS * N * sizeof(stats_t)];
+team_double_int_t pair_src[N], pair_dst[N];
+stats_t stats_src[N], stats_dst[N];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+int main(int argc, char *argv[]) {
+    int i, iter;
+    int me, npes;
+    double t_two, t_maxloc;
+    team_op_t stats_op;
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    for (i = 0; i < TEAM_REDUCE_SYNC_SIZE; i++) {
+        team_pSync[i] = SHMEM_SYNC_VALUE;
+    }
+    team_map_init();
+
+    /* residuals peak on a different PE for every element */
+    for (i = 0; i < N; i++) {
+        residual[i] = 1.0 / (1 + (me + npes - i) % npes);
+        pair_src[i].value = residual[i];
+        pair_src[i].loc   = me;
+        stats_src[i].min  = residual[i];
+        stats_src[i].max  = residual[i];
+        stats_src[i].sum  = residual[i];
+    }
+
+    /* workaround: reduce the value, then the locations holding it */
+    shmem_barrier_all();
+    t_two = wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        shmemx_team_double_max_to_all(SHMEM_TEAM_WORLD, max_residual,
+                                      residual, N, dpWrk, pSync[0]);
+        for (i = 0; i < N; i++) {
+            loc[i] = (residual[i] == max_residual[i]) ? me : INT_MAX;
+        }
+        shmemx_team_int_min_to_all(SHMEM_TEAM_WORLD, max_loc, loc, N,
+                                   ipWrk, pSync[1]);
+    }
+    t_two = (wtime() - t_two) / NITER;
+
+    /* one reduction over value/location pairs */
+    team_double_int_maxloc_to_all(SHMEM_TEAM_WORLD, pair_dst, pair_src, N,
+                                  team_pWrk, team_pSync);
+    shmem_barrier_all();
+    t_maxloc = wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        team_double_int_maxloc_to_all(SHMEM_TEAM_WORLD, pair_dst, pair_src,
+                                      N, team_pWrk, team_pSync);
+    }
+    t_maxloc = (wtime() - t_maxloc) / NITER;
+
+    team_op_create(stats_combine, sizeof(stats_t), &stats_op);
+    team_reduce_to_all(SHMEM_TEAM_WORLD, stats_dst, stats_src, N, &stats_op,
+                       team_pWrk, team_pSync);
+
+    if (me == 0) {
+        for (i = 0; i < N; i++) {
+            printf("[PE:%d] max[%d]=%g on PE %d, maxloc %g on PE %d, "
+                   "min %g sum %g\n", me, i, max_residual[i], max_loc[i],
+                   pair_dst[i].value, pair_dst[i].loc,
+                   stats_dst[i].min, stats_dst[i].sum);
+        }
+        printf("npes %d, nreduce %d\n", npes, N);
+        printf("max_to_all + min_to_all: %10.2f us\n", t_two * 1.0e6);
+        printf("maxloc_to_all:           %10.2f us\n", t_maxloc * 1.0e6);
+    }
+
+    shmem_barrier_all();
+    shmem_finalize();
+    return 0;
+}
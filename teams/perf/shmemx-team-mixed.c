@@ -0,0 +1,405 @@
+/*
+ * Example program to show team reductions with a narrow input type and a
+ * wide accumulator type
+ *
+ * SYNOPSIS:
+ * void team_<srctype>_<acctype>_<op>_to_all( shmem_team_t  team,
+ *                                            <acctype>    *dest,
+ *                                            <srctype>    *source,
+ *                                            int           nreduce,
+ *                                            <srctype>    *pWrk,
+ *                                            long         *pSync )
+ *
+ * where <op> is one from sum, prod, max and min, and <srctype>_<acctype>
+ * is one from short_int, short_long, int_long, float_double, bf16_float,
+ * bf16_double and double_double.
+ *
+ * team_bf16_t team_float_to_bf16( float x )
+ *
+ * float team_bf16_to_float( team_bf16_t x )
+ *
+ * long team_mixed_wire_bytes( void )
+ *
+ * DESCRIPTION:
+ * Reducing float or short data without losing precision or overflowing
+ * needs a double or int accumulator. With the team reductions, whose
+ * source and dest have the same type, the source has to be copied into a
+ * wider array first, and every byte moved by the reduction is then twice
+ * as large as the data it carries.
+ *
+ * The mixed reductions take a source array of <srctype> and return the
+ * result in a dest array of <acctype>, with every combine done in
+ * <acctype>. The source elements are sent unconverted, so only the
+ * partial results are wide on the wire. Each team PE owns a block of
+ * about nreduce / n elements for a team of n PEs. Every PE puts each
+ * block of its source to the block's owner, the owner converts and
+ * combines the n contributions to its block in team PE order and puts
+ * the result into the dest array of every member. Every PE sends (n-1)/n
+ * of the source in <srctype> and (n-1)/n of the result in <acctype>;
+ * the upcast workaround sends at least twice (n-1)/n of the data in
+ * <acctype>. The result does not depend on the PE that computes it and
+ * is the same on all members.
+ *
+ * The inputs are never rounded: the wire carries exactly the source
+ * values, and the accumulator type can represent each of them, so a
+ * mixed reduction is as exact as the upcast one. bf16 is the brain
+ * floating point format, the upper 16 bits of a float; it is for inputs
+ * that are bf16 already, which team_float_to_bf16 produces with round to
+ * nearest even. Float inputs are never sent as bf16.
+ *
+ * team_mixed_wire_bytes returns the number of bytes this PE has put in
+ * mixed reductions, flags included.
+ *
+ * dest, pWrk and pSync have to be symmetric, source does not. Consecutive
+ * calls on a team may use the same pWrk and pSync without other
+ * synchronization, as no PE can start writing to a work slot of the next
+ * call before its owner has finished the previous one. They must not be
+ * shared between teams. The first call on a team gathers the mapping
+ * from team PE numbers to global PE numbers and is therefore slower than
+ * the following ones.
+ *
+ * The mixed reduction routines support the following options:
+ *
+ * team
+ *          A valid PE team. A predefined team constant or any team
+ *          created by a split team routine may be used.
+ *
+ * dest
+ *          A symmetric array of nreduce <acctype> elements receiving the
+ *          result. It must not overlap source.
+ *
+ * source
+ *          An array of nreduce <srctype> elements.
+ *
+ * nreduce
+ *          Number of elements, the same on all members.
+ *
+ * pWrk
+ *          A symmetric work array of TEAM_MIXED_WRK_SIZE(nreduce, n)
+ *          <srctype> elements.
+ *
+ * pSync
+ *          A symmetric work array of TEAM_MIXED_SYNC_SIZE(n) longs. Every
+ *          element must be initialized with SHMEM_SYNC_VALUE before the
+ *          first call.
+ *
+ * EXAMPLE DETAILS:
+ * The example program sums float data of 16 to 1M elements per PE over
+ * SHMEM_TEAM_WORLD into double results, with the upcast workaround
+ * through shmemx_team_double_sum_to_all, with team_double_double_sum_to_all
+ * on upcast data and with team_float_double_sum_to_all, and the same
+ * data as bf16 with team_bf16_double_sum_to_all. The values are small
+ * integers, so all results must agree exactly, which is checked. PE 0
+ * prints the latency of each and the bytes each mixed reduction put.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+#include "shmemx-team-map.h"
+
+#define TEAM_MIXED_SEQ                  0
+#define TEAM_MIXED_DATA                 1
+#define TEAM_MIXED_SYNC_SIZE(npes)      (1 + 2 * (npes))
+#define TEAM_MIXED_WRK_SIZE(n, npes)    ((n) + (npes))
+
+typedef uint16_t team_bf16_t;
+
+team_bf16_t team_float_to_bf16(float x) {
+    uint32_t u;
+
+    memcpy(&u, &x, sizeof(u));
+    if ((u & 0x7fffffff) > 0x7f800000) {
+        return (team_bf16_t) ((u >> 16) | 0x40);
+    }
+    u += 0x7fff + ((u >> 16) & 1);
+    return (team_bf16_t) (u >> 16);
+}
+
+float team_bf16_to_float(team_bf16_t x) {
+    uint32_t u = (uint32_t) x << 16;
+    float f;
+
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static long team_mixed_bytes;
+
+long team_mixed_wire_bytes(void) {
+    return team_mixed_bytes;
+}
+
+/*
+ * Converts n source elements into the accumulator (first contribution)
+ * or combines them with it.
+ */
+typedef void (*team_mixed_fn)(void *acc, const void *src, int n, int first);
+
+static void team_mixed_to_all(shmem_team_t team, void *dest,
+                              const void *source, int nreduce,
+                              size_t src_size, size_t acc_size,
+                              team_mixed_fn combine, void *pWrk,
+                              long *pSync) {
+    int  *pe_map = team_pe_map(team);
+    int   t_pe   = shmemx_team_my_pe(team);
+    int   t_size = shmemx_team_n_pes(team);
+    int   base   = nreduce / t_size;
+    int   extra  = nreduce % t_size;
+    int   slot_elems = base + (extra ? 1 : 0);
+    long  seq    = ++pSync[TEAM_MIXED_SEQ];
+    const char *src = source;
+    char *wrk    = pWrk;
+    char *mine;
+    int   j, k, count;
+
+#define BLOCK_COUNT(b)  (base + ((b) < extra ? 1 : 0))
+#define BLOCK_DISPL(b)  ((b) * base + ((b) < extra ? (b) : extra))
+#define DATA_FLAG(j)    (&pSync[TEAM_MIXED_DATA + (j)])
+#define RESULT_FLAG(j)  (&pSync[TEAM_MIXED_DATA + t_size + (j)])
+
+    /* contributions to the other blocks, staggered to spread the load */
+    for (k = 1; k < t_size; k++) {
+        j = (t_pe + k) % t_size;
+        count = BLOCK_COUNT(j);
+        if (count > 0) {
+            shmem_putmem(wrk + (size_t) t_pe * slot_elems * src_size,
+                         src + BLOCK_DISPL(j) * src_size, count * src_size,
+                         pe_map[j]);
+            team_mixed_bytes += count * src_size;
+        }
+    }
+    shmem_fence();
+    for (k = 1; k < t_size; k++) {
+        j = (t_pe + k) % t_size;
+        if (BLOCK_COUNT(j) > 0) {
+            shmem_long_p(DATA_FLAG(t_pe), seq, pe_map[j]);
+            team_mixed_bytes += sizeof(long);
+        }
+    }
+
+    /* own block, combined in team PE order */
+    count = BLOCK_COUNT(t_pe);
+    mine  = (char *) dest + BLOCK_DISPL(t_pe) * acc_size;
+    if (count > 0) {
+        for (j = 0; j < t_size; j++) {
+            if (j == t_pe) {
+                combine(mine, src + BLOCK_DISPL(t_pe) * src_size, count,
+                        j == 0);
+                continue;
+            }
+            shmem_long_wait_until(DATA_FLAG(j), SHMEM_CMP_GE, seq);
+            combine(mine, wrk + (size_t) j * slot_elems * src_size, count,
+                    j == 0);
+        }
+        for (k = 1; k < t_size; k++) {
+            j = (t_pe + k) % t_size;
+            shmem_putmem(mine, mine, count * acc_size, pe_map[j]);
+            team_mixed_bytes += count * acc_size;
+        }
+        shmem_fence();
+        for (k = 1; k < t_size; k++) {
+            j = (t_pe + k) % t_size;
+            shmem_long_p(RESULT_FLAG(t_pe), seq, pe_map[j]);
+            team_mixed_bytes += sizeof(long);
+        }
+    }
+
+    for (j = 0; j < t_size; j++) {
+        if (j != t_pe && BLOCK_COUNT(j) > 0) {
+            shmem_long_wait_until(RESULT_FLAG(j), SHMEM_CMP_GE, seq);
+        }
+    }
+
+#undef BLOCK_COUNT
+#undef BLOCK_DISPL
+#undef DATA_FLAG
+#undef RESULT_FLAG
+}
+
+#define TEAM_MIXED_LOAD(x)      (x)
+#define TEAM_MIXED_LOAD_BF16(x) team_bf16_to_float(x)
+
+#define DEFINE_MIXED(STYPE, SNAME, ATYPE, ANAME, LOAD, OPNAME, EXPR)         \
+static void SNAME##_##ANAME##_##OPNAME##_combine(void *acc, const void *src, \
+                                                 int n, int first) {         \
+    ATYPE *a = acc;                                                          \
+    const STYPE *b = src;                                                    \
+    int i;                                                                   \
+    if (first) {                                                             \
+        for (i = 0; i < n; i++) {                                            \
+            a[i] = (ATYPE) LOAD(b[i]);                                       \
+        }                                                                    \
+        return;                                                              \
+    }                                                                        \
+    for (i = 0; i < n; i++) {                                                \
+        ATYPE x = a[i], y = (ATYPE) LOAD(b[i]);                              \
+        a[i] = (EXPR);                                                       \
+    }                                                                        \
+}                                                                            \
+                                                                             \
+void team_##SNAME##_##ANAME##_##OPNAME##_to_all(shmem_team_t team,           \
+                                                ATYPE *dest, STYPE *source,  \
+                                                int nreduce, STYPE *pWrk,    \
+                                                long *pSync) {               \
+    team_mixed_to_all(team, dest, source, nreduce, sizeof(STYPE),            \
+                      sizeof(ATYPE), SNAME##_##ANAME##_##OPNAME##_combine,   \
+                      pWrk, pSync);                                          \
+}
+
+#define DEFINE_MIXED_ARITH(STYPE, SNAME, ATYPE, ANAME, LOAD)                 \
+    DEFINE_MIXED(STYPE, SNAME, ATYPE, ANAME, LOAD, sum,  x + y)              \
+    DEFINE_MIXED(STYPE, SNAME, ATYPE, ANAME, LOAD, prod, x * y)              \
+    DEFINE_MIXED(STYPE, SNAME, ATYPE, ANAME, LOAD, max,  (x > y) ? x : y)    \
+    DEFINE_MIXED(STYPE, SNAME, ATYPE, ANAME, LOAD, min,  (x < y) ? x : y)
+
+DEFINE_MIXED_ARITH(short, short, int, int, TEAM_MIXED_LOAD)
+DEFINE_MIXED_ARITH(short, short, long, long, TEAM_MIXED_LOAD)
+DEFINE_MIXED_ARITH(int, int, long, long, TEAM_MIXED_LOAD)
+DEFINE_MIXED_ARITH(float, float, double, double, TEAM_MIXED_LOAD)
+DEFINE_MIXED_ARITH(team_bf16_t, bf16, float, float, TEAM_MIXED_LOAD_BF16)
+DEFINE_MIXED_ARITH(team_bf16_t, bf16, double, double, TEAM_MIXED_LOAD_BF16)
+DEFINE_MIXED_ARITH(double, double, double, double, TEAM_MIXED_LOAD)
+
+#define NITER       20
+#define MAX_NREDUCE (1 << 20)
+
+#define MAX(a, b) ((a > b) ? a : b)
+
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+int main(int argc, char *argv[]) {
+    int i, iter, n, errors = 0;
+    int me, npes;
+    int pwrk_size;
+    float *fsource;
+    team_bf16_t *hsource;
+    double *upcast, *dest, *ref, *pWrk, *mixed_pWrk;
+    long *mixed_pSync;
+    long b_double, b_float, b_bf16;
+    double t_lib, t_double, t_float, t_bf16;
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+
+    pwrk_size   = MAX(MAX_NREDUCE/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE);
+    upcast      = shmem_malloc(MAX_NREDUCE * sizeof(double));
+    dest        = shmem_malloc(MAX_NREDUCE * sizeof(double));
+    /* two halves, alternated between consecutive library reductions */
+    pWrk        = shmem_malloc(2 * pwrk_size * sizeof(double));
+    mixed_pWrk  = shmem_malloc(TEAM_MIXED_WRK_SIZE(MAX_NREDUCE, npes) *
+                               sizeof(double));
+    mixed_pSync = shmem_malloc(TEAM_MIXED_SYNC_SIZE(npes) * sizeof(long));
+    fsource     = malloc(MAX_NREDUCE * sizeof(float));
+    hsource     = malloc(MAX_NREDUCE * sizeof(team_bf16_t));
+    ref         = malloc(MAX_NREDUCE * sizeof(double));
+
+    for (i = 0; i < TEAM_MIXED_SYNC_SIZE(npes); i++) {
+        mixed_pSync[i] = SHMEM_SYNC_VALUE;
+    }
+    team_map_init();
+    for (i = 0; i < MAX_NREDUCE; i++) {
+        fsource[i] = (float) ((me + i) % 256);
+        hsource[i] = team_float_to_bf16(fsource[i]);
+    }
+
+    if (me == 0) {
+        printf("npes %d, float data summed into double, time in us\n", npes);
+        printf("%8s %10s %10s %10s %10s %12s %12s %12s\n", "nreduce",
+               "upcast", "double", "float", "bf16", "bytes dbl",
+               "bytes flt", "bytes bf16");
+    }
+
+    for (n = 16; n <= MAX_NREDUCE; n *= 4) {
+        /* upcast workaround */
+        shmem_barrier_all();
+        t_lib = wtime();
+        for (iter = 0; iter < NITER; iter++) {
+            for (i = 0; i < n; i++) {
+                upcast[i] = fsource[i];
+            }
+            shmemx_team_double_sum_to_all(SHMEM_TEAM_WORLD, dest, upcast, n,
+                                          pWrk + (iter % 2) * pwrk_size,
+                                          pSync[iter % 2]);
+        }
+        t_lib = (wtime() - t_lib) / NITER;
+        memcpy(ref, dest, n * sizeof(double));
+
+        /* upcast data through the same transport */
+        shmem_barrier_all();
+        b_double = team_mixed_wire_bytes();
+        t_double = wtime();
+        for (iter = 0; iter < NITER; iter++) {
+            for (i = 0; i < n; i++) {
+                upcast[i] = fsource[i];
+            }
+            team_double_double_sum_to_all(SHMEM_TEAM_WORLD, dest, upcast, n,
+                                          mixed_pWrk, mixed_pSync);
+        }
+        t_double = (wtime() - t_double) / NITER;
+        b_double = (team_mixed_wire_bytes() - b_double) / NITER;
+        errors += memcmp(ref, dest, n * sizeof(double)) != 0;
+
+        shmem_barrier_all();
+        b_float = team_mixed_wire_bytes();
+        t_float = wtime();
+        for (iter = 0; iter < NITER; iter++) {
+            team_float_double_sum_to_all(SHMEM_TEAM_WORLD, dest, fsource, n,
+                                         (float *) mixed_pWrk, mixed_pSync);
+        }
+        t_float = (wtime() - t_float) / NITER;
+        b_float = (team_mixed_wire_bytes() - b_float) / NITER;
+        errors += memcmp(ref, dest, n * sizeof(double)) != 0;
+
+        shmem_barrier_all();
+        b_bf16 = team_mixed_wire_bytes();
+        t_bf16 = wtime();
+        for (iter = 0; iter < NITER; iter++) {
+            team_bf16_double_sum_to_all(SHMEM_TEAM_WORLD, dest, hsource, n,
+                                        (team_bf16_t *) mixed_pWrk,
+                                        mixed_pSync);
+        }
+        t_bf16 = (wtime() - t_bf16) / NITER;
+        b_bf16 = (team_mixed_wire_bytes() - b_bf16) / NITER;
+        errors += memcmp(ref, dest, n * sizeof(double)) != 0;
+
+        if (me == 0) {
+            printf("%8d %10.2f %10.2f %10.2f %10.2f %12ld %12ld %12ld\n", n,
+                   t_lib * 1.0e6, t_double * 1.0e6, t_float * 1.0e6,
+                   t_bf16 * 1.0e6, b_double, b_float, b_bf16);
+        }
+    }
+
+    if (errors) {
+        printf("[PE:%d] %d mixed results differ from the upcast ones\n", me,
+               errors);
+    }
+
+    free(ref);
+    free(hsource);
+    free(fsource);
+    shmem_barrier_all();
+    shmem_free(mixed_pSync);
+    shmem_free(mixed_pWrk);
+    shmem_free(pWrk);
+    shmem_free(dest);
+    shmem_free(upcast);
+    shmem_finalize();
+    return 0;
+}
@@ -0,0 +1,399 @@
+/*
+ * Example program to show a node-local team whose members access each
+ * other's symmetric memory with loads and stores
+ *
+ * SYNOPSIS:
+ * void team_split_node( shmem_team_t   parent,
+ *                       shmem_team_t  *node_team )
+ *
+ * int team_ptrs(        shmem_team_t   team,
+ *                       const void    *sym,
+ *                       void         **ptrs )
+ *
+ * void team_node_<datatype>_<op>_to_all( shmem_team_t  team,
+ *                                        <datatype>   *dest,
+ *                                        <datatype>   *source,
+ *                                        int           nreduce,
+ *                                        long         *pSync )
+ *
+ * where <op> is one from sum, prod, max and min for <datatype> short,
+ * int, long, float, double, longdouble and longlong, and additionally
+ * and, or and xor for short, int, long and longlong.
+ *
+ * DESCRIPTION:
+ * The PEs of a node share memory, and shmem_ptr gives a PE the address
+ * at which it can load and store another PE's copy of a symmetric object
+ * directly. Team reductions within a node still copy every contribution
+ * through the SHMEM transport into work arrays, although all of them
+ * could be read where they are.
+ *
+ * team_split_node is a collective routine over the parent team which
+ * returns in node_team the team of the parent PEs sharing memory with
+ * the calling PE, the ones shmem_ptr can reach. When the PEs of every
+ * node are numbered consecutively in the parent, the node teams are
+ * created with shmemx_team_split_strided, otherwise with
+ * shmemx_team_split_color, the color being the first PE of the node.
+ * The first call allocates the object it probes other PEs with on the
+ * symmetric heap and must be made by all PEs. The members agree on the
+ * kind of split with a reduction on the pSync and pWrk arrays of the
+ * parent from shmemx-team-map.h, so team_map_init must have been called.
+ *
+ * team_ptrs stores in ptrs[i] the address of team PE i's copy of the
+ * symmetric object sym, or NULL if it cannot be accessed directly, and
+ * returns the number of NULL entries. ptrs must have room for one entry
+ * per team PE. It takes the global PE numbers of the members from
+ * team_pe_map, whose first call on a team is collective over the team,
+ * so the first call of team_ptrs or of a reduction on a team must be
+ * made by all its members.
+ *
+ * team_node_<datatype>_<op>_to_all has the semantics of
+ * shmemx_team_<datatype>_<op>_to_all on a team whose members all share
+ * memory, for example one returned by team_split_node. Each team PE owns
+ * a block of the result, aligned to cache lines, which it computes by
+ * reading the block from the source arrays of all members in place,
+ * starting with its own and then the others in team PE order, then it
+ * copies the blocks of the other members from their dest arrays. No data
+ * is copied through the SHMEM transport and no work array is needed. The
+ * members synchronize through flags in pSync, which they read directly
+ * as well: once all sources are ready, once all blocks are computed and
+ * once all blocks are copied. The same pSync may be used by consecutive
+ * calls on a team, but must not be shared between teams. Only the owner
+ * of a block reads it from the sources, and it takes in its own source
+ * before writing dest, so dest may be the same array as source. Some
+ * libraries only map the symmetric heap of other PEs, so dest, source
+ * and pSync are best allocated with shmem_malloc.
+ *
+ * The node team routines support the following options:
+ *
+ * parent
+ *          A valid PE team. A predefined team constant or any team
+ *          created by a split team routine may be used.
+ *
+ * team
+ *          A valid PE team. For team_node_<datatype>_<op>_to_all, all its
+ *          members must share memory.
+ *
+ * sym
+ *          A symmetric object.
+ *
+ * dest, source
+ *          Symmetric arrays of nreduce elements.
+ *
+ * nreduce
+ *          Number of elements, the same on all members.
+ *
+ * pSync
+ *          A symmetric work array of TEAM_NODE_SYNC_SIZE longs. Every
+ *          element must be initialized with SHMEM_SYNC_VALUE before the
+ *          first call.
+ *
+ * EXAMPLE DETAILS:
+ * The example program creates the node team of SHMEM_TEAM_WORLD with
+ * team_split_node and sums 1 to 1M doubles per PE over it, once with
+ * shmemx_team_double_sum_to_all and once with
+ * team_node_double_sum_to_all, and checks that both give the same
+ * result. PE 0 prints the size of its node team and the latencies.
+ */
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+#include "shmemx-team-map.h"
+
+#define TEAM_NODE_SEQ           0
+#define TEAM_NODE_FLAG          1
+#define TEAM_NODE_SYNC_SIZE     4
+#define TEAM_NODE_MAX_PES       1024
+#define TEAM_NODE_LINE          64
+
+long node_src, node_dst;
+static long *node_probe;
+
+void team_split_node(shmem_team_t parent, shmem_team_t *node_team) {
+    int *pe_map = team_pe_map(parent);
+    int  t_pe   = shmemx_team_my_pe(parent);
+    int  t_size = shmemx_team_n_pes(parent);
+    int  i, first = -1, last = -1, count = 0;
+    long *pWrk, *pSync;
+
+    if (node_probe == NULL) {
+        node_probe = shmem_malloc(sizeof(long));
+    }
+
+    for (i = 0; i < t_size; i++) {
+        if (i == t_pe || shmem_ptr(node_probe, pe_map[i]) != NULL) {
+            first = (first < 0) ? i : first;
+            last  = i;
+            count++;
+        }
+    }
+
+    /* strided only if the PEs of every node are consecutive */
+    node_src = (last - first + 1 == count);
+    team_map_sync(parent, &pWrk, &pSync);
+    shmemx_team_long_min_to_all(parent, &node_dst, &node_src, 1, pWrk,
+                                pSync);
+
+    if (node_dst) {
+        shmemx_team_split_strided(parent, first, 1, count, node_team);
+    } else {
+        shmemx_team_split_color(parent, first, t_pe, node_team);
+    }
+}
+
+int team_ptrs(shmem_team_t team, const void *sym, void **ptrs) {
+    int *pe_map = team_pe_map(team);
+    int  t_pe   = shmemx_team_my_pe(team);
+    int  t_size = shmemx_team_n_pes(team);
+    int  i, missing = 0;
+
+    for (i = 0; i < t_size; i++) {
+        ptrs[i] = (i == t_pe) ? (void *) sym
+                              : shmem_ptr(sym, pe_map[i]);
+        missing += (ptrs[i] == NULL);
+    }
+    return missing;
+}
+
+/* sets this PE's flag to seq and waits for the flags of all members */
+static void team_node_sync(long **sync_ptrs, int t_pe, int t_size, int flag,
+                           long seq) {
+    int i, polls = 0;
+
+    __sync_synchronize();
+    *(volatile long *) &sync_ptrs[t_pe][TEAM_NODE_FLAG + flag] = seq;
+    for (i = 0; i < t_size; i++) {
+        while (*(volatile long *) &sync_ptrs[i][TEAM_NODE_FLAG + flag] < seq) {
+            /* let other PEs run when cores are oversubscribed */
+            if (++polls % 1024 == 0) {
+                sched_yield();
+            }
+        }
+    }
+    __sync_synchronize();
+}
+
+/*
+ * Converts n elements into the result (first contribution) or combines
+ * them with it.
+ */
+typedef void (*team_combine_fn)(void *inout, const void *in, int n,
+                                int first);
+
+static void team_node_to_all(shmem_team_t team, void *dest,
+                             const void *source, int nreduce,
+                             size_t elem_size, team_combine_fn combine,
+                             long *pSync) {
+    static void *src_ptrs[TEAM_NODE_MAX_PES];
+    static void *dst_ptrs[TEAM_NODE_MAX_PES];
+    static long *sync_ptrs[TEAM_NODE_MAX_PES];
+    int    t_pe   = shmemx_team_my_pe(team);
+    int    t_size = shmemx_team_n_pes(team);
+    int    line   = TEAM_NODE_LINE / elem_size;
+    int    block, i, j, count, displ;
+    long   seq;
+
+    if (t_size > TEAM_NODE_MAX_PES ||
+        team_ptrs(team, source, src_ptrs) != 0 ||
+        team_ptrs(team, dest, dst_ptrs) != 0 ||
+        team_ptrs(team, pSync, (void **) sync_ptrs) != 0) {
+        fprintf(stderr, "team_node_to_all: team members do not share "
+                "memory\n");
+        shmem_global_exit(1);
+    }
+
+    /* blocks of whole cache lines, so that no two owners share a line */
+    line  = (line > 0) ? line : 1;
+    block = (nreduce + t_size - 1) / t_size;
+    block = (block + line - 1) / line * line;
+    seq   = ++pSync[TEAM_NODE_SEQ];
+
+#define BLOCK_DISPL(b)  ((b) * block < nreduce ? (b) * block : nreduce)
+#define BLOCK_COUNT(b)  (BLOCK_DISPL((b) + 1) - BLOCK_DISPL(b))
+
+    team_node_sync(sync_ptrs, t_pe, t_size, 0, seq);
+
+    count = BLOCK_COUNT(t_pe);
+    displ = BLOCK_DISPL(t_pe);
+    if (count > 0) {
+        /* the own source first, it may be dest */
+        combine((char *) dest + displ * elem_size,
+                (char *) source + displ * elem_size, count, 1);
+        for (i = 0; i < t_size; i++) {
+            if (i != t_pe) {
+                combine((char *) dest + displ * elem_size,
+                        (char *) src_ptrs[i] + displ * elem_size, count, 0);
+            }
+        }
+    }
+
+    team_node_sync(sync_ptrs, t_pe, t_size, 1, seq);
+
+    for (i = 1; i < t_size; i++) {
+        j = (t_pe + i) % t_size;
+        count = BLOCK_COUNT(j);
+        displ = BLOCK_DISPL(j);
+        if (count > 0) {
+            memcpy((char *) dest + displ * elem_size,
+                   (char *) dst_ptrs[j] + displ * elem_size,
+                   count * elem_size);
+        }
+    }
+
+    team_node_sync(sync_ptrs, t_pe, t_size, 2, seq);
+
+#undef BLOCK_DISPL
+#undef BLOCK_COUNT
+}
+
+#define DEFINE_NODE(TYPE, NAME, OPNAME, EXPR)                                \
+static void NAME##_##OPNAME##_combine(void *inout, const void *in, int n,   \
+                                      int first) {                          \
+    TYPE *a = inout;                                                         \
+    const TYPE *b = in;                                                      \
+    int i;                                                                   \
+    if (first) {                                                             \
+        memmove(a, b, n * sizeof(TYPE));                                     \
+        return;                                                              \
+    }                                                                        \
+    for (i = 0; i < n; i++) {                                                \
+        TYPE x = a[i], y = b[i];                                             \
+        a[i] = (EXPR);                                                       \
+    }                                                                        \
+}                                                                            \
+                                                                             \
+void team_node_##NAME##_##OPNAME##_to_all(shmem_team_t team, TYPE *dest,     \
+                                          TYPE *source, int nreduce,         \
+                                          long *pSync) {                     \
+    team_node_to_all(team, dest, source, nreduce, sizeof(TYPE),              \
+                     NAME##_##OPNAME##_combine, pSync);                      \
+}
+
+#define DEFINE_NODE_ARITH(TYPE, NAME)                                        \
+    DEFINE_NODE(TYPE, NAME, sum,  x + y)                                     \
+    DEFINE_NODE(TYPE, NAME, prod, x * y)                                     \
+    DEFINE_NODE(TYPE, NAME, max,  (x > y) ? x : y)                           \
+    DEFINE_NODE(TYPE, NAME, min,  (x < y) ? x : y)
+
+#define DEFINE_NODE_BITWISE(TYPE, NAME)                                      \
+    DEFINE_NODE(TYPE, NAME, and,  x & y)                                     \
+    DEFINE_NODE(TYPE, NAME, or,   x | y)                                     \
+    DEFINE_NODE(TYPE, NAME, xor,  x ^ y)
+
+DEFINE_NODE_ARITH(short, short)
+DEFINE_NODE_ARITH(int, int)
+DEFINE_NODE_ARITH(long, long)
+DEFINE_NODE_ARITH(long long, longlong)
+DEFINE_NODE_ARITH(float, float)
+DEFINE_NODE_ARITH(double, double)
+DEFINE_NODE_ARITH(long double, longdouble)
+
+DEFINE_NODE_BITWISE(short, short)
+DEFINE_NODE_BITWISE(int, int)
+DEFINE_NODE_BITWISE(long, long)
+DEFINE_NODE_BITWISE(long long, longlong)
+
+#define NITER       20
+#define MAX_NREDUCE (1 << 20)
+
+#define MAX(a, b) ((a > b) ? a : b)
+
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+int main(int argc, char *argv[]) {
+    int i, iter, n, errors = 0;
+    int me, npes, node_pe, node_size;
+    int pwrk_size;
+    double *source, *dest, *ref, *pWrk;
+    double t_split, t_lib, t_zc;
+    long *zc_pSync;
+    shmem_team_t node_team;
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    pwrk_size = MAX(MAX_NREDUCE/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE);
+    source    = shmem_malloc(MAX_NREDUCE * sizeof(double));
+    dest      = shmem_malloc(MAX_NREDUCE * sizeof(double));
+    /* two halves, alternated between consecutive library reductions */
+    pWrk      = shmem_malloc(2 * pwrk_size * sizeof(double));
+    zc_pSync  = shmem_malloc(TEAM_NODE_SYNC_SIZE * sizeof(long));
+    ref       = malloc(MAX_NREDUCE * sizeof(double));
+
+    for (i = 0; i < TEAM_NODE_SYNC_SIZE; i++) {
+        zc_pSync[i] = SHMEM_SYNC_VALUE;
+    }
+    team_map_init();
+
+    for (i = 0; i < MAX_NREDUCE; i++) {
+        source[i] = me + i;
+    }
+
+    shmem_barrier_all();
+    t_split = wtime();
+    team_split_node(SHMEM_TEAM_WORLD, &node_team);
+    t_split = wtime() - t_split;
+    node_pe   = shmemx_team_my_pe(node_team);
+    node_size = shmemx_team_n_pes(node_team);
+
+    if (me == 0) {
+        printf("npes %d, node team of %d PEs created in %.2f us\n", npes,
+               node_size, t_split * 1.0e6);
+        printf("%8s %12s %12s\n", "nreduce", "to_all us", "zero copy us");
+    }
+
+    for (n = 1; n <= MAX_NREDUCE; n *= 16) {
+        shmem_barrier_all();
+        t_lib = wtime();
+        for (iter = 0; iter < NITER; iter++) {
+            shmemx_team_double_sum_to_all(node_team, dest, source, n,
+                                          pWrk + (iter % 2) * pwrk_size,
+                                          pSync[iter % 2]);
+        }
+        t_lib = (wtime() - t_lib) / NITER;
+        memcpy(ref, dest, n * sizeof(double));
+
+        shmem_barrier_all();
+        t_zc = wtime();
+        for (iter = 0; iter < NITER; iter++) {
+            team_node_double_sum_to_all(node_team, dest, source, n,
+                                        zc_pSync);
+        }
+        t_zc = (wtime() - t_zc) / NITER;
+        errors += memcmp(ref, dest, n * sizeof(double)) != 0;
+
+        if (me == 0) {
+            printf("%8d %12.2f %12.2f\n", n, t_lib * 1.0e6, t_zc * 1.0e6);
+        }
+    }
+
+    if (errors) {
+        printf("[PE:%d] node PE %d: %d zero copy results differ\n", me,
+               node_pe, errors);
+    }
+
+    team_map_destroy(&node_team);
+    free(ref);
+    shmem_barrier_all();
+    shmem_free(zc_pSync);
+    shmem_free(pWrk);
+    shmem_free(dest);
+    shmem_free(source);
+    shmem_finalize();
+    return 0;
+}
@@ -0,0 +1,271 @@
+/*
+ * Example program to show NUMA-aware placement of team reduction buffers
+ *
+ * SYNOPSIS:
+ * int  team_numa_nodes(  void )
+ * int  team_numa_node(   void )
+ * int  team_numa_bind(   void         *addr,
+ *                        size_t        len,
+ *                        int           node )
+ * long team_numa_pages(  const void   *addr,
+ *                        size_t        len,
+ *                        int           node,
+ *                        long         *npages )
+ *
+ * DESCRIPTION:
+ * The combine step of shmemx_team_<datatype>_<op>_to_all streams through
+ * source, dest and pWrk of the local PE. On nodes with more than one
+ * NUMA node, these pages may have been placed on another node than the
+ * one the PE runs on, for example by a first touch from another thread,
+ * and the combine then runs at remote memory bandwidth.
+ *
+ * team_numa_nodes returns the number of NUMA nodes of the machine and
+ * team_numa_node the node of the CPU the calling PE runs on.
+ * team_numa_bind binds the pages covering addr to addr+len to node and
+ * moves the pages already present there. It works on symmetric memory
+ * as well as on local memory, and returns 0 on success or -1 if the
+ * pages could not be bound, for example because they are pinned by the
+ * network. team_numa_pages returns how many of the pages covering the
+ * range are on node, or -1 on error, and sets npages to the number of
+ * pages of the range present in memory. Pages never touched have no
+ * node yet. All routines are local and only use the Linux system calls
+ * mbind, move_pages and getcpu.
+ *
+ * A PE should bind its symmetric work buffers once after allocating
+ * them and before their first use, and should be pinned to the CPUs of
+ * one NUMA node by the job launcher, so that its node does not change.
+ *
+ * The NUMA placement routines support the following options:
+ *
+ * addr, len
+ *          Range of memory of the calling PE.
+ *
+ * node
+ *          A NUMA node number, from 0 to team_numa_nodes()-1.
+ *
+ * npages
+ *          Set to the number of pages of the range present in memory.
+ *
+ * EXAMPLE DETAILS:
+ * The example program runs double sum reductions of N elements on
+ * SHMEM_TEAM_WORLD with source, dest and pWrk bound to the local NUMA
+ * node of every PE, and then bound to the next node, which stands for
+ * unmanaged placement. PE 0 prints the share of pages on the local node
+ * after the reductions and the reduction bandwidth of both. On a machine
+ * with one NUMA node both placements are the same.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+
+#ifndef MPOL_BIND
+#define MPOL_BIND       2
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE    (1 << 1)
+#endif
+
+#define TEAM_NUMA_MAX_NODES 1024
+#define TEAM_NUMA_BATCH     1024
+
+int team_numa_nodes(void) {
+    DIR *dir = opendir("/sys/devices/system/node");
+    struct dirent *ent;
+    int n = 0, node;
+
+    if (dir == NULL) {
+        return 1;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        if (sscanf(ent->d_name, "node%d", &node) == 1 && node + 1 > n) {
+            n = node + 1;
+        }
+    }
+    closedir(dir);
+    return n ? n : 1;
+}
+
+int team_numa_node(void) {
+    unsigned cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+        return 0;
+    }
+    return (int) node;
+}
+
+int team_numa_bind(void *addr, size_t len, int node) {
+    unsigned long mask[TEAM_NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+    long   page  = sysconf(_SC_PAGESIZE);
+    char  *start = (char *) ((unsigned long) addr & ~(page - 1));
+    size_t bytes = ((char *) addr + len) - start;
+
+    if (node < 0 || node >= TEAM_NUMA_MAX_NODES) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] |=
+        1UL << (node % (8 * sizeof(unsigned long)));
+
+    if (syscall(SYS_mbind, start, bytes, MPOL_BIND, mask,
+                TEAM_NUMA_MAX_NODES, MPOL_MF_MOVE) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+long team_numa_pages(const void *addr, size_t len, int node, long *npages) {
+    long   page  = sysconf(_SC_PAGESIZE);
+    char  *start = (char *) ((unsigned long) addr & ~(page - 1));
+    long   total = (((char *) addr + len) - start + page - 1) / page;
+    void  *pages[TEAM_NUMA_BATCH];
+    int    status[TEAM_NUMA_BATCH];
+    long   i, on_node = 0, present = 0;
+    int    j, n;
+
+    for (i = 0; i < total; i += n) {
+        n = (total - i < TEAM_NUMA_BATCH) ? total - i : TEAM_NUMA_BATCH;
+        for (j = 0; j < n; j++) {
+            pages[j] = start + (i + j) * page;
+        }
+        if (syscall(SYS_move_pages, 0, n, pages, NULL, status, 0) != 0) {
+            *npages = 0;
+            return -1;
+        }
+        for (j = 0; j < n; j++) {
+            present += (status[j] >= 0);
+            on_node += (status[j] == node);
+        }
+    }
+    *npages = present;
+    return on_node;
+}
+
+#define NITER   5
+#define N       (1 << 21)
+
+#define MAX(a, b) ((a > b) ? a : b)
+
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+double local_share[1], min_share[1];
+double share_pWrk[SHMEM_REDUCE_MIN_WRKDATA_SIZE];
+long share_pSync[SHMEM_REDUCE_SYNC_SIZE];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+static int place(double *buf[], size_t len[], int nbufs, int node) {
+    int i, failed = 0;
+
+    for (i = 0; i < nbufs; i++) {
+        if (team_numa_bind(buf[i], len[i], node) != 0) {
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/* share of the pages of all buffers on the local node, lowest of all PEs */
+static double share(double *buf[], size_t len[], int nbufs, int local) {
+    long on_node = 0, total = 0, n, on;
+    int  i;
+
+    for (i = 0; i < nbufs; i++) {
+        on = team_numa_pages(buf[i], len[i], local, &n);
+        if (on >= 0) {
+            on_node += on;
+            total   += n;
+        }
+    }
+    local_share[0] = (total > 0) ? (double) on_node / total : 0.0;
+    shmem_barrier_all();
+    shmem_double_min_to_all(min_share, local_share, 1, 0, 0, shmem_n_pes(),
+                            share_pWrk, share_pSync);
+    return min_share[0];
+}
+
+int main(int argc, char *argv[]) {
+    int i, iter, mode;
+    int me, nodes, local, failed;
+    int pwrk_size;
+    double *source, *dest, *pWrk, t, frac;
+    double *buf[3];
+    size_t len[3];
+
+    shmem_init();
+    me = shmem_my_pe();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+        share_pSync[i] = SHMEM_SYNC_VALUE;
+    }
+
+    pwrk_size = MAX(N/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE);
+    source = shmem_malloc(N * sizeof(double));
+    dest   = shmem_malloc(N * sizeof(double));
+    /* two halves, alternated between consecutive reductions */
+    pWrk   = shmem_malloc(2 * pwrk_size * sizeof(double));
+    buf[0] = source;
+    buf[1] = dest;
+    buf[2] = pWrk;
+    len[0] = N * sizeof(double);
+    len[1] = N * sizeof(double);
+    len[2] = 2 * pwrk_size * sizeof(double);
+
+    nodes = team_numa_nodes();
+    local = team_numa_node();
+    for (i = 0; i < N; i++) {
+        source[i] = me + i;
+    }
+
+    if (me == 0) {
+        printf("%d NUMA nodes, PE 0 on node %d, nreduce %d\n", nodes, local,
+               N);
+    }
+
+    /* mode 0 binds to the local node, mode 1 to the next node */
+    for (mode = 0; mode < 2; mode++) {
+        failed = place(buf, len, 3, (local + mode) % nodes);
+
+        shmem_barrier_all();
+        t = wtime();
+        for (iter = 0; iter < NITER; iter++) {
+            shmemx_team_double_sum_to_all(SHMEM_TEAM_WORLD, dest, source, N,
+                                          pWrk + (iter % 2) * pwrk_size,
+                                          pSync[iter % 2]);
+        }
+        t = (wtime() - t) / NITER;
+        frac = share(buf, len, 3, local);
+
+        if (failed) {
+            printf("[PE:%d] %d buffers could not be bound: %s\n", me, failed,
+                   strerror(errno));
+        }
+        if (me == 0) {
+            printf("%-12s placement: %5.1f%% of pages local, %10.2f ms, "
+                   "%8.2f MB/s\n", mode ? "next node" : "local node",
+                   frac * 100.0, t * 1.0e3,
+                   N * sizeof(double) / t / 1.0e6);
+        }
+    }
+
+    shmem_barrier_all();
+    shmem_free(pWrk);
+    shmem_free(dest);
+    shmem_free(source);
+    shmem_finalize();
+    return 0;
+}
@@ -0,0 +1,372 @@
+/*
+ * Example program to show collectives on overlapping teams without
+ * global barriers
+ *
+ * SYNOPSIS:
+ * void  team_sync_init(   int            nslots,
+ *                         size_t         wrk_size,
+ *                         team_sync_t   *world )
+ *
+ * void  team_sync_create( team_sync_t   *parent,
+ *                         shmem_team_t   team,
+ *                         team_sync_t   *sync )
+ *
+ * long *team_sync_next(   team_sync_t   *sync,
+ *                         void         **pWrk )
+ *
+ * void  team_sync_destroy( team_sync_t  *sync )
+ *
+ * TEAM_SYNC_TO_ALL(       TYPENAME, OP, sync, dest, source, nreduce )
+ *
+ * DESCRIPTION:
+ * After shmemx_team_split_2d every PE is a member of an xaxis_team and a
+ * yaxis_team. A reduction on one of them can still be running on some
+ * PEs when they start the next one on the other, so the two must never
+ * share a pSync array, and one pSync array can only be reused by a team
+ * once all members are done with its previous use. The usage examples
+ * get both by a shmem_barrier_all between collectives, which costs more
+ * than the collectives themselves on large teams.
+ *
+ * A team sync context keeps all the sync state of one team: a ring of
+ * TEAM_SYNC_DEPTH pairs of pSync and pWrk arrays, in a slot of a
+ * symmetric pool which no other team uses at the same time.
+ * team_sync_next returns the pSync array for the next collective on the
+ * team and stores the matching pWrk array in pWrk. With a depth of 2, a
+ * pair is reused two collectives later, when every member has been
+ * through the collective in between, which holds for all *_to_all
+ * reductions. TEAM_SYNC_TO_ALL calls shmemx_team_<TYPENAME>_<OP>_to_all
+ * on the team of the context with its next pair.
+ *
+ * team_sync_init is called once by all PEs after shmem_init. It
+ * allocates a pool of nslots slots, at most TEAM_SYNC_MAX_SLOTS, each
+ * with wrk_size bytes of pWrk, and sets up world as the context of
+ * SHMEM_TEAM_WORLD. team_sync_create is a collective routine over the
+ * parent team of the split which created team, and is also called by
+ * the PEs which got SHMEM_TEAM_NULL. The parent PEs agree on a slot free
+ * on all of them with one reduction on the parent context. The teams of
+ * one split have disjoint members and share the slot. team_sync_destroy
+ * is local and frees the slot; the team itself is left to the caller.
+ *
+ * The ordering rules are: all members issue the collectives on a team in
+ * the same order, and all parent PEs create the contexts of the teams
+ * split from it in the same order. Collectives on different teams need
+ * no ordering between them. When compiled with -DTEAM_SYNC_CHECK, every
+ * collective is preceded by a check that all members are at the same
+ * sequence number, and a violation aborts the job with an informative
+ * error message. The check reductions alternate between two pairs of
+ * pSync and pWrk arrays of their own.
+ *
+ * The contexts only cover the sync arrays. A data buffer which is the
+ * dest of a collective on one team and the source of the next one on
+ * another team may still be read by members of the second team when the
+ * first one is issued again, so such a buffer is used in turn from
+ * TEAM_SYNC_DEPTH copies, like the pSync arrays.
+ *
+ * Running out of slots is considered fatal and will result in the job
+ * aborting with an informative error message.
+ *
+ * The team sync routines support the following options:
+ *
+ * nslots, wrk_size
+ *          Number of slots and bytes of each pWrk array of a slot,
+ *          enough for the largest reduction on any team. Must be the same
+ *          on all PEs.
+ *
+ * parent
+ *          Context of the parent team of the split.
+ *
+ * team
+ *          A team created by a split of the parent team, or
+ *          SHMEM_TEAM_NULL.
+ *
+ * sync, world
+ *          Team sync contexts, filled in by the routines.
+ *
+ * EXAMPLE DETAILS:
+ * The example program splits SHMEM_TEAM_WORLD into a two dimensional
+ * grid and runs NITER world sums made of a row reduction followed by a
+ * column reduction. This is done once with the pattern of the usage
+ * examples, a single pSync array and a shmem_barrier_all after each
+ * reduction, and once with a sync context per axis team, no barrier and
+ * TEAM_SYNC_DEPTH row buffers used in turn.
+ * The results are checked, and PE 0 prints the time per world sum.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+
+#define TEAM_SYNC_DEPTH     2
+#define TEAM_SYNC_MAX_SLOTS 256
+#define TEAM_SYNC_WORDS     (TEAM_SYNC_MAX_SLOTS / 64)
+#define TEAM_SYNC_NCHECK    2
+#define TEAM_SYNC_ALIGN     64
+
+/* slot layout in longs: the pSync ring, two check pSync arrays, the
+ * check values and two check pWrk arrays, then the pWrk ring */
+#define TEAM_SYNC_CHECK_WRK ((TEAM_SYNC_DEPTH + 2) * SHMEM_REDUCE_SYNC_SIZE + \
+                             2 * TEAM_SYNC_NCHECK)
+#define TEAM_SYNC_HDR       (TEAM_SYNC_CHECK_WRK +                            \
+                             2 * SHMEM_REDUCE_MIN_WRKDATA_SIZE)
+
+typedef struct {
+    shmem_team_t  team;
+    char         *pWrk;
+    long         *pSync;
+    long         *check;
+    long          seq;
+    int           slot;
+} team_sync_t;
+
+#define TEAM_SYNC_TO_ALL(TYPENAME, OP, sync, dest, source, nreduce)          \
+    do {                                                                     \
+        void *sync_pWrk_;                                                    \
+        long *sync_pSync_ = team_sync_next(sync, &sync_pWrk_);               \
+        shmemx_team_##TYPENAME##_##OP##_to_all((sync)->team, dest, source,   \
+                                               nreduce, sync_pWrk_,          \
+                                               sync_pSync_);                 \
+    } while (0)
+
+static char          *sync_pool;
+static size_t         sync_slot_size;
+static size_t         sync_wrk_size;
+static int            sync_nslots;
+static unsigned long  sync_free[TEAM_SYNC_WORDS];
+
+long sync_free_src[TEAM_SYNC_WORDS];
+long sync_free_dst[TEAM_SYNC_WORDS];
+
+static void team_sync_slot(team_sync_t *sync, shmem_team_t team, int slot) {
+    long *base = (long *) (sync_pool + slot * sync_slot_size);
+
+    sync->team  = team;
+    sync->slot  = slot;
+    sync->seq   = 0;
+    sync->pSync = base;
+    sync->check = base + TEAM_SYNC_DEPTH * SHMEM_REDUCE_SYNC_SIZE;
+    sync->pWrk  = (char *) (base + TEAM_SYNC_HDR);
+}
+
+void team_sync_init(int nslots, size_t wrk_size, team_sync_t *world) {
+    long *base;
+    int i, j;
+
+    if (nslots < 1 || nslots > TEAM_SYNC_MAX_SLOTS) {
+        fprintf(stderr, "team_sync_init: invalid nslots %d\n", nslots);
+        shmem_global_exit(1);
+    }
+    if (wrk_size < SHMEM_REDUCE_MIN_WRKDATA_SIZE * sizeof(long double)) {
+        wrk_size = SHMEM_REDUCE_MIN_WRKDATA_SIZE * sizeof(long double);
+    }
+    sync_wrk_size  = (wrk_size + TEAM_SYNC_ALIGN - 1) &
+                     ~((size_t) TEAM_SYNC_ALIGN - 1);
+    sync_slot_size = TEAM_SYNC_HDR * sizeof(long) +
+                     TEAM_SYNC_DEPTH * sync_wrk_size;
+    sync_slot_size = (sync_slot_size + TEAM_SYNC_ALIGN - 1) &
+                     ~((size_t) TEAM_SYNC_ALIGN - 1);
+    sync_pool = shmem_malloc(nslots * sync_slot_size);
+    if (sync_pool == NULL) {
+        fprintf(stderr, "team_sync_init: cannot allocate %zu bytes\n",
+                nslots * sync_slot_size);
+        shmem_global_exit(1);
+    }
+
+    /* the pSync arrays keep their initial value between collectives */
+    for (i = 0; i < nslots; i++) {
+        base = (long *) (sync_pool + i * sync_slot_size);
+        for (j = 0; j < (TEAM_SYNC_DEPTH + 2) * SHMEM_REDUCE_SYNC_SIZE; j++) {
+            base[j] = SHMEM_SYNC_VALUE;
+        }
+        sync_free[i / 64] |= 1UL << (i % 64);
+    }
+    sync_nslots = nslots;
+
+    sync_free[0] &= ~1UL;
+    team_sync_slot(world, SHMEM_TEAM_WORLD, 0);
+    shmem_barrier_all();
+}
+
+#ifdef TEAM_SYNC_CHECK
+static void team_sync_check(team_sync_t *sync) {
+    long *pSync = sync->check + (sync->seq % 2) * SHMEM_REDUCE_SYNC_SIZE;
+    long *src = sync->check + 2 * SHMEM_REDUCE_SYNC_SIZE;
+    long *dst = src + TEAM_SYNC_NCHECK;
+    long *pWrk = dst + TEAM_SYNC_NCHECK +
+                 (sync->seq % 2) * SHMEM_REDUCE_MIN_WRKDATA_SIZE;
+
+    src[0] = sync->seq;
+    src[1] = -sync->seq;
+    shmemx_team_long_max_to_all(sync->team, dst, src, TEAM_SYNC_NCHECK,
+                                pWrk, pSync);
+    if (dst[0] != -dst[1]) {
+        fprintf(stderr, "team_sync: collective %ld on PE %d is out of "
+                "order, members are at collectives %ld to %ld\n",
+                sync->seq, shmem_my_pe(), -dst[1], dst[0]);
+        shmem_global_exit(1);
+    }
+}
+#endif
+
+long *team_sync_next(team_sync_t *sync, void **pWrk) {
+    int idx;
+
+#ifdef TEAM_SYNC_CHECK
+    team_sync_check(sync);
+#endif
+    idx   = sync->seq++ % TEAM_SYNC_DEPTH;
+    *pWrk = sync->pWrk + idx * sync_wrk_size;
+    return sync->pSync + idx * SHMEM_REDUCE_SYNC_SIZE;
+}
+
+void team_sync_create(team_sync_t *parent, shmem_team_t team,
+                      team_sync_t *sync) {
+    int i, slot = -1;
+
+    /* the parent PEs agree on the lowest slot free on all of them */
+    for (i = 0; i < TEAM_SYNC_WORDS; i++) {
+        sync_free_src[i] = (long) sync_free[i];
+    }
+    TEAM_SYNC_TO_ALL(long, and, parent, sync_free_dst, sync_free_src,
+                     TEAM_SYNC_WORDS);
+    for (i = 0; i < sync_nslots && slot < 0; i++) {
+        if ((unsigned long) sync_free_dst[i / 64] & (1UL << (i % 64))) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        fprintf(stderr, "team_sync_create: no slot free on all %d parent "
+                "PEs, %d slots\n", shmemx_team_n_pes(parent->team),
+                sync_nslots);
+        shmem_global_exit(1);
+    }
+
+    if (team != SHMEM_TEAM_NULL) {
+        sync_free[slot / 64] &= ~(1UL << (slot % 64));
+    }
+    team_sync_slot(sync, team, slot);
+}
+
+void team_sync_destroy(team_sync_t *sync) {
+    if (sync->team != SHMEM_TEAM_NULL) {
+        sync_free[sync->slot / 64] |= 1UL << (sync->slot % 64);
+    }
+    memset(sync, 0, sizeof(*sync));
+    sync->team = SHMEM_TEAM_NULL;
+}
+
+#define NITER   1000
+#define NSLOTS  16
+#define N       16
+
+#define MAX(a, b) ((a > b) ? a : b)
+#define PWRK_MAX_SIZE MAX(N/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE)
+
+long pSync[SHMEM_REDUCE_SYNC_SIZE];
+double pWrk[PWRK_MAX_SIZE];
+double source[N], row[TEAM_SYNC_DEPTH][N], dest[N];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+static int check(int npes) {
+    int i, errors = 0;
+
+    for (i = 0; i < N; i++) {
+        if (dest[i] != (double) npes * (npes - 1) / 2 + (double) npes * i) {
+            errors++;
+        }
+        dest[i] = 0.0;
+    }
+    return errors;
+}
+
+int main(int argc, char *argv[]) {
+    int i, iter;
+    int me, npes, xrange, yrange;
+    int errors_barrier, errors_sync;
+    double t_barrier, t_sync;
+    shmem_team_t xaxis_team, yaxis_team;
+    team_sync_t world, xsync, ysync;
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[i] = SHMEM_SYNC_VALUE;
+    }
+    for (i = 0; i < N; i++) {
+        source[i] = me + i;
+    }
+
+    /* the most square grid holding all PEs */
+    for (xrange = 1, i = 1; i * i <= npes; i++) {
+        if (npes % i == 0) {
+            xrange = i;
+        }
+    }
+    yrange = npes / xrange;
+    shmemx_team_split_2d(SHMEM_TEAM_WORLD, xrange, yrange, &xaxis_team,
+                         &yaxis_team);
+
+    /* a barrier after every reduction, as in the usage examples */
+    shmem_barrier_all();
+    t_barrier = wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        shmemx_team_double_sum_to_all(xaxis_team, row[0], source, N, pWrk,
+                                      pSync);
+        shmem_barrier_all();
+        shmemx_team_double_sum_to_all(yaxis_team, dest, row[0], N, pWrk,
+                                      pSync);
+        shmem_barrier_all();
+    }
+    t_barrier = (wtime() - t_barrier) / NITER;
+    errors_barrier = check(npes);
+
+    /* a sync context per axis team and no barriers */
+    team_sync_init(NSLOTS, PWRK_MAX_SIZE * sizeof(double), &world);
+    team_sync_create(&world, xaxis_team, &xsync);
+    team_sync_create(&world, yaxis_team, &ysync);
+
+    shmem_barrier_all();
+    t_sync = wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        TEAM_SYNC_TO_ALL(double, sum, &xsync, row[iter % TEAM_SYNC_DEPTH],
+                         source, N);
+        TEAM_SYNC_TO_ALL(double, sum, &ysync, dest,
+                         row[iter % TEAM_SYNC_DEPTH], N);
+    }
+    t_sync = (wtime() - t_sync) / NITER;
+    errors_sync = check(npes);
+
+    if (errors_barrier || errors_sync) {
+        printf("Global PE %d has %d wrong sums with barriers and %d with "
+               "sync contexts\n", me, errors_barrier, errors_sync);
+    }
+
+    shmem_barrier_all();
+    team_sync_destroy(&ysync);
+    team_sync_destroy(&xsync);
+    shmemx_team_destroy(&yaxis_team);
+    shmemx_team_destroy(&xaxis_team);
+
+    if (me == 0) {
+        printf("npes %d, grid %d x %d, row then column sum of %d doubles\n",
+               npes, xrange, yrange, N);
+        printf("barrier after each reduction: %10.2f us per world sum\n",
+               t_barrier * 1.0e6);
+        printf("per-team sync contexts:       %10.2f us per world sum\n",
+               t_sync * 1.0e6);
+    }
+
+    shmem_barrier_all();
+    shmem_free(sync_pool);
+    shmem_finalize();
+    return 0;
+}
@@ -0,0 +1,406 @@
+/*
+ * Example program to show persistent team reductions
+ *
+ * SYNOPSIS:
+ * void team_plan_pool_init(               size_t                pool_size )
+ *
+ * void team_<datatype>_<op>_to_all_init(  shmem_team_t          team,
+ *                                         <datatype>           *dest,
+ *                                         const <datatype>     *source,
+ *                                         int                   nreduce,
+ *                                         team_reduce_plan_t  **plan )
+ *
+ * void team_reduce_start(                 team_reduce_plan_t   *plan )
+ * void team_reduce_wait(                  team_reduce_plan_t   *plan )
+ * void team_reduce_plan_free(             team_reduce_plan_t  **plan )
+ *
+ * where <op> is one from sum, prod, max and min for <datatype> short,
+ * int, long, float, double, longdouble and longlong, and additionally
+ * and, or and xor for short, int, long and longlong.
+ *
+ * DESCRIPTION:
+ * Solvers call the same reduction on the same team, with the same
+ * buffers and count, many times over. The persistent reduction routines
+ * split such a call in two. team_<datatype>_<op>_to_all_init is a
+ * collective routine over the members of team. It checks the arguments
+ * once, builds the schedule of a recursive doubling allreduce with the
+ * global PE numbers of all partners, and reserves the receive buffers
+ * and flags of the plan in symmetric memory. Every
+ * team_reduce_start/team_reduce_wait pair then computes the reduction
+ * of the current contents of source into dest, and only moves data.
+ *
+ * team_reduce_start sends the first message of the schedule and returns.
+ * team_reduce_wait completes the reduction; dest is valid after it has
+ * returned, and source may then be changed. Every start must be followed
+ * by a wait before the next start on the same plan. All members must run
+ * the same sequence of plans. A plan has its own flags, so no pSync
+ * needs to be passed and consecutive calls need no other
+ * synchronization.
+ *
+ * For a team of n PEs, the reduction takes log2(n) exchange steps when n
+ * is a power of two. Otherwise the first 2*(n - 2^k) PEs are folded in
+ * pairs before and after the exchange steps, so the result is the same
+ * on all PEs.
+ *
+ * team_plan_pool_init is called once by all PEs after shmem_init and
+ * allocates the symmetric pool for all plans; it also calls
+ * team_map_init from shmemx-team-map.h. Members of a team agree on an
+ * offset in the pool with one reduction on the team in
+ * team_<datatype>_<op>_to_all_init, using the team's own pWrk and pSync
+ * arrays, so no PE outside the team takes part. team_reduce_plan_free is
+ * a local routine. The pool is a stack: only the most recently created
+ * plan gives its space back. Running out of pool space is considered
+ * fatal.
+ *
+ * The persistent reduction routines support the following options:
+ *
+ * pool_size
+ *          Number of bytes of symmetric memory reserved for all plans.
+ *          Must be the same on all PEs.
+ *
+ * team, nreduce
+ *          As for shmemx_team_<datatype>_<op>_to_all.
+ *
+ * dest, source
+ *          Arrays of nreduce elements bound to the plan. Neither needs
+ *          to be symmetric.
+ *
+ * plan
+ *          Handle of the persistent reduction.
+ *
+ * EXAMPLE DETAILS:
+ * The example program runs NITER double sum reductions of 1 and N
+ * elements on SHMEM_TEAM_WORLD and on the teams of odd and even PEs,
+ * once with shmemx_team_double_sum_to_all and once with a persistent
+ * plan, and checks that both give the same result. Team PE 0 of every
+ * team prints the time to create the plan and the latency per call.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+#include "shmemx-team-map.h"
+
+#define TEAM_PLAN_MAX_STEPS     32
+#define TEAM_PLAN_ALIGN         64
+
+
+typedef void (*team_combine_fn)(void *inout, const void *in, int n);
+
+enum {
+    PLAN_FOLD_NONE,
+    PLAN_FOLD_SEND,
+    PLAN_FOLD_KEEP
+};
+
+typedef struct {
+    void           *dest;
+    const void     *source;
+    size_t          bytes;
+    size_t          stride;
+    int             nreduce;
+    team_combine_fn combine;
+    int             fold;
+    int             fold_peer;
+    int             nsteps;
+    int             peer[TEAM_PLAN_MAX_STEPS];
+    long           *flags;
+    char           *bufs;
+    char           *acc;
+    size_t          offset;
+    size_t          size;
+    long            seq;
+} team_reduce_plan_t;
+
+/* one flag and one receive buffer per step and call parity, the fold
+ * slot follows the exchange steps */
+#define PLAN_FLAG(plan, par, slot)                                           \
+    (&(plan)->flags[(par) * (TEAM_PLAN_MAX_STEPS + 1) + (slot)])
+#define PLAN_BUF(plan, par, slot)                                            \
+    ((plan)->bufs + ((par) * ((plan)->nsteps + 1) + (slot)) * (plan)->stride)
+
+static char   *plan_pool;
+static size_t  plan_pool_size;
+static size_t  plan_pool_cursor;
+
+long plan_offset_src;
+long plan_offset_dst;
+
+void team_plan_pool_init(size_t size) {
+    team_map_init();
+
+    plan_pool        = shmem_malloc(size);
+    plan_pool_size   = size;
+    plan_pool_cursor = 0;
+    if (plan_pool == NULL) {
+        fprintf(stderr, "team_plan_pool_init: cannot allocate %zu bytes\n",
+                size);
+        shmem_global_exit(1);
+    }
+}
+
+static long plan_max(shmem_team_t team, long value) {
+    long *pWrk, *pSync;
+
+    team_map_sync(team, &pWrk, &pSync);
+    plan_offset_src = value;
+    shmemx_team_long_max_to_all(team, &plan_offset_dst, &plan_offset_src, 1,
+                                pWrk, pSync);
+    return plan_offset_dst;
+}
+
+static void plan_init(shmem_team_t team, void *dest, const void *source,
+                      int nreduce, size_t elem_size, team_combine_fn combine,
+                      team_reduce_plan_t **planp) {
+    int *pe_map = team_pe_map(team);
+    int  t_pe   = shmemx_team_my_pe(team);
+    int  t_size = shmemx_team_n_pes(team);
+    int  p2, rem, v, k;
+    team_reduce_plan_t *plan;
+
+    if (nreduce < 0) {
+        fprintf(stderr, "team_to_all_init: invalid nreduce %d\n", nreduce);
+        shmem_global_exit(1);
+    }
+
+    plan = calloc(1, sizeof(*plan));
+    plan->dest    = dest;
+    plan->source  = source;
+    plan->nreduce = nreduce;
+    plan->bytes   = nreduce * elem_size;
+    plan->stride  = (plan->bytes + TEAM_PLAN_ALIGN - 1) &
+                    ~((size_t) TEAM_PLAN_ALIGN - 1);
+    plan->combine = combine;
+    plan->acc     = malloc(plan->bytes ? plan->bytes : 1);
+
+    /* fold the first 2*rem PEs in pairs onto a power of two */
+    for (p2 = 1, plan->nsteps = 0; 2 * p2 <= t_size; p2 *= 2) {
+        plan->nsteps++;
+    }
+    rem = t_size - p2;
+    if (t_pe < 2 * rem) {
+        plan->fold      = (t_pe % 2 == 0) ? PLAN_FOLD_SEND : PLAN_FOLD_KEEP;
+        plan->fold_peer = pe_map[t_pe ^ 1];
+        v = t_pe / 2;
+    } else {
+        plan->fold = PLAN_FOLD_NONE;
+        v = t_pe - rem;
+    }
+    for (k = 0; k < plan->nsteps; k++) {
+        int pv = v ^ (1 << k);
+
+        plan->peer[k] = pe_map[(pv < rem) ? 2 * pv + 1 : pv + rem];
+    }
+
+    /* all members agree on the highest cursor as the common offset */
+    plan->size   = 2 * (TEAM_PLAN_MAX_STEPS + 1) * sizeof(long) +
+                   2 * (plan->nsteps + 1) * plan->stride;
+    plan->offset = (size_t) plan_max(team, (long) plan_pool_cursor);
+    if (plan->offset + plan->size > plan_pool_size) {
+        fprintf(stderr, "team_to_all_init: pool exhausted, %zu of %zu "
+                "bytes in use, %zu requested\n", plan->offset,
+                plan_pool_size, plan->size);
+        shmem_global_exit(1);
+    }
+    plan_pool_cursor = plan->offset + plan->size;
+    plan->flags = (long *) (plan_pool + plan->offset);
+    plan->bufs  = plan_pool + plan->offset +
+                  2 * (TEAM_PLAN_MAX_STEPS + 1) * sizeof(long);
+    memset(plan->flags, 0, plan->size);
+
+    /* no member may send before all flags are cleared */
+    plan_max(team, 0);
+    *planp = plan;
+}
+
+static void plan_send(team_reduce_plan_t *plan, int par, int slot, int pe) {
+    shmem_putmem(PLAN_BUF(plan, par, slot), plan->acc, plan->bytes, pe);
+    shmem_fence();
+    shmem_long_p(PLAN_FLAG(plan, par, slot), plan->seq, pe);
+}
+
+static void plan_recv(team_reduce_plan_t *plan, int par, int slot) {
+    shmem_long_wait_until(PLAN_FLAG(plan, par, slot), SHMEM_CMP_EQ,
+                          plan->seq);
+}
+
+void team_reduce_start(team_reduce_plan_t *plan) {
+    int par = (int) (++plan->seq & 1);
+
+    memcpy(plan->acc, plan->source, plan->bytes);
+    if (plan->fold == PLAN_FOLD_SEND) {
+        plan_send(plan, par, plan->nsteps, plan->fold_peer);
+    } else if (plan->fold == PLAN_FOLD_NONE && plan->nsteps > 0) {
+        plan_send(plan, par, 0, plan->peer[0]);
+    }
+}
+
+void team_reduce_wait(team_reduce_plan_t *plan) {
+    int par = (int) (plan->seq & 1);
+    int k;
+
+    if (plan->fold == PLAN_FOLD_SEND) {
+        plan_recv(plan, par, plan->nsteps);
+        memcpy(plan->dest, PLAN_BUF(plan, par, plan->nsteps), plan->bytes);
+        return;
+    }
+    if (plan->fold == PLAN_FOLD_KEEP) {
+        plan_recv(plan, par, plan->nsteps);
+        plan->combine(plan->acc, PLAN_BUF(plan, par, plan->nsteps),
+                      plan->nreduce);
+    }
+
+    for (k = 0; k < plan->nsteps; k++) {
+        if (k > 0 || plan->fold == PLAN_FOLD_KEEP) {
+            plan_send(plan, par, k, plan->peer[k]);
+        }
+        plan_recv(plan, par, k);
+        plan->combine(plan->acc, PLAN_BUF(plan, par, k), plan->nreduce);
+    }
+
+    if (plan->fold == PLAN_FOLD_KEEP) {
+        plan_send(plan, par, plan->nsteps, plan->fold_peer);
+    }
+    memcpy(plan->dest, plan->acc, plan->bytes);
+}
+
+void team_reduce_plan_free(team_reduce_plan_t **plan) {
+    if ((*plan)->offset + (*plan)->size == plan_pool_cursor) {
+        plan_pool_cursor = (*plan)->offset;
+    }
+    free((*plan)->acc);
+    free(*plan);
+    *plan = NULL;
+}
+
+#define DEFINE_PLAN(TYPE, NAME, OPNAME, EXPR)                                \
+static void NAME##_##OPNAME##_combine(void *inout, const void *in, int n) { \
+    TYPE *a = inout;                                                         \
+    const TYPE *b = in;                                                      \
+    int i;                                                                   \
+    for (i = 0; i < n; i++) {                                                \
+        TYPE x = a[i], y = b[i];                                             \
+        a[i] = (EXPR);                                                       \
+    }                                                                        \
+}                                                                            \
+                                                                             \
+void team_##NAME##_##OPNAME##_to_all_init(shmem_team_t team, TYPE *dest,     \
+                                          const TYPE *source, int nreduce,   \
+                                          team_reduce_plan_t **plan) {       \
+    plan_init(team, dest, source, nreduce, sizeof(TYPE),                     \
+              NAME##_##OPNAME##_combine, plan);                              \
+}
+
+#define DEFINE_PLAN_ARITH(TYPE, NAME)                                        \
+    DEFINE_PLAN(TYPE, NAME, sum,  x + y)                                     \
+    DEFINE_PLAN(TYPE, NAME, prod, x * y)                                     \
+    DEFINE_PLAN(TYPE, NAME, max,  (x > y) ? x : y)                           \
+    DEFINE_PLAN(TYPE, NAME, min,  (x < y) ? x : y)
+
+#define DEFINE_PLAN_BITWISE(TYPE, NAME)                                      \
+    DEFINE_PLAN(TYPE, NAME, and,  x & y)                                     \
+    DEFINE_PLAN(TYPE, NAME, or,   x | y)                                     \
+    DEFINE_PLAN(TYPE, NAME, xor,  x ^ y)
+
+DEFINE_PLAN_ARITH(short, short)
+DEFINE_PLAN_ARITH(int, int)
+DEFINE_PLAN_ARITH(long, long)
+DEFINE_PLAN_ARITH(long long, longlong)
+DEFINE_PLAN_ARITH(float, float)
+DEFINE_PLAN_ARITH(double, double)
+DEFINE_PLAN_ARITH(long double, longdouble)
+
+DEFINE_PLAN_BITWISE(short, short)
+DEFINE_PLAN_BITWISE(int, int)
+DEFINE_PLAN_BITWISE(long, long)
+DEFINE_PLAN_BITWISE(long long, longlong)
+
+#define NITER       1000
+#define N           3
+#define POOL_SIZE   (1 << 20)
+
+#define MAX(a, b) ((a > b) ? a : b)
+#define PWRK_MAX_SIZE MAX(N/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE)
+
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+double pWrk[2][PWRK_MAX_SIZE];
+double source[N], dest[N], check[N];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+static void run(shmem_team_t team, const char *name, int nreduce) {
+    int i, iter;
+    double t_to_all, t_init, t_plan;
+    team_reduce_plan_t *plan;
+
+    shmem_barrier_all();
+    t_to_all = wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        shmemx_team_double_sum_to_all(team, check, source, nreduce,
+                                      pWrk[iter % 2], pSync[iter % 2]);
+    }
+    t_to_all = (wtime() - t_to_all) / NITER;
+
+    shmem_barrier_all();
+    t_init = wtime();
+    team_double_sum_to_all_init(team, dest, source, nreduce, &plan);
+    t_init = wtime() - t_init;
+
+    t_plan = wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        team_reduce_start(plan);
+        team_reduce_wait(plan);
+    }
+    t_plan = (wtime() - t_plan) / NITER;
+    team_reduce_plan_free(&plan);
+
+    for (i = 0; i < nreduce; i++) {
+        if (dest[i] != check[i]) {
+            printf("[PE:%d] %s: dest[%d] %g, expected %g\n", shmem_my_pe(),
+                   name, i, dest[i], check[i]);
+        }
+    }
+    if (shmemx_team_my_pe(team) == 0) {
+        printf("%-16s size %4d nreduce %d: sum_to_all %8.2f us, "
+               "plan init %8.2f us, start/wait %8.2f us\n", name,
+               shmemx_team_n_pes(team), nreduce, t_to_all * 1.0e6,
+               t_init * 1.0e6, t_plan * 1.0e6);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int i;
+    int me;
+    shmem_team_t new_team;
+
+    shmem_init();
+    me = shmem_my_pe();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    for (i = 0; i < N; i++) {
+        source[i] = me + i * 0.5;
+    }
+    team_plan_pool_init(POOL_SIZE);
+
+    run(SHMEM_TEAM_WORLD, "SHMEM_TEAM_WORLD", 1);
+    run(SHMEM_TEAM_WORLD, "SHMEM_TEAM_WORLD", N);
+
+    shmemx_team_split_color(SHMEM_TEAM_WORLD, me % 2, me, &new_team);
+    run(new_team, (me % 2) ? "odd team" : "even team", 1);
+    run(new_team, (me % 2) ? "odd team" : "even team", N);
+
+    team_map_destroy(&new_team);
+    shmem_barrier_all();
+    shmem_finalize();
+    return 0;
+}
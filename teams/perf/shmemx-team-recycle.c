@@ -0,0 +1,461 @@
+/*
+ * Example program to show recycling of teams and their sync slots
+ *
+ * SYNOPSIS:
+ * void team_recycle_init(          int               nslots,
+ *                                  size_t            wrk_size,
+ *                                  int               retain )
+ *
+ * void team_recycle_split_strided( shmem_team_t      parent_team,
+ *                                  int               PE_start,
+ *                                  int               PE_stride,
+ *                                  int               PE_size,
+ *                                  team_recycle_t  **new_team )
+ *
+ * void team_recycle_split_2d(      shmem_team_t      parent_team,
+ *                                  int               xrange,
+ *                                  int               yrange,
+ *                                  team_recycle_t  **xaxis_team,
+ *                                  team_recycle_t  **yaxis_team )
+ *
+ * void team_recycle_destroy(       team_recycle_t  **team )
+ *
+ * void team_recycle_finalize(      void )
+ *
+ * DESCRIPTION:
+ * Codes which regrid often split and destroy teams again and again, and
+ * every new team needs its own pSync and pWrk arrays. Allocating those
+ * with shmem_malloc costs a global barrier and a network registration
+ * each time, and the team itself is rebuilt from scratch even when the
+ * same set of PEs had a team a moment ago.
+ *
+ * team_recycle_init is called once by all PEs after shmem_init. It
+ * allocates a symmetric pool of nslots sync slots, each holding two
+ * pSync arrays and a pWrk array of wrk_size bytes, at most
+ * TEAM_RECYCLE_MAX_SLOTS, and ends with a barrier over all PEs. Each team
+ * created by team_recycle_split_strided or team_recycle_split_2d gets a
+ * slot, available to the caller as team->pSync[0], team->pSync[1] and
+ * team->pWrk, and the SHMEM team handle itself as team->team. The members
+ * of a new team agree on a slot that is free on all of them with one
+ * reduction on the new team, so slots are reused as soon as their team is
+ * gone and no PE outside the team takes part.
+ *
+ * That reduction uses sync arrays shared by all new teams. A second one,
+ * on sync arrays the slot keeps for the routines themselves, makes sure
+ * that every member is done with them before any member splits its next
+ * team. It also numbers the team in creation order. The reduction of
+ * team_recycle_destroy uses the slot's own arrays as well, alternating
+ * between two of them, so reductions on teams sharing a PE never use the
+ * same arrays.
+ *
+ * team_recycle_destroy is a collective routine over the members of the
+ * team. Instead of destroying the team, it parks it, with its slot, on a
+ * list of up to retain teams per PE. A later split of the same parent
+ * team with the same PE triplet takes the parked team back without any
+ * communication. Only when the list of one of the members is full is the
+ * team destroyed and its slot freed; the members agree on this with one
+ * reduction on the team, so they always take the same decision. Setting
+ * retain to 0 disables parking. The team records are recycled as well.
+ *
+ * Parked teams stay valid only as long as their parent team, and are
+ * destroyed by team_recycle_finalize, which must be called by all PEs
+ * before the parent teams are destroyed and before shmem_finalize. It
+ * destroys them in creation order, which is the same on all members.
+ *
+ * Running out of slots in a split is considered fatal and will result in
+ * the job aborting with an informative error message.
+ *
+ * The team recycling routines support the following options:
+ *
+ * nslots, wrk_size, retain
+ *          Number of sync slots, bytes of pWrk in each slot and number
+ *          of parked teams per PE. Must be the same on all PEs.
+ *
+ * parent_team, PE_start, PE_stride, PE_size, xrange, yrange
+ *          As for the corresponding shmemx_team_split_* routine.
+ *          team_recycle_split_strided is only called by the PEs in the
+ *          triplet.
+ *
+ * new_team, xaxis_team, yaxis_team
+ *          New team records, or NULL if the calling PE is not a member.
+ *
+ * team
+ *          A team record from a team_recycle_split_* routine.
+ *
+ * EXAMPLE DETAILS:
+ * The example program runs NCYCLES regrid cycles, unless another number
+ * is given on the command line. Each cycle splits SHMEM_TEAM_WORLD with
+ * split_2d, taking xrange in turn from a few divisors of the number of
+ * PEs, runs one reduction on each axis team and destroys both teams. This
+ * is done once with shmemx_team_split_2d and pSync and pWrk arrays from
+ * shmem_malloc, and once with team_recycle_split_2d. PE 0 prints the time
+ * per cycle of both and how many teams were taken from the parked list.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+
+#define TEAM_RECYCLE_MAX_SLOTS  1024
+#define TEAM_RECYCLE_ALIGN      64
+#define TEAM_RECYCLE_WORDS      (TEAM_RECYCLE_MAX_SLOTS / 64)
+
+/* sync arrays of a slot used by the routines themselves */
+typedef struct {
+    long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+    long pWrk[2][SHMEM_REDUCE_MIN_WRKDATA_SIZE];
+    long src[2];
+    long dst[2];
+} team_recycle_sys_t;
+
+typedef struct team_recycle {
+    shmem_team_t         team;
+    long                *pSync[2];
+    void                *pWrk;
+    shmem_team_t         parent;
+    int                  start;
+    int                  stride;
+    int                  size;
+    int                  slot;
+    team_recycle_sys_t  *sys;
+    int                  sys_idx;
+    long                 serial;
+    struct team_recycle *next;
+} team_recycle_t;
+
+static char           *recycle_pool;
+static size_t          recycle_slot_size;
+static int             recycle_nslots;
+static int             recycle_retain;
+static int             recycle_nparked;
+static team_recycle_t *recycle_parked;
+static team_recycle_t *recycle_records;
+static unsigned long   recycle_free[TEAM_RECYCLE_WORDS];
+static long            recycle_hits;
+static long            recycle_misses;
+static long            recycle_serial;
+
+long recycle_pSync[SHMEM_REDUCE_SYNC_SIZE];
+long recycle_pWrk[SHMEM_REDUCE_MIN_WRKDATA_SIZE + TEAM_RECYCLE_WORDS];
+long recycle_free_src[TEAM_RECYCLE_WORDS];
+long recycle_free_dst[TEAM_RECYCLE_WORDS];
+
+void team_recycle_init(int nslots, size_t wrk_size, int retain) {
+    int i;
+
+    if (nslots < 1 || nslots > TEAM_RECYCLE_MAX_SLOTS) {
+        fprintf(stderr, "team_recycle_init: invalid nslots %d\n", nslots);
+        shmem_global_exit(1);
+    }
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        recycle_pSync[i] = SHMEM_SYNC_VALUE;
+    }
+
+    recycle_slot_size = 2 * SHMEM_REDUCE_SYNC_SIZE * sizeof(long) +
+                        sizeof(team_recycle_sys_t) + wrk_size;
+    recycle_slot_size = (recycle_slot_size + TEAM_RECYCLE_ALIGN - 1) &
+                        ~((size_t) TEAM_RECYCLE_ALIGN - 1);
+    recycle_pool = shmem_malloc(nslots * recycle_slot_size);
+    if (recycle_pool == NULL) {
+        fprintf(stderr, "team_recycle_init: cannot allocate %zu bytes\n",
+                nslots * recycle_slot_size);
+        shmem_global_exit(1);
+    }
+    for (i = 0; i < nslots; i++) {
+        long *pSync = (long *) (recycle_pool + i * recycle_slot_size);
+        team_recycle_sys_t *sys = (team_recycle_sys_t *)
+                                  (pSync + 2 * SHMEM_REDUCE_SYNC_SIZE);
+        int j;
+
+        for (j = 0; j < SHMEM_REDUCE_SYNC_SIZE; j++) {
+            pSync[j] = SHMEM_SYNC_VALUE;
+            pSync[SHMEM_REDUCE_SYNC_SIZE + j] = SHMEM_SYNC_VALUE;
+            sys->pSync[0][j] = SHMEM_SYNC_VALUE;
+            sys->pSync[1][j] = SHMEM_SYNC_VALUE;
+        }
+        recycle_free[i / 64] |= 1UL << (i % 64);
+    }
+    recycle_nslots = nslots;
+    recycle_retain = retain;
+    shmem_barrier_all();
+}
+
+static team_recycle_t *recycle_record(void) {
+    team_recycle_t *t = recycle_records;
+
+    if (t != NULL) {
+        recycle_records = t->next;
+    } else {
+        t = malloc(sizeof(*t));
+    }
+    return t;
+}
+
+/* maximum of value over the team, on the slot's own sync arrays */
+static long recycle_max(team_recycle_t *t, long value) {
+    int i = t->sys_idx;
+
+    t->sys_idx = !i;
+    t->sys->src[i] = value;
+    shmemx_team_long_max_to_all(t->team, &t->sys->dst[i], &t->sys->src[i],
+                                1, t->sys->pWrk[i], t->sys->pSync[i]);
+    return t->sys->dst[i];
+}
+
+/* the members agree on the lowest slot free on all of them */
+static void recycle_slot(team_recycle_t *t) {
+    int i, w;
+    char *base;
+
+    for (w = 0; w < TEAM_RECYCLE_WORDS; w++) {
+        recycle_free_src[w] = (long) recycle_free[w];
+    }
+    shmemx_team_long_and_to_all(t->team, recycle_free_dst, recycle_free_src,
+                                TEAM_RECYCLE_WORDS, recycle_pWrk,
+                                recycle_pSync);
+
+    t->slot = -1;
+    for (i = 0; i < recycle_nslots && t->slot < 0; i++) {
+        if ((unsigned long) recycle_free_dst[i / 64] & (1UL << (i % 64))) {
+            t->slot = i;
+        }
+    }
+    if (t->slot < 0) {
+        fprintf(stderr, "team_recycle: no sync slot free on all %d members, "
+                "%d slots\n", shmemx_team_n_pes(t->team), recycle_nslots);
+        shmem_global_exit(1);
+    }
+    recycle_free[t->slot / 64] &= ~(1UL << (t->slot % 64));
+
+    base = recycle_pool + t->slot * recycle_slot_size;
+    t->pSync[0] = (long *) base;
+    t->pSync[1] = (long *) base + SHMEM_REDUCE_SYNC_SIZE;
+    t->sys      = (team_recycle_sys_t *) (t->pSync[1] +
+                                          SHMEM_REDUCE_SYNC_SIZE);
+    t->pWrk     = t->sys + 1;
+    t->sys_idx  = 0;
+
+    /* all members have left recycle_pSync once this returns */
+    t->serial      = recycle_max(t, recycle_serial);
+    recycle_serial = t->serial + 1;
+}
+
+void team_recycle_split_strided(shmem_team_t parent_team, int PE_start,
+                                int PE_stride, int PE_size,
+                                team_recycle_t **new_team) {
+    team_recycle_t *t, **prev;
+
+    for (prev = &recycle_parked; (t = *prev) != NULL; prev = &t->next) {
+        if (t->parent == parent_team && t->start == PE_start &&
+            t->stride == PE_stride && t->size == PE_size) {
+            *prev = t->next;
+            recycle_nparked--;
+            recycle_hits++;
+            *new_team = t;
+            return;
+        }
+    }
+
+    t = recycle_record();
+    t->parent = parent_team;
+    t->start  = PE_start;
+    t->stride = PE_stride;
+    t->size   = PE_size;
+    shmemx_team_split_strided(parent_team, PE_start, PE_stride, PE_size,
+                              &t->team);
+    recycle_slot(t);
+    recycle_misses++;
+    *new_team = t;
+}
+
+void team_recycle_split_2d(shmem_team_t parent_team, int xrange, int yrange,
+                           team_recycle_t **xaxis_team,
+                           team_recycle_t **yaxis_team) {
+    int p_pe = shmemx_team_my_pe(parent_team);
+    int x = p_pe % xrange;
+    int y = p_pe / xrange;
+
+    if (p_pe >= xrange * yrange) {
+        *xaxis_team = NULL;
+        *yaxis_team = NULL;
+        return;
+    }
+    team_recycle_split_strided(parent_team, y * xrange, 1, xrange,
+                               xaxis_team);
+    team_recycle_split_strided(parent_team, x, xrange, yrange, yaxis_team);
+}
+
+static void recycle_release(team_recycle_t *t) {
+    recycle_free[t->slot / 64] |= 1UL << (t->slot % 64);
+    shmemx_team_destroy(&t->team);
+    t->next = recycle_records;
+    recycle_records = t;
+}
+
+void team_recycle_destroy(team_recycle_t **team) {
+    team_recycle_t *t = *team;
+
+    if (t == NULL) {
+        return;
+    }
+    *team = NULL;
+
+    /* park the team unless the list of any member is full */
+    if (recycle_max(t, recycle_nparked >= recycle_retain)) {
+        recycle_release(t);
+        return;
+    }
+    t->next = recycle_parked;
+    recycle_parked = t;
+    recycle_nparked++;
+}
+
+static int recycle_order(const void *a, const void *b) {
+    const team_recycle_t *s = *(team_recycle_t * const *) a;
+    const team_recycle_t *t = *(team_recycle_t * const *) b;
+
+    return (s->serial > t->serial) - (s->serial < t->serial);
+}
+
+void team_recycle_finalize(void) {
+    team_recycle_t **parked = malloc((recycle_nparked + 1) * sizeof(*parked));
+    team_recycle_t *t;
+    int i, n = 0;
+
+    /* destroy the parked teams in the same order on all their members */
+    for (t = recycle_parked; t != NULL; t = t->next) {
+        parked[n++] = t;
+    }
+    qsort(parked, n, sizeof(*parked), recycle_order);
+    for (i = 0; i < n; i++) {
+        recycle_release(parked[i]);
+    }
+    free(parked);
+    recycle_parked = NULL;
+    recycle_nparked = 0;
+
+    while ((t = recycle_records) != NULL) {
+        recycle_records = t->next;
+        free(t);
+    }
+    shmem_barrier_all();
+    shmem_free(recycle_pool);
+}
+
+#define NCYCLES 10000
+#define NSHAPES 4
+#define NSLOTS  64
+#define RETAIN  8
+#define N       16
+
+#define MAX(a, b) ((a > b) ? a : b)
+#define PWRK_MAX_SIZE MAX(N/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE)
+
+double source[N], dest[N];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/* up to NSHAPES divisors of npes, used in turn as xrange */
+static int shapes(int npes, int *xranges) {
+    int d, n = 0;
+
+    for (d = 1; d <= npes && n < NSHAPES; d++) {
+        if (npes % d == 0) {
+            xranges[n++] = d;
+        }
+    }
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    int i, c, a;
+    int me, npes, nshapes, xrange, yrange;
+    int ncycles = (argc > 1) ? atoi(argv[1]) : NCYCLES;
+    int xranges[NSHAPES];
+    double t_plain, t_recycle;
+    long *pSync;
+    double *pWrk;
+    shmem_team_t axis[2];
+    team_recycle_t *raxis[2];
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+    nshapes = shapes(npes, xranges);
+    xrange = xranges[0];
+    yrange = npes / xrange;
+
+    for (i = 0; i < N; i++) {
+        source[i] = me;
+    }
+
+    /* every cycle allocates new teams and sync arrays */
+    shmem_barrier_all();
+    t_plain = wtime();
+    for (c = 0; c < ncycles; c++) {
+        xrange = xranges[c % nshapes];
+        yrange = npes / xrange;
+        shmemx_team_split_2d(SHMEM_TEAM_WORLD, xrange, yrange, &axis[0],
+                             &axis[1]);
+        pSync = shmem_malloc(2 * SHMEM_REDUCE_SYNC_SIZE * sizeof(long));
+        pWrk  = shmem_malloc(PWRK_MAX_SIZE * sizeof(double));
+        for (i = 0; i < 2 * SHMEM_REDUCE_SYNC_SIZE; i++) {
+            pSync[i] = SHMEM_SYNC_VALUE;
+        }
+        shmem_barrier_all();
+        for (a = 0; a < 2; a++) {
+            shmemx_team_double_sum_to_all(axis[a], dest, source, N, pWrk,
+                                          pSync + a * SHMEM_REDUCE_SYNC_SIZE);
+        }
+        shmem_free(pWrk);
+        shmem_free(pSync);
+        shmemx_team_destroy(&axis[0]);
+        shmemx_team_destroy(&axis[1]);
+    }
+    t_plain = (wtime() - t_plain) / ncycles;
+
+    /* teams and sync slots are recycled */
+    team_recycle_init(NSLOTS, PWRK_MAX_SIZE * sizeof(double), RETAIN);
+    shmem_barrier_all();
+    t_recycle = wtime();
+    for (c = 0; c < ncycles; c++) {
+        xrange = xranges[c % nshapes];
+        yrange = npes / xrange;
+        team_recycle_split_2d(SHMEM_TEAM_WORLD, xrange, yrange, &raxis[0],
+                              &raxis[1]);
+        for (a = 0; a < 2; a++) {
+            shmemx_team_double_sum_to_all(raxis[a]->team, dest, source, N,
+                                          raxis[a]->pWrk,
+                                          raxis[a]->pSync[c % 2]);
+        }
+        team_recycle_destroy(&raxis[0]);
+        team_recycle_destroy(&raxis[1]);
+    }
+    t_recycle = (wtime() - t_recycle) / ncycles;
+
+    if (ncycles > 0 && dest[0] != (double) (me % xrange) * yrange +
+                       (double) xrange * yrange * (yrange - 1) / 2) {
+        printf("Global PE %d has wrong column sum %f\n", me, dest[0]);
+    }
+
+    if (me == 0) {
+        printf("npes %d, %d split_2d shapes, %d cycles\n", npes, nshapes,
+               ncycles);
+        printf("split and shmem_malloc: %10.2f us per cycle\n",
+               t_plain * 1.0e6);
+        printf("recycled:               %10.2f us per cycle, %ld of %ld "
+               "teams reused\n", t_recycle * 1.0e6, recycle_hits,
+               recycle_hits + recycle_misses);
+    }
+
+    team_recycle_finalize();
+    shmem_finalize();
+    return 0;
+}
@@ -0,0 +1,336 @@
+/*
+ * Example program to show team reduce-scatter routines
+ *
+ * SYNOPSIS:
+ * void team_<datatype>_<op>_reduce_scatter(  shmem_team_t  team,
+ *                                            <datatype>   *dest,
+ *                                            <datatype>   *source,
+ *                                            const int    *counts,
+ *                                            <datatype>   *pWrk,
+ *                                            long         *pSync )
+ *
+ * void team_<datatype>_<op>_reduce_scatter_block( shmem_team_t team,
+ *                                                 <datatype>  *dest,
+ *                                                 <datatype>  *source,
+ *                                                 int          blocksize,
+ *                                                 <datatype>  *pWrk,
+ *                                                 long        *pSync )
+ *
+ * where <op> is one from sum, prod, max and min for <datatype> short,
+ * int, long, float, double, longdouble and longlong, and additionally
+ * and, or and xor for short, int, long and longlong.
+ *
+ * DESCRIPTION:
+ * The reduce-scatter routines are collective routines which reduce the
+ * source arrays of all members of a team element by element, like
+ * shmemx_team_<datatype>_<op>_to_all, but leave on every team PE only its
+ * own block of the result. Team PE i receives counts[i] elements, which
+ * are the elements counts[0] + ... + counts[i-1] onwards of the result.
+ * The _block variant uses blocksize elements for every team PE.
+ *
+ * The reduction runs on a ring: in each of n-1 steps for a team of n PEs,
+ * every PE passes one partially reduced block to the next team PE and
+ * combines the block it receives with its own contribution. Every PE
+ * sends and receives (n-1)/n of the source array once, which is the
+ * minimum for this operation and about half of what a reduction to all
+ * PEs moves. Blocks are double buffered in pWrk and the receiver
+ * acknowledges each one, so consecutive calls may use the same pWrk and
+ * pSync without other synchronization. They must not be shared between
+ * teams.
+ *
+ * Only pWrk and pSync have to be symmetric. The first call on a team
+ * gathers the mapping from team PE numbers to global PE numbers and is
+ * therefore slower than the following ones.
+ *
+ * The reduce-scatter routines support the following options:
+ *
+ * team
+ *          A valid PE team. A predefined team constant or any team
+ *          created by a split team routine may be used.
+ *
+ * dest
+ *          An array of counts[team_pe] (blocksize) elements receiving
+ *          this PE's block of the result.
+ *
+ * source
+ *          An array of counts[0] + ... + counts[n-1] (n * blocksize)
+ *          elements.
+ *
+ * counts, blocksize
+ *          Number of result elements for each team PE. counts must hold
+ *          one entry per team PE, and the values must be the same on all
+ *          members.
+ *
+ * pWrk
+ *          A symmetric work array of at least 2 * max(counts) (2 *
+ *          blocksize) elements.
+ *
+ * pSync
+ *          A symmetric work array of TEAM_RS_SYNC_SIZE longs. Every
+ *          element must be initialized with SHMEM_SYNC_VALUE before the
+ *          first call.
+ *
+ * EXAMPLE DETAILS:
+ * The example program sums a vector of NBLOCK elements per PE over
+ * SHMEM_TEAM_WORLD, once with shmemx_team_double_sum_to_all keeping only
+ * the local slice, and once with team_double_sum_reduce_scatter_block.
+ * It then runs team_int_sum_reduce_scatter with a different block size
+ * for every PE and checks every PE's block against the expected sums.
+ * PE 0 prints the latencies.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+#include "shmemx-team-map.h"
+
+#define TEAM_RS_DATA            0
+#define TEAM_RS_ACK             2
+#define TEAM_RS_SEQ             3
+#define TEAM_RS_SYNC_SIZE       4
+
+typedef void (*team_combine_fn)(void *inout, const void *in, int n);
+
+/*
+ * Ring reduce-scatter. In step s this PE sends the partial result of
+ * block (t_pe - s - 1) to the right neighbour and receives block
+ * (t_pe - s - 2) from the left one; after n-1 steps the block received
+ * is its own. Both neighbours count messages the same way, so the message
+ * number doubles as the sequence value of the data and ack flags.
+ */
+static void team_reduce_scatter(shmem_team_t team, void *dest,
+                                const void *source, const int *counts,
+                                size_t elem_size, team_combine_fn combine,
+                                void *pWrk, long *pSync) {
+    int *pe_map  = team_pe_map(team);
+    int  t_pe    = shmemx_team_my_pe(team);
+    int  t_size  = shmemx_team_n_pes(team);
+    int  right   = pe_map[(t_pe + 1) % t_size];
+    int  left    = pe_map[(t_pe + t_size - 1) % t_size];
+    int  i, s, max_count = 0;
+    long *displs = malloc(t_size * sizeof(long));
+    char *acc, *src = (char *) source, *wrk = pWrk;
+    size_t slot_bytes;
+
+    for (i = 0; i < t_size; i++) {
+        displs[i] = i ? displs[i - 1] + counts[i - 1] : 0;
+        max_count = (counts[i] > max_count) ? counts[i] : max_count;
+    }
+    slot_bytes = max_count * elem_size;
+    acc = malloc(slot_bytes ? slot_bytes : 1);
+
+    if (t_size == 1) {
+        memcpy(dest, source, counts[0] * elem_size);
+    }
+
+    for (s = 0; s < t_size - 1; s++) {
+        int  send_blk = (t_pe - s - 1 + t_size) % t_size;
+        int  recv_blk = (t_pe - s - 2 + 2 * t_size) % t_size;
+        long msg      = ++pSync[TEAM_RS_SEQ];
+        int  slot     = (int) (msg & 1);
+        char *sendbuf = (s == 0) ? src + displs[send_blk] * elem_size : acc;
+        char *recvbuf = wrk + slot * slot_bytes;
+
+        /*
+         * The slot is free once the right neighbour consumed msg - 2. The
+         * first step waits for msg - 1 as well, since the slot layout of
+         * the previous call may differ.
+         */
+        shmem_long_wait_until(&pSync[TEAM_RS_ACK], SHMEM_CMP_GE,
+                              (s == 0) ? msg - 1 : msg - 2);
+        shmem_putmem(recvbuf, sendbuf, counts[send_blk] * elem_size, right);
+        shmem_fence();
+        shmem_long_p(&pSync[TEAM_RS_DATA + slot], msg, right);
+
+        shmem_long_wait_until(&pSync[TEAM_RS_DATA + slot], SHMEM_CMP_EQ, msg);
+        memcpy(acc, recvbuf, counts[recv_blk] * elem_size);
+        shmem_long_p(&pSync[TEAM_RS_ACK], msg, left);
+        combine(acc, src + displs[recv_blk] * elem_size, counts[recv_blk]);
+    }
+
+    if (t_size > 1) {
+        memcpy(dest, acc, counts[t_pe] * elem_size);
+    }
+
+    free(displs);
+    free(acc);
+}
+
+#define DEFINE_RS(TYPE, NAME, OPNAME, EXPR)                                  \
+static void NAME##_##OPNAME##_combine(void *inout, const void *in, int n) { \
+    TYPE *a = inout;                                                         \
+    const TYPE *b = in;                                                      \
+    int i;                                                                   \
+    for (i = 0; i < n; i++) {                                                \
+        TYPE x = a[i], y = b[i];                                             \
+        a[i] = (EXPR);                                                       \
+    }                                                                        \
+}                                                                            \
+                                                                             \
+void team_##NAME##_##OPNAME##_reduce_scatter(shmem_team_t team, TYPE *dest,  \
+                                             TYPE *source,                   \
+                                             const int *counts,              \
+                                             TYPE *pWrk, long *pSync) {      \
+    team_reduce_scatter(team, dest, source, counts, sizeof(TYPE),            \
+                        NAME##_##OPNAME##_combine, pWrk, pSync);             \
+}                                                                            \
+                                                                             \
+void team_##NAME##_##OPNAME##_reduce_scatter_block(shmem_team_t team,        \
+                                                   TYPE *dest, TYPE *source, \
+                                                   int blocksize,            \
+                                                   TYPE *pWrk, long *pSync) {\
+    int i, t_size = shmemx_team_n_pes(team);                                 \
+    int *counts = malloc(t_size * sizeof(int));                              \
+    for (i = 0; i < t_size; i++) {                                           \
+        counts[i] = blocksize;                                               \
+    }                                                                        \
+    team_reduce_scatter(team, dest, source, counts, sizeof(TYPE),            \
+                        NAME##_##OPNAME##_combine, pWrk, pSync);             \
+    free(counts);                                                            \
+}
+
+#define DEFINE_RS_ARITH(TYPE, NAME)                                          \
+    DEFINE_RS(TYPE, NAME, sum,  x + y)                                       \
+    DEFINE_RS(TYPE, NAME, prod, x * y)                                       \
+    DEFINE_RS(TYPE, NAME, max,  (x > y) ? x : y)                             \
+    DEFINE_RS(TYPE, NAME, min,  (x < y) ? x : y)
+
+#define DEFINE_RS_BITWISE(TYPE, NAME)                                        \
+    DEFINE_RS(TYPE, NAME, and,  x & y)                                       \
+    DEFINE_RS(TYPE, NAME, or,   x | y)                                       \
+    DEFINE_RS(TYPE, NAME, xor,  x ^ y)
+
+DEFINE_RS_ARITH(short, short)
+DEFINE_RS_ARITH(int, int)
+DEFINE_RS_ARITH(long, long)
+DEFINE_RS_ARITH(long long, longlong)
+DEFINE_RS_ARITH(float, float)
+DEFINE_RS_ARITH(double, double)
+DEFINE_RS_ARITH(long double, longdouble)
+
+DEFINE_RS_BITWISE(short, short)
+DEFINE_RS_BITWISE(int, int)
+DEFINE_RS_BITWISE(long, long)
+DEFINE_RS_BITWISE(long long, longlong)
+
+#define NITER       20
+#define NBLOCK      (1 << 16)
+
+#define MAX(a, b) ((a > b) ? a : b)
+
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+long rs_pSync[TEAM_RS_SYNC_SIZE];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+int main(int argc, char *argv[]) {
+    int i, iter;
+    int me, npes;
+    int nreduce, pwrk_size;
+    int *counts, *isource, *idest, *ipWrk, ntotal, offset, expected;
+    double *source, *dest, *pWrk[2], *slice;
+    double t_to_all, t_rs;
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    for (i = 0; i < TEAM_RS_SYNC_SIZE; i++) {
+        rs_pSync[i] = SHMEM_SYNC_VALUE;
+    }
+    team_map_init();
+
+    nreduce   = npes * NBLOCK;
+    pwrk_size = MAX(nreduce/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE);
+    pwrk_size = MAX(pwrk_size, 2 * NBLOCK);
+    source    = shmem_malloc(nreduce * sizeof(double));
+    dest      = shmem_malloc(nreduce * sizeof(double));
+    pWrk[0]   = shmem_malloc(pwrk_size * sizeof(double));
+    pWrk[1]   = shmem_malloc(pwrk_size * sizeof(double));
+    slice     = malloc(NBLOCK * sizeof(double));
+
+    for (i = 0; i < nreduce; i++) {
+        source[i] = me + i;
+    }
+
+    /* reduce the whole vector, keep this PE's slice */
+    shmem_barrier_all();
+    t_to_all = wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        shmemx_team_double_sum_to_all(SHMEM_TEAM_WORLD, dest, source,
+                                      nreduce, pWrk[iter % 2],
+                                      pSync[iter % 2]);
+        memcpy(slice, dest + me * NBLOCK, NBLOCK * sizeof(double));
+    }
+    t_to_all = (wtime() - t_to_all) / NITER;
+
+    shmem_barrier_all();
+    t_rs = wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        team_double_sum_reduce_scatter_block(SHMEM_TEAM_WORLD, slice, source,
+                                             NBLOCK, pWrk[0], rs_pSync);
+    }
+    t_rs = (wtime() - t_rs) / NITER;
+
+    if (slice[0] != dest[me * NBLOCK]) {
+        printf("[PE:%d] slice[0]=%g, expected %g\n", me, slice[0],
+               dest[me * NBLOCK]);
+    }
+
+    /* variable block sizes: team PE i keeps i+1 elements */
+    counts = calloc(npes, sizeof(int));
+    for (i = 0, ntotal = 0; i < npes; i++) {
+        counts[i] = i + 1;
+        ntotal   += counts[i];
+    }
+    offset = me * (me + 1) / 2;
+    isource = malloc(ntotal * sizeof(int));
+    idest   = malloc(counts[me] * sizeof(int));
+    ipWrk   = (int *) pWrk[0];
+    for (i = 0; i < ntotal; i++) {
+        isource[i] = me + i;
+    }
+    shmem_barrier_all();
+    team_int_sum_reduce_scatter(SHMEM_TEAM_WORLD, idest, isource, counts,
+                                ipWrk, rs_pSync);
+    for (i = 0; i < counts[me]; i++) {
+        expected = npes * (npes - 1) / 2 + npes * (offset + i);
+        if (idest[i] != expected) {
+            printf("[PE:%d] idest[%d]=%d, expected %d\n", me, i, idest[i],
+                   expected);
+            break;
+        }
+    }
+    printf("[PE:%d] %d elements, dest[0]=%d\n", me, counts[me], idest[0]);
+
+    shmem_barrier_all();
+    if (me == 0) {
+        printf("npes %d, %d doubles per PE block\n", npes, NBLOCK);
+        printf("sum_to_all + slice:   %10.2f us\n", t_to_all * 1.0e6);
+        printf("reduce_scatter_block: %10.2f us\n", t_rs * 1.0e6);
+    }
+
+    free(counts);
+    free(isource);
+    free(idest);
+    free(slice);
+    shmem_barrier_all();
+    shmem_free(pWrk[1]);
+    shmem_free(pWrk[0]);
+    shmem_free(dest);
+    shmem_free(source);
+    shmem_finalize();
+    return 0;
+}
@@ -0,0 +1,379 @@
+/*
+ * Example program to show rooted team reduction routines
+ *
+ * SYNOPSIS:
+ * void team_<datatype>_<op>_reduce(  shmem_team_t  team,
+ *                                    int           root,
+ *                                    <datatype>   *dest,
+ *                                    <datatype>   *source,
+ *                                    int           nreduce,
+ *                                    <datatype>   *pWrk,
+ *                                    long         *pSync )
+ *
+ * where <op> is one from sum, prod, max and min for <datatype> short,
+ * int, long, float, double, longdouble and longlong, and additionally
+ * and, or and xor for short, int, long and longlong.
+ *
+ * DESCRIPTION:
+ * The rooted reduction routines are collective routines which compute
+ * the same reductions as shmemx_team_<datatype>_<op>_to_all, but place
+ * the result only in dest on the team PE root. dest is left unchanged on
+ * all other members, so no broadcast or allgather phase is needed.
+ *
+ * Up to TEAM_REDUCE_TREE_MAX bytes, the reduction runs a binomial tree
+ * towards root in ceil(log2(n)) steps for a team of n PEs. Larger
+ * reductions run a ring reduce-scatter, after which every PE writes its
+ * reduced block straight into dest on root. This moves each element
+ * about twice instead of log2(n) times. The choice depends only on
+ * nreduce and the datatype, so it is the same on all members.
+ *
+ * Non-root PEs return as soon as their contribution has been sent. The
+ * receiver of every message acknowledges it, so consecutive calls with
+ * the same nreduce and datatype may use the same pWrk and pSync, with
+ * the same or a different root, without other synchronization. The
+ * layout of pWrk depends on the message size and on the algorithm, so a
+ * call with another nreduce or datatype must be separated from the
+ * previous one by a barrier over the team, or use another pWrk. pWrk
+ * and pSync must not be shared between teams.
+ * The first call on a team gathers the mapping from team PE numbers to
+ * global PE numbers and is therefore slower than the following ones.
+ *
+ * The rooted reduction routines support the following options:
+ *
+ * team, source, nreduce
+ *          As for shmemx_team_<datatype>_<op>_to_all.
+ *
+ * root
+ *          Team PE number receiving the result. Must be the same on all
+ *          members.
+ *
+ * dest
+ *          A symmetric array of length nreduce elements to receive the
+ *          result on root.
+ *
+ * pWrk
+ *          A symmetric work array of at least
+ *          TEAM_REDUCE_WRK_SIZE(nreduce, <datatype>) elements.
+ *
+ * pSync
+ *          A symmetric work array of TEAM_REDUCE_SYNC_SIZE longs. Every
+ *          element must be initialized with SHMEM_SYNC_VALUE before the
+ *          first call.
+ *
+ * EXAMPLE DETAILS:
+ * The example program reduces a small and a large vector of doubles to
+ * team PE 0 of SHMEM_TEAM_WORLD and of the teams of odd and even PEs,
+ * once with shmemx_team_double_sum_to_all and once with
+ * team_double_sum_reduce. Every run starts with a barrier, which
+ * separates the small and large reductions sharing pWrk. Team PE 0 of
+ * every team prints the latencies.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+#include "shmemx-team-map.h"
+
+#define TEAM_REDUCE_MAX_STEPS   32
+#define TEAM_REDUCE_TREE_MAX    (16 * 1024)
+
+/* pSync layout */
+#define TEAM_REDUCE_TREE_DATA   0
+#define TEAM_REDUCE_TREE_ACK    (TEAM_REDUCE_MAX_STEPS)
+#define TEAM_REDUCE_TREE_SENT   (2 * TEAM_REDUCE_MAX_STEPS)
+#define TEAM_REDUCE_RING_DATA   (3 * TEAM_REDUCE_MAX_STEPS)
+#define TEAM_REDUCE_RING_ACK    (TEAM_REDUCE_RING_DATA + 2)
+#define TEAM_REDUCE_RING_MSG    (TEAM_REDUCE_RING_DATA + 3)
+#define TEAM_REDUCE_GATHER      (TEAM_REDUCE_RING_DATA + 4)
+#define TEAM_REDUCE_GATHER_SEEN (TEAM_REDUCE_RING_DATA + 5)
+#define TEAM_REDUCE_SEQ         (TEAM_REDUCE_RING_DATA + 6)
+#define TEAM_REDUCE_SYNC_SIZE   (TEAM_REDUCE_RING_DATA + 7)
+
+#define TEAM_REDUCE_WRK_SIZE(nreduce, type)                                  \
+    (((nreduce) * sizeof(type) <= TEAM_REDUCE_TREE_MAX) ?                    \
+     TEAM_REDUCE_MAX_STEPS * (nreduce) : 2 * (nreduce))
+
+typedef void (*team_combine_fn)(void *inout, const void *in, int n);
+
+/*
+ * Binomial tree towards root. Relative to root the tree changes, but the
+ * team PE a PE sends to in step k is always t_pe - 2^k, so every pWrk
+ * slot has a single writer and can be flow controlled by the receiver's
+ * acknowledgement.
+ */
+static void reduce_tree(int *pe_map, int t_pe, int t_size, int root,
+                        void *dest, const void *source, int nreduce,
+                        size_t elem_size, team_combine_fn combine,
+                        char *wrk, long *pSync, long seq) {
+    size_t bytes = nreduce * elem_size;
+    char *acc    = malloc(bytes ? bytes : 1);
+    int   vpe    = (t_pe - root + t_size) % t_size;
+    int   mask, step;
+
+    memcpy(acc, source, bytes);
+
+    for (mask = 1, step = 0; mask < t_size; mask <<= 1, step++) {
+        if (vpe & mask) {
+            int parent = pe_map[(t_pe - mask + t_size) % t_size];
+
+            shmem_long_wait_until(&pSync[TEAM_REDUCE_TREE_ACK + step],
+                                  SHMEM_CMP_EQ,
+                                  pSync[TEAM_REDUCE_TREE_SENT + step]);
+            pSync[TEAM_REDUCE_TREE_SENT + step] = seq;
+            shmem_putmem(wrk + step * bytes, acc, bytes, parent);
+            shmem_fence();
+            shmem_long_p(&pSync[TEAM_REDUCE_TREE_DATA + step], seq, parent);
+            break;
+        }
+        if (vpe + mask < t_size) {
+            int child = pe_map[(t_pe + mask) % t_size];
+
+            shmem_long_wait_until(&pSync[TEAM_REDUCE_TREE_DATA + step],
+                                  SHMEM_CMP_EQ, seq);
+            combine(acc, wrk + step * bytes, nreduce);
+            shmem_long_p(&pSync[TEAM_REDUCE_TREE_ACK + step], seq, child);
+        }
+    }
+
+    if (vpe == 0) {
+        memcpy(dest, acc, bytes);
+    }
+    free(acc);
+}
+
+/*
+ * Ring reduce-scatter of nreduce elements split into n nearly equal
+ * blocks, then every PE puts its block into dest on root and increments
+ * a counter there. Only root ever sees increments of its own counter, so
+ * it keeps the number already consumed in GATHER_SEEN.
+ */
+static void reduce_ring(int *pe_map, int t_pe, int t_size, int root,
+                        void *dest, const void *source, int nreduce,
+                        size_t elem_size, team_combine_fn combine,
+                        char *wrk, long *pSync) {
+    int   right  = pe_map[(t_pe + 1) % t_size];
+    int   left   = pe_map[(t_pe + t_size - 1) % t_size];
+    int   base   = nreduce / t_size;
+    int   extra  = nreduce % t_size;
+    int   max_count = base + (extra ? 1 : 0);
+    size_t slot_bytes = max_count * elem_size;
+    char *acc    = malloc(slot_bytes ? slot_bytes : 1);
+    char *src    = (char *) source;
+    int   s, my_count, my_displ;
+
+#define BLOCK_COUNT(b)  (base + ((b) < extra ? 1 : 0))
+#define BLOCK_DISPL(b)  ((b) * base + ((b) < extra ? (b) : extra))
+
+    for (s = 0; s < t_size - 1; s++) {
+        int  send_blk = (t_pe - s - 1 + t_size) % t_size;
+        int  recv_blk = (t_pe - s - 2 + 2 * t_size) % t_size;
+        long msg      = ++pSync[TEAM_REDUCE_RING_MSG];
+        int  slot     = (int) (msg & 1);
+        char *sendbuf = (s == 0) ? src + BLOCK_DISPL(send_blk) * elem_size
+                                 : acc;
+        char *recvbuf = wrk + slot * slot_bytes;
+
+        shmem_long_wait_until(&pSync[TEAM_REDUCE_RING_ACK], SHMEM_CMP_GE,
+                              (s == 0) ? msg - 1 : msg - 2);
+        shmem_putmem(recvbuf, sendbuf, BLOCK_COUNT(send_blk) * elem_size,
+                     right);
+        shmem_fence();
+        shmem_long_p(&pSync[TEAM_REDUCE_RING_DATA + slot], msg, right);
+
+        shmem_long_wait_until(&pSync[TEAM_REDUCE_RING_DATA + slot],
+                              SHMEM_CMP_EQ, msg);
+        memcpy(acc, recvbuf, BLOCK_COUNT(recv_blk) * elem_size);
+        shmem_long_p(&pSync[TEAM_REDUCE_RING_ACK], msg, left);
+        combine(acc, src + BLOCK_DISPL(recv_blk) * elem_size,
+                BLOCK_COUNT(recv_blk));
+    }
+
+    my_count = BLOCK_COUNT(t_pe);
+    my_displ = BLOCK_DISPL(t_pe);
+    if (t_size == 1) {
+        memcpy(acc, src, my_count * elem_size);
+    }
+
+    if (t_pe == root) {
+        memcpy((char *) dest + my_displ * elem_size, acc,
+               my_count * elem_size);
+        pSync[TEAM_REDUCE_GATHER_SEEN] += t_size - 1;
+        shmem_long_wait_until(&pSync[TEAM_REDUCE_GATHER], SHMEM_CMP_GE,
+                              pSync[TEAM_REDUCE_GATHER_SEEN]);
+    } else {
+        shmem_putmem((char *) dest + my_displ * elem_size, acc,
+                     my_count * elem_size, pe_map[root]);
+        shmem_fence();
+        shmem_long_atomic_inc(&pSync[TEAM_REDUCE_GATHER], pe_map[root]);
+    }
+
+#undef BLOCK_COUNT
+#undef BLOCK_DISPL
+
+    free(acc);
+}
+
+static void team_reduce(shmem_team_t team, int root, void *dest,
+                        const void *source, int nreduce, size_t elem_size,
+                        team_combine_fn combine, void *pWrk, long *pSync) {
+    int *pe_map = team_pe_map(team);
+    int  t_pe   = shmemx_team_my_pe(team);
+    int  t_size = shmemx_team_n_pes(team);
+    long seq    = ++pSync[TEAM_REDUCE_SEQ];
+
+    if (nreduce * elem_size <= TEAM_REDUCE_TREE_MAX) {
+        reduce_tree(pe_map, t_pe, t_size, root, dest, source, nreduce,
+                    elem_size, combine, pWrk, pSync, seq);
+    } else {
+        reduce_ring(pe_map, t_pe, t_size, root, dest, source, nreduce,
+                    elem_size, combine, pWrk, pSync);
+    }
+}
+
+#define DEFINE_REDUCE(TYPE, NAME, OPNAME, EXPR)                              \
+static void NAME##_##OPNAME##_combine(void *inout, const void *in, int n) { \
+    TYPE *a = inout;                                                         \
+    const TYPE *b = in;                                                      \
+    int i;                                                                   \
+    for (i = 0; i < n; i++) {                                                \
+        TYPE x = a[i], y = b[i];                                             \
+        a[i] = (EXPR);                                                       \
+    }                                                                        \
+}                                                                            \
+                                                                             \
+void team_##NAME##_##OPNAME##_reduce(shmem_team_t team, int root,            \
+                                     TYPE *dest, TYPE *source, int nreduce,  \
+                                     TYPE *pWrk, long *pSync) {              \
+    team_reduce(team, root, dest, source, nreduce, sizeof(TYPE),             \
+                NAME##_##OPNAME##_combine, pWrk, pSync);                     \
+}
+
+#define DEFINE_REDUCE_ARITH(TYPE, NAME)                                      \
+    DEFINE_REDUCE(TYPE, NAME, sum,  x + y)                                   \
+    DEFINE_REDUCE(TYPE, NAME, prod, x * y)                                   \
+    DEFINE_REDUCE(TYPE, NAME, max,  (x > y) ? x : y)                         \
+    DEFINE_REDUCE(TYPE, NAME, min,  (x < y) ? x : y)
+
+#define DEFINE_REDUCE_BITWISE(TYPE, NAME)                                    \
+    DEFINE_REDUCE(TYPE, NAME, and,  x & y)                                   \
+    DEFINE_REDUCE(TYPE, NAME, or,   x | y)                                   \
+    DEFINE_REDUCE(TYPE, NAME, xor,  x ^ y)
+
+DEFINE_REDUCE_ARITH(short, short)
+DEFINE_REDUCE_ARITH(int, int)
+DEFINE_REDUCE_ARITH(long, long)
+DEFINE_REDUCE_ARITH(long long, longlong)
+DEFINE_REDUCE_ARITH(float, float)
+DEFINE_REDUCE_ARITH(double, double)
+DEFINE_REDUCE_ARITH(long double, longdouble)
+
+DEFINE_REDUCE_BITWISE(short, short)
+DEFINE_REDUCE_BITWISE(int, int)
+DEFINE_REDUCE_BITWISE(long, long)
+DEFINE_REDUCE_BITWISE(long long, longlong)
+
+#define NITER       50
+#define N_SMALL     3
+#define N_LARGE     (1 << 18)
+
+#define MAX(a, b) ((a > b) ? a : b)
+
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+long reduce_pSync[2][TEAM_REDUCE_SYNC_SIZE];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+static void run(shmem_team_t team, const char *name, double *dest,
+                double *source, double *pWrk[2], long *team_pSync,
+                int nreduce) {
+    int iter;
+    double t_to_all, t_reduce, result;
+
+    shmem_barrier_all();
+    t_to_all = wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        shmemx_team_double_sum_to_all(team, dest, source, nreduce,
+                                      pWrk[iter % 2], pSync[iter % 2]);
+    }
+    t_to_all = (wtime() - t_to_all) / NITER;
+    result = dest[nreduce - 1];
+
+    shmem_barrier_all();
+    t_reduce = wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        team_double_sum_reduce(team, 0, dest, source, nreduce, pWrk[0],
+                               team_pSync);
+    }
+    t_reduce = (wtime() - t_reduce) / NITER;
+
+    if (shmemx_team_my_pe(team) == 0) {
+        if (dest[nreduce - 1] != result) {
+            printf("[PE:%d] %s: result %g, expected %g\n", shmem_my_pe(),
+                   name, dest[nreduce - 1], result);
+        }
+        printf("%-16s size %5d nreduce %7d: sum_to_all %10.2f us, "
+               "reduce %10.2f us\n", name, shmemx_team_n_pes(team), nreduce,
+               t_to_all * 1.0e6, t_reduce * 1.0e6);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int i;
+    int me;
+    int pwrk_size;
+    double *source, *dest, *pWrk[2];
+    shmem_team_t new_team;
+
+    shmem_init();
+    me = shmem_my_pe();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    for (i = 0; i < TEAM_REDUCE_SYNC_SIZE; i++) {
+        reduce_pSync[0][i] = SHMEM_SYNC_VALUE;
+        reduce_pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    team_map_init();
+
+    pwrk_size = MAX(N_LARGE/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE);
+    pwrk_size = MAX(pwrk_size, TEAM_REDUCE_WRK_SIZE(N_LARGE, double));
+    pwrk_size = MAX(pwrk_size, TEAM_REDUCE_WRK_SIZE(N_SMALL, double));
+    source  = shmem_malloc(N_LARGE * sizeof(double));
+    dest    = shmem_malloc(N_LARGE * sizeof(double));
+    pWrk[0] = shmem_malloc(pwrk_size * sizeof(double));
+    pWrk[1] = shmem_malloc(pwrk_size * sizeof(double));
+
+    for (i = 0; i < N_LARGE; i++) {
+        source[i] = me + i;
+    }
+
+    run(SHMEM_TEAM_WORLD, "SHMEM_TEAM_WORLD", dest, source, pWrk,
+        reduce_pSync[0], N_SMALL);
+    run(SHMEM_TEAM_WORLD, "SHMEM_TEAM_WORLD", dest, source, pWrk,
+        reduce_pSync[0], N_LARGE);
+
+    /* the odd and even teams need their own reduce pSync */
+    shmemx_team_split_color(SHMEM_TEAM_WORLD, me % 2, me, &new_team);
+    run(new_team, (me % 2) ? "odd team" : "even team", dest, source, pWrk,
+        reduce_pSync[1], N_SMALL);
+    run(new_team, (me % 2) ? "odd team" : "even team", dest, source, pWrk,
+        reduce_pSync[1], N_LARGE);
+
+    team_map_destroy(&new_team);
+    shmem_barrier_all();
+    shmem_free(pWrk[1]);
+    shmem_free(pWrk[0]);
+    shmem_free(dest);
+    shmem_free(source);
+    shmem_finalize();
+    return 0;
+}
@@ -0,0 +1,360 @@
+/*
+ * Example program to show bitwise reproducible team sum reductions
+ *
+ * SYNOPSIS:
+ * void team_<datatype>_sum_to_all_repro( shmem_team_t  team,
+ *                                        <datatype>   *dest,
+ *                                        <datatype>   *source,
+ *                                        int           nreduce,
+ *                                        <datatype>   *pWrk,
+ *                                        long         *pSync )
+ *
+ * where <datatype> is float or double.
+ *
+ * DESCRIPTION:
+ * Floating point addition is not associative, so the result of
+ * shmemx_team_<datatype>_sum_to_all depends on the order in which the
+ * contributions are combined, which depends on the team size, the team
+ * layout and the algorithm. The reproducible sum routines give a result
+ * which only depends on the set of values summed for each element.
+ *
+ * Each element is summed in fixed point. A first reduction finds the
+ * largest magnitude of every element over the team. Every PE then splits
+ * its value into TEAM_REPRO_LIMBS integer limbs of TEAM_REPRO_BITS bits,
+ * aligned on the exponent of that maximum, and the limbs are summed with
+ * shmemx_team_long_sum_to_all. Integer addition is associative, so the
+ * summed limbs are exact and the same on all PEs whatever the order.
+ * They are converted back to floating point in a fixed order. Both
+ * reductions run the logarithmic depth algorithms of the underlying
+ * routines.
+ *
+ * Bits of a value more than TEAM_REPRO_LIMBS * TEAM_REPRO_BITS bits
+ * below the largest magnitude are dropped; this truncation is the same
+ * on every run. Infinities and NaNs are counted separately and give the
+ * result IEEE addition would, in any order.
+ *
+ * The reproducible sum routines support the following options:
+ *
+ * team, dest, source, nreduce
+ *          As for shmemx_team_<datatype>_sum_to_all.
+ *
+ * pWrk
+ *          A symmetric work array of at least
+ *          TEAM_REPRO_WRK_SIZE(nreduce, <datatype>) elements, aligned on
+ *          a long.
+ *
+ * pSync
+ *          A symmetric work array of TEAM_REPRO_SYNC_SIZE longs. Every
+ *          element must be initialized with SHMEM_SYNC_VALUE before the
+ *          first call.
+ *
+ * pWrk holds the symmetric source and destination buffers of both
+ * reductions, so pWrk and pSync follow the rules of
+ * shmemx_team_<datatype>_sum_to_all: consecutive calls alternate between
+ * two pWrk and two pSync arrays, or are separated by a barrier over the
+ * team. The local conversion buffer is allocated on the first call and
+ * only grows when a later call needs more room.
+ *
+ * EXAMPLE DETAILS:
+ * The example program sums N doubles of widely different magnitudes over
+ * SHMEM_TEAM_WORLD and over a team of the same PEs in reverse order,
+ * with shmemx_team_double_sum_to_all, with team_double_sum_to_all_repro
+ * and with a gather of all contributions followed by a serial sum on
+ * every PE. Consecutive calls alternate between two halves of pWrk and
+ * two pSync arrays. PE 0 prints the latency of the three methods and the
+ * number of elements whose result differs between the two teams.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+
+#define TEAM_REPRO_LIMBS        4
+#define TEAM_REPRO_BITS         32
+#define TEAM_REPRO_WORDS        (TEAM_REPRO_LIMBS + 1)
+#define TEAM_REPRO_SYNC_SIZE    (2 * SHMEM_REDUCE_SYNC_SIZE)
+
+/* counts of special values, kept in the last word of every element */
+#define TEAM_REPRO_PINF         1L
+#define TEAM_REPRO_NINF         (1L << 20)
+#define TEAM_REPRO_NAN          (1L << 40)
+#define TEAM_REPRO_COUNT_MASK   ((1L << 20) - 1)
+
+#define TEAM_REPRO_RED_WRK(n)                                                \
+    (((n)/2+1 > SHMEM_REDUCE_MIN_WRKDATA_SIZE) ? (n)/2+1                     \
+                                               : SHMEM_REDUCE_MIN_WRKDATA_SIZE)
+#define TEAM_REPRO_WRK_WORDS(n)                                              \
+    (2 * (n) + TEAM_REPRO_RED_WRK(n) +                                       \
+     2 * TEAM_REPRO_WORDS * (n) + TEAM_REPRO_RED_WRK(TEAM_REPRO_WORDS * (n)))
+#define TEAM_REPRO_WRK_SIZE(nreduce, type)                                   \
+    ((TEAM_REPRO_WRK_WORDS(nreduce) * sizeof(long) + sizeof(type) - 1) /     \
+     sizeof(type))
+
+/*
+ * x and res are local arrays of nreduce doubles. wrk holds the symmetric
+ * buffers of both reductions, which use the two halves of pSync.
+ */
+static void team_repro_sum(shmem_team_t team, const double *x, double *res,
+                           int nreduce, void *wrk, long *pSync) {
+    double *amax_src = wrk;
+    double *amax_dst = amax_src + nreduce;
+    double *amax_wrk = amax_dst + nreduce;
+    long   *limb_src = (long *) (amax_wrk + TEAM_REPRO_RED_WRK(nreduce));
+    long   *limb_dst = limb_src + TEAM_REPRO_WORDS * nreduce;
+    long   *limb_wrk = limb_dst + TEAM_REPRO_WORDS * nreduce;
+    long    mask     = (1L << TEAM_REPRO_BITS) - 1;
+    int     i, j;
+
+    for (i = 0; i < nreduce; i++) {
+        amax_src[i] = isfinite(x[i]) ? fabs(x[i]) : 0.0;
+    }
+    shmemx_team_double_max_to_all(team, amax_dst, amax_src, nreduce,
+                                  amax_wrk, pSync);
+
+    for (i = 0; i < nreduce; i++) {
+        long  *limb = &limb_src[i * TEAM_REPRO_WORDS];
+        double d;
+
+        memset(limb, 0, TEAM_REPRO_WORDS * sizeof(long));
+        if (!isfinite(x[i])) {
+            limb[TEAM_REPRO_LIMBS] = isnan(x[i]) ? TEAM_REPRO_NAN :
+                                     (x[i] > 0) ? TEAM_REPRO_PINF :
+                                                  TEAM_REPRO_NINF;
+            continue;
+        }
+        if (amax_dst[i] == 0.0) {
+            continue;
+        }
+
+        /* |d| < 2^TEAM_REPRO_BITS, every step below is exact */
+        d = ldexp(x[i], TEAM_REPRO_BITS - (ilogb(amax_dst[i]) + 1));
+        for (j = 0; j < TEAM_REPRO_LIMBS; j++) {
+            limb[j] = (long) d;
+            d = ldexp(d - (double) limb[j], TEAM_REPRO_BITS);
+        }
+    }
+
+    shmemx_team_long_sum_to_all(team, limb_dst, limb_src,
+                                TEAM_REPRO_WORDS * nreduce, limb_wrk,
+                                pSync + SHMEM_REDUCE_SYNC_SIZE);
+
+    for (i = 0; i < nreduce; i++) {
+        long  *limb    = &limb_dst[i * TEAM_REPRO_WORDS];
+        long   special = limb[TEAM_REPRO_LIMBS];
+        int    top;
+        double sum;
+
+        if (special != 0) {
+            long pinf = special & TEAM_REPRO_COUNT_MASK;
+            long ninf = (special / TEAM_REPRO_NINF) & TEAM_REPRO_COUNT_MASK;
+
+            if (special >= TEAM_REPRO_NAN || (pinf && ninf)) {
+                res[i] = NAN;
+            } else {
+                res[i] = pinf ? HUGE_VAL : -HUGE_VAL;
+            }
+            continue;
+        }
+        if (amax_dst[i] == 0.0) {
+            res[i] = 0.0;
+            continue;
+        }
+
+        /* carry into the most significant limb, then convert from the
+         * least significant one up */
+        for (j = TEAM_REPRO_LIMBS - 1; j > 0; j--) {
+            long carry = (limb[j] - (limb[j] & mask)) / (mask + 1);
+
+            limb[j]     -= carry * (mask + 1);
+            limb[j - 1] += carry;
+        }
+        top = ilogb(amax_dst[i]) + 1;
+        sum = 0.0;
+        for (j = TEAM_REPRO_LIMBS - 1; j >= 0; j--) {
+            sum += ldexp((double) limb[j], top - TEAM_REPRO_BITS * (j + 1));
+        }
+        res[i] = sum;
+    }
+}
+
+static double *repro_scratch;
+static int     repro_scratch_size;
+
+/* local buffer of 2 * nreduce doubles, kept between calls */
+static double *team_repro_scratch(int nreduce) {
+    if (nreduce > repro_scratch_size) {
+        free(repro_scratch);
+        repro_scratch = malloc(2 * (size_t) nreduce * sizeof(double));
+        if (repro_scratch == NULL) {
+            fprintf(stderr, "team_repro_scratch: cannot allocate %d "
+                    "doubles\n", 2 * nreduce);
+            shmem_global_exit(1);
+        }
+        repro_scratch_size = nreduce;
+    }
+    return repro_scratch;
+}
+
+#define DEFINE_REPRO(TYPE, NAME)                                             \
+void team_##NAME##_sum_to_all_repro(shmem_team_t team, TYPE *dest,           \
+                                    TYPE *source, int nreduce, TYPE *pWrk,   \
+                                    long *pSync) {                           \
+    double *x   = team_repro_scratch(nreduce);                               \
+    double *res = x + nreduce;                                               \
+    int i;                                                                   \
+                                                                             \
+    for (i = 0; i < nreduce; i++) {                                          \
+        x[i] = source[i];                                                    \
+    }                                                                        \
+    team_repro_sum(team, x, res, nreduce, pWrk, pSync);                      \
+    for (i = 0; i < nreduce; i++) {                                          \
+        dest[i] = (TYPE) res[i];                                             \
+    }                                                                        \
+}
+
+DEFINE_REPRO(float, float)
+DEFINE_REPRO(double, double)
+
+#define NITER   20
+#define N       256
+
+#define MAX(a, b) ((a > b) ? a : b)
+
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+long repro_pSync[2][2][TEAM_REPRO_SYNC_SIZE];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/* the workaround: gather all contributions and sum them in rank order */
+static void gather_sum(shmem_team_t team, double *dest, double *source,
+                       double *gather, double *gather_dst, double *pWrk,
+                       long *gather_pSync) {
+    int t_pe = shmemx_team_my_pe(team);
+    int t_size = shmemx_team_n_pes(team);
+    int i, pe;
+
+    memset(gather, 0, (size_t) t_size * N * sizeof(double));
+    memcpy(gather + (size_t) t_pe * N, source, N * sizeof(double));
+    shmemx_team_double_sum_to_all(team, gather_dst, gather, t_size * N,
+                                  pWrk, gather_pSync);
+    for (i = 0; i < N; i++) {
+        dest[i] = 0.0;
+        for (pe = 0; pe < t_size; pe++) {
+            dest[i] += gather_dst[(size_t) pe * N + i];
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int i, iter, t;
+    int me, npes;
+    int pwrk_size, repro_wrk;
+    int diff[3];
+    double times[3];
+    double *source, *dest, *pWrk, *gather, *gather_dst;
+    double result[2][3][N];
+    shmem_team_t teams[2];
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    for (i = 0; i < TEAM_REPRO_SYNC_SIZE; i++) {
+        repro_pSync[0][0][i] = SHMEM_SYNC_VALUE;
+        repro_pSync[0][1][i] = SHMEM_SYNC_VALUE;
+        repro_pSync[1][0][i] = SHMEM_SYNC_VALUE;
+        repro_pSync[1][1][i] = SHMEM_SYNC_VALUE;
+    }
+
+    repro_wrk = (int) TEAM_REPRO_WRK_SIZE(N, double);
+    pwrk_size = MAX(npes * N / 2 + 1, SHMEM_REDUCE_MIN_WRKDATA_SIZE);
+    pwrk_size = MAX(pwrk_size, repro_wrk);
+    source     = shmem_malloc(N * sizeof(double));
+    dest       = shmem_malloc(N * sizeof(double));
+    /* two halves, alternated between consecutive reductions */
+    pWrk       = shmem_malloc(2 * pwrk_size * sizeof(double));
+    gather     = shmem_malloc((size_t) npes * N * sizeof(double));
+    gather_dst = shmem_malloc((size_t) npes * N * sizeof(double));
+
+    for (i = 0; i < N; i++) {
+        source[i] = sin(me + 0.1 * i) * pow(10.0, (me * 7 + i) % 17 - 8);
+    }
+
+    /* the same PEs in rank order and in reverse rank order */
+    teams[0] = SHMEM_TEAM_WORLD;
+    shmemx_team_split_color(SHMEM_TEAM_WORLD, 0, npes - 1 - me, &teams[1]);
+
+    for (t = 0; t < 2; t++) {
+        shmem_barrier_all();
+        times[0] = wtime();
+        for (iter = 0; iter < NITER; iter++) {
+            shmemx_team_double_sum_to_all(teams[t], dest, source, N,
+                                          pWrk + (iter % 2) * pwrk_size,
+                                          pSync[iter % 2]);
+        }
+        times[0] = (wtime() - times[0]) / NITER;
+        memcpy(result[t][0], dest, N * sizeof(double));
+
+        shmem_barrier_all();
+        times[1] = wtime();
+        for (iter = 0; iter < NITER; iter++) {
+            team_double_sum_to_all_repro(teams[t], dest, source, N,
+                                         pWrk + (iter % 2) * pwrk_size,
+                                         repro_pSync[t][iter % 2]);
+        }
+        times[1] = (wtime() - times[1]) / NITER;
+        memcpy(result[t][1], dest, N * sizeof(double));
+
+        shmem_barrier_all();
+        times[2] = wtime();
+        for (iter = 0; iter < NITER; iter++) {
+            gather_sum(teams[t], dest, source, gather, gather_dst,
+                       pWrk + (iter % 2) * pwrk_size, pSync[iter % 2]);
+        }
+        times[2] = (wtime() - times[2]) / NITER;
+        memcpy(result[t][2], dest, N * sizeof(double));
+
+        if (me == 0) {
+            printf("%-14s npes %4d nreduce %d: sum_to_all %10.2f us, "
+                   "repro %10.2f us, gather %10.2f us\n",
+                   t ? "reverse order" : "rank order", npes, N,
+                   times[0] * 1.0e6, times[1] * 1.0e6, times[2] * 1.0e6);
+        }
+    }
+
+    for (t = 0; t < 3; t++) {
+        diff[t] = 0;
+        for (i = 0; i < N; i++) {
+            if (memcmp(&result[0][t][i], &result[1][t][i],
+                       sizeof(double)) != 0) {
+                diff[t]++;
+            }
+        }
+    }
+    if (me == 0) {
+        printf("elements differing between the two orders: sum_to_all %d, "
+               "repro %d, gather %d\n", diff[0], diff[1], diff[2]);
+    }
+
+    shmemx_team_destroy(&teams[1]);
+    shmem_barrier_all();
+    shmem_free(gather_dst);
+    shmem_free(gather);
+    shmem_free(pWrk);
+    shmem_free(dest);
+    shmem_free(source);
+    shmem_finalize();
+    return 0;
+}
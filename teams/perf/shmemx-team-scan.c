@@ -0,0 +1,331 @@
+/*
+ * Example program to show team prefix scan routines
+ *
+ * SYNOPSIS:
+ * void team_<datatype>_<op>_scan(   shmem_team_t  team,
+ *                                   <datatype>   *dest,
+ *                                   <datatype>   *source,
+ *                                   int           nreduce,
+ *                                   <datatype>   *pWrk,
+ *                                   long         *pSync )
+ *
+ * void team_<datatype>_<op>_exscan( ... same arguments ... )
+ *
+ * where <op> is one from sum, prod, max and min for <datatype> short,
+ * int, long, float, double, longdouble and longlong, and additionally
+ * and, or and xor for short, int, long and longlong.
+ *
+ * DESCRIPTION:
+ * The team scan routines are collective routines which compute one or
+ * more prefix reductions across symmetric arrays on the members of a
+ * team. The inclusive scan leaves in dest on team PE i the reduction of
+ * source over team PEs 0 to i. The exclusive scan leaves the reduction
+ * over team PEs 0 to i-1; team PE 0 receives the identity of the
+ * operation, for example 0 for sum and 1 for prod.
+ *
+ * The scan runs in ceil(log2(n)) steps for a team of n PEs. In step k
+ * every PE sends its partial result to the PE 2^k positions further in
+ * the team and combines the partial result received from the PE 2^k
+ * positions before it. Each PE sends and receives at most nreduce
+ * elements per step, unlike a gather of all contributions followed by a
+ * local scan, which moves n * nreduce elements to every PE.
+ *
+ * Receivers acknowledge every step, so the same pWrk and pSync arrays may
+ * be passed to consecutive scans on the same team without any other
+ * synchronization. They must not be shared between teams. The first call
+ * on a team gathers the mapping from team PE numbers to global PE numbers
+ * and is therefore slower than the following ones.
+ *
+ * The team scan routines support the following options:
+ *
+ * team, dest, source, nreduce
+ *          As for shmemx_team_<datatype>_<op>_to_all.
+ *
+ * pWrk
+ *          A symmetric work array of at least TEAM_SCAN_WRK_SIZE(nreduce)
+ *          elements of <datatype>.
+ *
+ * pSync
+ *          A symmetric work array of TEAM_SCAN_SYNC_SIZE longs. Every
+ *          element must be initialized with SHMEM_SYNC_VALUE before the
+ *          first call.
+ *
+ * EXAMPLE DETAILS:
+ * Every PE holds a number of items to write and needs the offset of its
+ * items in the output, which is the exclusive sum scan of the counts. The
+ * offsets are computed with team_long_sum_exscan, and with a gather of
+ * all counts followed by a local scan. The gather is a shmem_fcollect64
+ * on SHMEM_TEAM_WORLD, and a shmemx_team_long_sum_to_all of a vector
+ * with one slot per PE on the teams of odd and even PEs, which have no
+ * fcollect. PE 0 prints the latencies.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <float.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+#include "shmemx-team-map.h"
+
+#define TEAM_SCAN_MAX_STEPS     32
+#define TEAM_SCAN_ACK           TEAM_SCAN_MAX_STEPS
+#define TEAM_SCAN_SEQ           (2 * TEAM_SCAN_MAX_STEPS)
+#define TEAM_SCAN_SYNC_SIZE     (2 * TEAM_SCAN_MAX_STEPS + 1)
+#define TEAM_SCAN_WRK_SIZE(n)   (TEAM_SCAN_MAX_STEPS * (n))
+
+typedef void (*team_combine_fn)(void *inout, const void *in, int n);
+
+/*
+ * Recursive doubling scan. partial holds the reduction over the team PEs
+ * covered so far including this one, excl the same without this one.
+ * Received values always come from lower team PEs and are the left
+ * operand of the combine function.
+ */
+static void team_scan(shmem_team_t team, void *dest, const void *source,
+                      int nreduce, size_t elem_size, team_combine_fn combine,
+                      const void *identity, int exclusive, void *pWrk,
+                      long *pSync) {
+    int *pe_map  = team_pe_map(team);
+    int  t_pe    = shmemx_team_my_pe(team);
+    int  t_size  = shmemx_team_n_pes(team);
+    size_t bytes = nreduce * elem_size;
+    char *partial = malloc(bytes ? bytes : 1);
+    char *excl    = malloc(bytes ? bytes : 1);
+    char *tmp     = malloc(bytes ? bytes : 1);
+    char *wrk     = pWrk;
+    long  seq     = ++pSync[TEAM_SCAN_SEQ];
+    int   have_excl = 0;
+    int   dist, step, i;
+
+    memcpy(partial, source, bytes);
+
+    for (dist = 1, step = 0; dist < t_size; dist <<= 1, step++) {
+        if (t_pe + dist < t_size) {
+            int peer = pe_map[t_pe + dist];
+
+            /* the receiver must have consumed the previous scan's data */
+            shmem_long_wait_until(&pSync[TEAM_SCAN_ACK + step],
+                                  SHMEM_CMP_GE, seq - 1);
+            shmem_putmem(wrk + step * bytes, partial, bytes, peer);
+            shmem_fence();
+            shmem_long_p(&pSync[step], seq, peer);
+        }
+
+        if (t_pe - dist >= 0) {
+            char *recv = wrk + step * bytes;
+
+            shmem_long_wait_until(&pSync[step], SHMEM_CMP_EQ, seq);
+            if (exclusive) {
+                memcpy(tmp, recv, bytes);
+                if (have_excl) {
+                    combine(tmp, excl, nreduce);
+                }
+                memcpy(excl, tmp, bytes);
+                have_excl = 1;
+            }
+            memcpy(tmp, recv, bytes);
+            combine(tmp, partial, nreduce);
+            memcpy(partial, tmp, bytes);
+            shmem_long_p(&pSync[TEAM_SCAN_ACK + step], seq,
+                         pe_map[t_pe - dist]);
+        }
+    }
+
+    if (!exclusive) {
+        memcpy(dest, partial, bytes);
+    } else if (have_excl) {
+        memcpy(dest, excl, bytes);
+    } else {
+        for (i = 0; i < nreduce; i++) {
+            memcpy((char *) dest + i * elem_size, identity, elem_size);
+        }
+    }
+
+    free(partial);
+    free(excl);
+    free(tmp);
+}
+
+#define DEFINE_SCAN(TYPE, NAME, OPNAME, EXPR, IDENTITY)                      \
+static void NAME##_##OPNAME##_combine(void *inout, const void *in, int n) { \
+    TYPE *a = inout;                                                         \
+    const TYPE *b = in;                                                      \
+    int i;                                                                   \
+    for (i = 0; i < n; i++) {                                                \
+        TYPE x = a[i], y = b[i];                                             \
+        a[i] = (EXPR);                                                       \
+    }                                                                        \
+}                                                                            \
+                                                                             \
+static const TYPE NAME##_##OPNAME##_identity = (IDENTITY);                   \
+                                                                             \
+void team_##NAME##_##OPNAME##_scan(shmem_team_t team, TYPE *dest,            \
+                                   TYPE *source, int nreduce, TYPE *pWrk,    \
+                                   long *pSync) {                            \
+    team_scan(team, dest, source, nreduce, sizeof(TYPE),                     \
+              NAME##_##OPNAME##_combine, &NAME##_##OPNAME##_identity, 0,     \
+              pWrk, pSync);                                                  \
+}                                                                            \
+                                                                             \
+void team_##NAME##_##OPNAME##_exscan(shmem_team_t team, TYPE *dest,          \
+                                     TYPE *source, int nreduce, TYPE *pWrk,  \
+                                     long *pSync) {                          \
+    team_scan(team, dest, source, nreduce, sizeof(TYPE),                     \
+              NAME##_##OPNAME##_combine, &NAME##_##OPNAME##_identity, 1,     \
+              pWrk, pSync);                                                  \
+}
+
+#define DEFINE_SCAN_ARITH(TYPE, NAME, TYPE_MIN, TYPE_MAX)                    \
+    DEFINE_SCAN(TYPE, NAME, sum,  x + y, 0)                                  \
+    DEFINE_SCAN(TYPE, NAME, prod, x * y, 1)                                  \
+    DEFINE_SCAN(TYPE, NAME, max,  (x > y) ? x : y, TYPE_MIN)                 \
+    DEFINE_SCAN(TYPE, NAME, min,  (x < y) ? x : y, TYPE_MAX)
+
+#define DEFINE_SCAN_BITWISE(TYPE, NAME)                                      \
+    DEFINE_SCAN(TYPE, NAME, and,  x & y, ~(TYPE) 0)                          \
+    DEFINE_SCAN(TYPE, NAME, or,   x | y, 0)                                  \
+    DEFINE_SCAN(TYPE, NAME, xor,  x ^ y, 0)
+
+DEFINE_SCAN_ARITH(short, short, SHRT_MIN, SHRT_MAX)
+DEFINE_SCAN_ARITH(int, int, INT_MIN, INT_MAX)
+DEFINE_SCAN_ARITH(long, long, LONG_MIN, LONG_MAX)
+DEFINE_SCAN_ARITH(long long, longlong, LLONG_MIN, LLONG_MAX)
+DEFINE_SCAN_ARITH(float, float, -HUGE_VALF, HUGE_VALF)
+DEFINE_SCAN_ARITH(double, double, -HUGE_VAL, HUGE_VAL)
+DEFINE_SCAN_ARITH(long double, longdouble, -HUGE_VALL, HUGE_VALL)
+
+DEFINE_SCAN_BITWISE(short, short)
+DEFINE_SCAN_BITWISE(int, int)
+DEFINE_SCAN_BITWISE(long, long)
+DEFINE_SCAN_BITWISE(long long, longlong)
+
+#define NITER       1000
+#define N           1
+#define MAX_PES     8192
+
+#define MAX(a, b) ((a > b) ? a : b)
+#define PWRK_MAX_SIZE MAX(MAX_PES/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE)
+
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+long collect_pSync[2][SHMEM_COLLECT_SYNC_SIZE];
+long pWrk[2][PWRK_MAX_SIZE];
+long gather_src[MAX_PES];
+long gather_dst[MAX_PES];
+
+long scan_pSync[2][TEAM_SCAN_SYNC_SIZE];
+long scan_pWrk[TEAM_SCAN_WRK_SIZE(N)];
+long count[N], offset[N];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/* gather all counts to every PE, then scan locally */
+static void emulated_exscan(shmem_team_t team, int world, int iter) {
+    int i;
+    int t_pe   = shmemx_team_my_pe(team);
+    int t_size = shmemx_team_n_pes(team);
+
+    if (world) {
+        shmem_fcollect64(gather_dst, count, 1, 0, 0, t_size,
+                         collect_pSync[iter % 2]);
+    } else {
+        for (i = 0; i < t_size; i++) {
+            gather_src[i] = 0;
+        }
+        gather_src[t_pe] = count[0];
+        shmemx_team_long_sum_to_all(team, gather_dst, gather_src, t_size,
+                                    pWrk[iter % 2], pSync[iter % 2]);
+    }
+
+    offset[0] = 0;
+    for (i = 0; i < t_pe; i++) {
+        offset[0] += gather_dst[i];
+    }
+}
+
+static void run(shmem_team_t team, long *team_pSync, int world,
+                const char *name) {
+    int iter;
+    long emulated;
+    double t_emulated, t_scan;
+
+    shmem_barrier_all();
+    t_emulated = wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        emulated_exscan(team, world, iter);
+    }
+    t_emulated = (wtime() - t_emulated) / NITER;
+    emulated = offset[0];
+
+    team_long_sum_exscan(team, offset, count, N, scan_pWrk, team_pSync);
+    shmem_barrier_all();
+    t_scan = wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        team_long_sum_exscan(team, offset, count, N, scan_pWrk, team_pSync);
+    }
+    t_scan = (wtime() - t_scan) / NITER;
+
+    if (offset[0] != emulated) {
+        printf("[PE:%d] %s: offset %ld, expected %ld\n", shmem_my_pe(), name,
+               offset[0], emulated);
+    }
+
+    if (shmemx_team_my_pe(team) == 0) {
+        printf("%-16s size %5d: gather + local scan %10.2f us, "
+               "exscan %10.2f us\n", name, shmemx_team_n_pes(team),
+               t_emulated * 1.0e6, t_scan * 1.0e6);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int i;
+    int me, npes;
+    shmem_team_t new_team;
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    if (npes > MAX_PES) {
+        if (me == 0) {
+            printf("at most %d PEs supported\n", MAX_PES);
+        }
+        shmem_finalize();
+        return 0;
+    }
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    for (i = 0; i < SHMEM_COLLECT_SYNC_SIZE; i++) {
+        collect_pSync[0][i] = SHMEM_SYNC_VALUE;
+        collect_pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    for (i = 0; i < TEAM_SCAN_SYNC_SIZE; i++) {
+        scan_pSync[0][i] = SHMEM_SYNC_VALUE;
+        scan_pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    team_map_init();
+
+    count[0] = 1 + me % 3;
+
+    run(SHMEM_TEAM_WORLD, scan_pSync[0], 1, "SHMEM_TEAM_WORLD");
+
+    shmemx_team_split_color(SHMEM_TEAM_WORLD, me % 2, me, &new_team);
+    run(new_team, scan_pSync[1], 0, (me % 2) ? "odd team" : "even team");
+
+    printf("[PE:%d] count %ld offset %ld\n", me, count[0], offset[0]);
+
+    team_map_destroy(&new_team);
+    shmem_barrier_all();
+    shmem_finalize();
+    return 0;
+}
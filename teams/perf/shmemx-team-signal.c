@@ -0,0 +1,360 @@
+/*
+ * Example program to show a team reduction transport moving data and
+ * completion signal in one message
+ *
+ * SYNOPSIS:
+ * void team_to_all_transport( int transport )
+ *
+ * void team_<datatype>_<op>_to_all( shmem_team_t  team,
+ *                                   <datatype>   *dest,
+ *                                   <datatype>   *source,
+ *                                   int           nreduce,
+ *                                   <datatype>   *pWrk,
+ *                                   long         *pSync )
+ *
+ * long team_to_all_messages( void )
+ *
+ * where <op> is one from sum, prod, max and min for <datatype> short,
+ * int, long, float, double, longdouble and longlong, and additionally
+ * and, or and xor for short, int, long and longlong.
+ *
+ * DESCRIPTION:
+ * A reduction step of the pSync protocol puts the data to the partner,
+ * orders it with shmem_fence and then puts a flag the partner waits on.
+ * Each step costs two messages and a fence, and for short reductions the
+ * flag message is as expensive as the data message. With put-with-signal
+ * the signal word is updated by the same operation, after the data has
+ * been delivered, and the partner waits on the signal word directly.
+ *
+ * team_<datatype>_<op>_to_all is a recursive doubling reduction with the
+ * semantics of shmemx_team_<datatype>_<op>_to_all. Teams that are not a
+ * power of two fold the extra PEs into their neighbours first. Every
+ * step has its own slot in pWrk and its own signal word in pSync, and a
+ * call uses one of two sets of them in turn, so consecutive calls with
+ * the same nreduce and datatype may use the same pWrk and pSync without
+ * other synchronization. The second set of slots starts right after the
+ * first, at an offset which depends on the message size, so a call with
+ * another nreduce or datatype must be separated from the previous one by
+ * a barrier over the team, or use another pWrk. pWrk and pSync must not
+ * be shared between teams.
+ *
+ * team_to_all_transport selects the transport of the following calls on
+ * this PE and must be called with the same value by all members of a
+ * team:
+ *
+ * TEAM_TRANSPORT_PSYNC
+ *          Data put, shmem_fence and flag put.
+ *
+ * TEAM_TRANSPORT_SIGNAL
+ *          One put with signal, the default. It uses shmem_putmem_signal
+ *          when the library provides OpenSHMEM 1.5, and
+ *          shmemx_putmem_signal when compiled with -DTEAM_SHMEMX_SIGNAL.
+ *          With neither, the signal is emulated with the pSync protocol
+ *          and TEAM_SIGNAL_EMULATED is defined.
+ *
+ * team_to_all_messages returns the number of messages this PE has
+ * issued in team reductions, each put and each flag counting as one.
+ *
+ * dest, source and pSync follow the rules of the team reductions. The
+ * first call on a team gathers the mapping from team PE numbers to
+ * global PE numbers and is therefore slower than the following ones.
+ *
+ * The reduction routines support the following options:
+ *
+ * team, dest, source, nreduce
+ *          As for shmemx_team_<datatype>_<op>_to_all.
+ *
+ * pWrk
+ *          A symmetric work array of TEAM_SIG_WRK_SIZE(nreduce, n)
+ *          elements for a team of n PEs.
+ *
+ * pSync
+ *          A symmetric work array of TEAM_SIG_SYNC_SIZE longs. Every
+ *          element must be initialized with SHMEM_SYNC_VALUE before the
+ *          first call.
+ *
+ * EXAMPLE DETAILS:
+ * The example program runs double sum reductions of 1, 4, 16, up to
+ * 16384 elements over SHMEM_TEAM_WORLD with shmemx_team_double_sum_to_all
+ * and with team_double_sum_to_all on both transports, and checks the
+ * results.
+ * A barrier separates the reductions of different sizes.
+ * PE 0 prints the latency of each, the latency per step and the
+ * messages per step of both transports.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+#include "shmemx-team-map.h"
+
+#if !defined(SHMEM_SIGNAL_SET) && !defined(TEAM_SHMEMX_SIGNAL)
+#define TEAM_SIGNAL_EMULATED
+#endif
+
+#define TEAM_TRANSPORT_PSYNC    0
+#define TEAM_TRANSPORT_SIGNAL   1
+
+#define TEAM_SIG_MAX_STEPS      24
+#define TEAM_SIG_SEQ            0
+#define TEAM_SIG_FLAGS          1
+#define TEAM_SIG_SYNC_SIZE      (TEAM_SIG_FLAGS + 2 * (TEAM_SIG_MAX_STEPS + 1))
+
+/* two sets of one slot per step, the last one for the folded PEs */
+#define TEAM_SIG_WRK_SIZE(nreduce, npes) \
+    (2 * (team_to_all_steps(npes) + 1) * (nreduce))
+
+static int  team_transport = TEAM_TRANSPORT_SIGNAL;
+static long team_messages;
+
+void team_to_all_transport(int transport) {
+    team_transport = transport;
+}
+
+long team_to_all_messages(void) {
+    return team_messages;
+}
+
+/* number of recursive doubling steps, floor(log2(npes)) */
+static int team_to_all_steps(int npes) {
+    int p2, nsteps;
+
+    for (p2 = 1, nsteps = 0; 2 * p2 <= npes; p2 *= 2) {
+        nsteps++;
+    }
+    return nsteps;
+}
+
+/* puts bytes to pe and sets *flag there to seq once they have arrived */
+static void team_send(void *dest, const void *src, size_t bytes, long *flag,
+                      long seq, int pe) {
+    if (team_transport == TEAM_TRANSPORT_SIGNAL) {
+#if defined(SHMEM_SIGNAL_SET)
+        shmem_putmem_signal(dest, src, bytes, (uint64_t *) flag,
+                            (uint64_t) seq, SHMEM_SIGNAL_SET, pe);
+        team_messages++;
+        return;
+#elif defined(TEAM_SHMEMX_SIGNAL)
+        shmemx_putmem_signal(dest, src, bytes, (uint64_t *) flag,
+                             (uint64_t) seq, pe);
+        team_messages++;
+        return;
+#endif
+    }
+    shmem_putmem(dest, src, bytes, pe);
+    shmem_fence();
+    shmem_long_p(flag, seq, pe);
+    team_messages += 2;
+}
+
+typedef void (*team_combine_fn)(void *inout, const void *in, int n);
+
+static void team_to_all(shmem_team_t team, void *dest, const void *source,
+                        int nreduce, size_t elem_size,
+                        team_combine_fn combine, void *pWrk, long *pSync) {
+    int    *pe_map = team_pe_map(team);
+    int     t_pe   = shmemx_team_my_pe(team);
+    int     t_size = shmemx_team_n_pes(team);
+    int     nsteps = team_to_all_steps(t_size);
+    int     rem    = t_size - (1 << nsteps);
+    size_t  bytes  = nreduce * elem_size;
+    long    seq    = ++pSync[TEAM_SIG_SEQ];
+    int     par    = (int) (seq & 1);
+    char   *wrk    = (char *) pWrk + par * (nsteps + 1) * bytes;
+    long   *flags  = &pSync[TEAM_SIG_FLAGS + par * (TEAM_SIG_MAX_STEPS + 1)];
+    int     v, k;
+
+#define SLOT(k) (wrk + (size_t) (k) * bytes)
+
+    if (nsteps > TEAM_SIG_MAX_STEPS) {
+        fprintf(stderr, "team_to_all: team of %d PEs too large\n", t_size);
+        shmem_global_exit(1);
+    }
+    memmove(dest, source, bytes);
+
+    if (t_pe < 2 * rem && t_pe % 2 == 0) {
+        team_send(SLOT(nsteps), dest, bytes, &flags[nsteps], seq,
+                  pe_map[t_pe + 1]);
+        shmem_long_wait_until(&flags[nsteps], SHMEM_CMP_GE, seq);
+        memcpy(dest, SLOT(nsteps), bytes);
+        return;
+    }
+    if (t_pe < 2 * rem) {
+        shmem_long_wait_until(&flags[nsteps], SHMEM_CMP_GE, seq);
+        combine(dest, SLOT(nsteps), nreduce);
+        v = t_pe / 2;
+    } else {
+        v = t_pe - rem;
+    }
+
+    for (k = 0; k < nsteps; k++) {
+        int pv = v ^ (1 << k);
+        int pe = pe_map[(pv < rem) ? 2 * pv + 1 : pv + rem];
+
+        team_send(SLOT(k), dest, bytes, &flags[k], seq, pe);
+        shmem_long_wait_until(&flags[k], SHMEM_CMP_GE, seq);
+        combine(dest, SLOT(k), nreduce);
+    }
+
+    if (t_pe < 2 * rem) {
+        team_send(SLOT(nsteps), dest, bytes, &flags[nsteps], seq,
+                  pe_map[t_pe - 1]);
+    }
+
+#undef SLOT
+}
+
+#define DEFINE_TO_ALL(TYPE, NAME, OPNAME, EXPR)                              \
+static void NAME##_##OPNAME##_combine(void *inout, const void *in, int n) { \
+    TYPE *a = inout;                                                         \
+    const TYPE *b = in;                                                      \
+    int i;                                                                   \
+    for (i = 0; i < n; i++) {                                                \
+        TYPE x = a[i], y = b[i];                                             \
+        a[i] = (EXPR);                                                       \
+    }                                                                        \
+}                                                                            \
+                                                                             \
+void team_##NAME##_##OPNAME##_to_all(shmem_team_t team, TYPE *dest,          \
+                                     TYPE *source, int nreduce, TYPE *pWrk,  \
+                                     long *pSync) {                          \
+    team_to_all(team, dest, source, nreduce, sizeof(TYPE),                   \
+                NAME##_##OPNAME##_combine, pWrk, pSync);                     \
+}
+
+#define DEFINE_TO_ALL_ARITH(TYPE, NAME)                                      \
+    DEFINE_TO_ALL(TYPE, NAME, sum,  x + y)                                   \
+    DEFINE_TO_ALL(TYPE, NAME, prod, x * y)                                   \
+    DEFINE_TO_ALL(TYPE, NAME, max,  (x > y) ? x : y)                         \
+    DEFINE_TO_ALL(TYPE, NAME, min,  (x < y) ? x : y)
+
+#define DEFINE_TO_ALL_BITWISE(TYPE, NAME)                                    \
+    DEFINE_TO_ALL(TYPE, NAME, and,  x & y)                                   \
+    DEFINE_TO_ALL(TYPE, NAME, or,   x | y)                                   \
+    DEFINE_TO_ALL(TYPE, NAME, xor,  x ^ y)
+
+DEFINE_TO_ALL_ARITH(short, short)
+DEFINE_TO_ALL_ARITH(int, int)
+DEFINE_TO_ALL_ARITH(long, long)
+DEFINE_TO_ALL_ARITH(long long, longlong)
+DEFINE_TO_ALL_ARITH(float, float)
+DEFINE_TO_ALL_ARITH(double, double)
+DEFINE_TO_ALL_ARITH(long double, longdouble)
+
+DEFINE_TO_ALL_BITWISE(short, short)
+DEFINE_TO_ALL_BITWISE(int, int)
+DEFINE_TO_ALL_BITWISE(long, long)
+DEFINE_TO_ALL_BITWISE(long long, longlong)
+
+#define NITER       1000
+#define MAX_NREDUCE 16384
+
+#define MAX(a, b) ((a > b) ? a : b)
+
+long pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+long sig_pSync[TEAM_SIG_SYNC_SIZE];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+int main(int argc, char *argv[]) {
+    int i, iter, n, t, nsteps, errors = 0;
+    int me, npes;
+    int pwrk_size;
+    double *source, *dest, *ref, *pWrk, *sig_pWrk;
+    double t_lib, t_tr[2];
+    long msgs[2];
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+    nsteps = team_to_all_steps(npes);
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        pSync[0][i] = SHMEM_SYNC_VALUE;
+        pSync[1][i] = SHMEM_SYNC_VALUE;
+    }
+    for (i = 0; i < TEAM_SIG_SYNC_SIZE; i++) {
+        sig_pSync[i] = SHMEM_SYNC_VALUE;
+    }
+    team_map_init();
+
+    pwrk_size = MAX(MAX_NREDUCE/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE);
+    source    = shmem_malloc(MAX_NREDUCE * sizeof(double));
+    dest      = shmem_malloc(MAX_NREDUCE * sizeof(double));
+    /* two halves, alternated between consecutive library reductions */
+    pWrk      = shmem_malloc(2 * pwrk_size * sizeof(double));
+    sig_pWrk  = shmem_malloc(TEAM_SIG_WRK_SIZE(MAX_NREDUCE, npes) *
+                             sizeof(double));
+    ref       = malloc(MAX_NREDUCE * sizeof(double));
+
+    for (i = 0; i < MAX_NREDUCE; i++) {
+        source[i] = me + i;
+    }
+
+    if (me == 0) {
+#ifdef TEAM_SIGNAL_EMULATED
+        printf("put with signal not available, emulated with pSync\n");
+#endif
+        printf("npes %d, %d doubling steps, time in us\n", npes,
+               nsteps);
+        printf("%8s %10s %10s %10s %10s %10s %8s %8s\n", "nreduce",
+               "library", "pSync", "signal", "pSync/st", "signal/st",
+               "msg/st", "msg/st");
+    }
+
+    for (n = 1; n <= MAX_NREDUCE; n *= 4) {
+        shmem_barrier_all();
+        t_lib = wtime();
+        for (iter = 0; iter < NITER; iter++) {
+            shmemx_team_double_sum_to_all(SHMEM_TEAM_WORLD, dest, source, n,
+                                          pWrk + (iter % 2) * pwrk_size,
+                                          pSync[iter % 2]);
+        }
+        t_lib = (wtime() - t_lib) / NITER;
+        memcpy(ref, dest, n * sizeof(double));
+
+        for (t = TEAM_TRANSPORT_PSYNC; t <= TEAM_TRANSPORT_SIGNAL; t++) {
+            team_to_all_transport(t);
+            shmem_barrier_all();
+            msgs[t] = team_to_all_messages();
+            t_tr[t] = wtime();
+            for (iter = 0; iter < NITER; iter++) {
+                team_double_sum_to_all(SHMEM_TEAM_WORLD, dest, source, n,
+                                       sig_pWrk, sig_pSync);
+            }
+            t_tr[t] = (wtime() - t_tr[t]) / NITER;
+            msgs[t] = (team_to_all_messages() - msgs[t]) / NITER;
+            errors += memcmp(ref, dest, n * sizeof(double)) != 0;
+        }
+
+        if (me == 0) {
+            printf("%8d %10.2f %10.2f %10.2f %10.2f %10.2f %8.1f %8.1f\n",
+                   n, t_lib * 1.0e6, t_tr[0] * 1.0e6, t_tr[1] * 1.0e6,
+                   t_tr[0] * 1.0e6 / MAX(nsteps, 1),
+                   t_tr[1] * 1.0e6 / MAX(nsteps, 1),
+                   (double) msgs[0] / MAX(nsteps, 1),
+                   (double) msgs[1] / MAX(nsteps, 1));
+        }
+    }
+
+    if (errors) {
+        printf("[PE:%d] %d results differ from the library\n", me, errors);
+    }
+
+    free(ref);
+    shmem_barrier_all();
+    shmem_free(sig_pWrk);
+    shmem_free(pWrk);
+    shmem_free(dest);
+    shmem_free(source);
+    shmem_finalize();
+    return 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * Example program to show nonblocking team creation
+ *
+ * SYNOPSIS:
+ * void team_split_2d_nb(    shmem_team_t       parent_team,
+ *                           int                xrange,
+ *                           int                yrange,
+ *                           shmem_team_t      *xaxis_team,
+ *                           shmem_team_t      *yaxis_team,
+ *                           team_split_req_t **req )
+ *
+ * void team_split_3d_nb(    shmem_team_t       parent_team,
+ *                           int                xrange,
+ *                           int                yrange,
+ *                           int                zrange,
+ *                           shmem_team_t      *xaxis_team,
+ *                           shmem_team_t      *yaxis_team,
+ *                           shmem_team_t      *zaxis_team,
+ *                           team_split_req_t **req )
+ *
+ * void team_split_color_nb( shmem_team_t       parent_team,
+ *                           int                color,
+ *                           int                key,
+ *                           shmem_team_t      *new_team,
+ *                           team_split_req_t **req )
+ *
+ * int  team_split_test(     team_split_req_t  *req )
+ * void team_split_wait(     team_split_req_t **req )
+ * void team_split_finalize( void )
+ *
+ * DESCRIPTION:
+ * The nonblocking split routines start the same collective as
+ * shmemx_team_split_2d, shmemx_team_split_3d and shmemx_team_split_color
+ * and return at once with a pending request. The new team handles are
+ * valid after team_split_wait has returned for the request, or
+ * team_split_test has returned nonzero. team_split_wait releases the
+ * request and sets it to NULL.
+ *
+ * Any number of splits may be pending at a time. They are carried out in
+ * the order they were started by a progress thread, which is created on
+ * the first call, so the PE can go on with its initialization in the
+ * meantime. As for the blocking routines, all PEs of a parent team must
+ * start the same splits in the same order. No other collective may be
+ * called on a parent team while a split of it is pending.
+ *
+ * team_split_finalize waits for all pending splits and stops the progress
+ * thread. It must be called before shmem_finalize. The program must be
+ * initialized with shmem_init_thread and SHMEM_THREAD_MULTIPLE.
+ *
+ * The nonblocking split routines support the following options:
+ *
+ * parent_team, xrange, yrange, zrange, color, key
+ *          As for the blocking split routines.
+ *
+ * xaxis_team, yaxis_team, zaxis_team, new_team
+ *          New PE team handles, written when the split completes.
+ *
+ * req
+ *          Request handle for the pending split.
+ *
+ * EXAMPLE DETAILS:
+ * The example program creates NSPLITS pairs of split_2d teams and one
+ * triple of split_3d teams, and initializes a mesh which stands for the
+ * application start up. This is done once with the blocking split
+ * routines before the initialization, and once with the nonblocking
+ * routines started before the initialization and completed after it.
+ * PE 0 prints the start up time of both.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+
+enum {
+    TEAM_SPLIT_2D,
+    TEAM_SPLIT_3D,
+    TEAM_SPLIT_COLOR
+};
+
+typedef struct team_split_req {
+    int                    kind;
+    shmem_team_t           parent;
+    int                    args[3];
+    shmem_team_t          *teams[3];
+    int                    done;
+    struct team_split_req *next;
+} team_split_req_t;
+
+static pthread_t       split_thread;
+static pthread_mutex_t split_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  split_cond = PTHREAD_COND_INITIALIZER;
+static team_split_req_t *split_head, *split_tail;
+static int split_running, split_stop;
+
+static void *team_split_progress(void *arg) {
+    team_split_req_t *req;
+
+    (void) arg;
+    pthread_mutex_lock(&split_lock);
+    for (;;) {
+        while (split_head == NULL && !split_stop) {
+            pthread_cond_wait(&split_cond, &split_lock);
+        }
+        if (split_head == NULL) {
+            break;
+        }
+        req = split_head;
+        pthread_mutex_unlock(&split_lock);
+
+        switch (req->kind) {
+        case TEAM_SPLIT_2D:
+            shmemx_team_split_2d(req->parent, req->args[0], req->args[1],
+                                 req->teams[0], req->teams[1]);
+            break;
+        case TEAM_SPLIT_3D:
+            shmemx_team_split_3d(req->parent, req->args[0], req->args[1],
+                                 req->args[2], req->teams[0], req->teams[1],
+                                 req->teams[2]);
+            break;
+        case TEAM_SPLIT_COLOR:
+            shmemx_team_split_color(req->parent, req->args[0], req->args[1],
+                                    req->teams[0]);
+            break;
+        }
+
+        pthread_mutex_lock(&split_lock);
+        split_head = req->next;
+        if (split_head == NULL) {
+            split_tail = NULL;
+        }
+        req->done = 1;
+        pthread_cond_broadcast(&split_cond);
+    }
+    pthread_mutex_unlock(&split_lock);
+    return NULL;
+}
+
+static team_split_req_t *team_split_post(int kind, shmem_team_t parent,
+                                         int a0, int a1, int a2,
+                                         shmem_team_t *t0, shmem_team_t *t1,
+                                         shmem_team_t *t2) {
+    team_split_req_t *req = calloc(1, sizeof(*req));
+
+    if (req == NULL) {
+        fprintf(stderr, "team_split: cannot allocate request\n");
+        shmem_global_exit(1);
+    }
+
+    req->kind     = kind;
+    req->parent   = parent;
+    req->args[0]  = a0;
+    req->args[1]  = a1;
+    req->args[2]  = a2;
+    req->teams[0] = t0;
+    req->teams[1] = t1;
+    req->teams[2] = t2;
+
+    pthread_mutex_lock(&split_lock);
+    if (!split_running) {
+        if (pthread_create(&split_thread, NULL, team_split_progress, NULL)) {
+            fprintf(stderr, "team_split: cannot start progress thread\n");
+            shmem_global_exit(1);
+        }
+        split_running = 1;
+    }
+    if (split_tail != NULL) {
+        split_tail->next = req;
+    } else {
+        split_head = req;
+    }
+    split_tail = req;
+    pthread_cond_broadcast(&split_cond);
+    pthread_mutex_unlock(&split_lock);
+    return req;
+}
+
+void team_split_2d_nb(shmem_team_t parent_team, int xrange, int yrange,
+                      shmem_team_t *xaxis_team, shmem_team_t *yaxis_team,
+                      team_split_req_t **req) {
+    *req = team_split_post(TEAM_SPLIT_2D, parent_team, xrange, yrange, 0,
+                           xaxis_team, yaxis_team, NULL);
+}
+
+void team_split_3d_nb(shmem_team_t parent_team, int xrange, int yrange,
+                      int zrange, shmem_team_t *xaxis_team,
+                      shmem_team_t *yaxis_team, shmem_team_t *zaxis_team,
+                      team_split_req_t **req) {
+    *req = team_split_post(TEAM_SPLIT_3D, parent_team, xrange, yrange,
+                           zrange, xaxis_team, yaxis_team, zaxis_team);
+}
+
+void team_split_color_nb(shmem_team_t parent_team, int color, int key,
+                         shmem_team_t *new_team, team_split_req_t **req) {
+    *req = team_split_post(TEAM_SPLIT_COLOR, parent_team, color, key, 0,
+                           new_team, NULL, NULL);
+}
+
+int team_split_test(team_split_req_t *req) {
+    int done;
+
+    pthread_mutex_lock(&split_lock);
+    done = req->done;
+    pthread_mutex_unlock(&split_lock);
+    return done;
+}
+
+void team_split_wait(team_split_req_t **req) {
+    pthread_mutex_lock(&split_lock);
+    while (!(*req)->done) {
+        pthread_cond_wait(&split_cond, &split_lock);
+    }
+    pthread_mutex_unlock(&split_lock);
+    free(*req);
+    *req = NULL;
+}
+
+void team_split_finalize(void) {
+    pthread_mutex_lock(&split_lock);
+    split_stop = 1;
+    pthread_cond_broadcast(&split_cond);
+    pthread_mutex_unlock(&split_lock);
+    if (split_running) {
+        pthread_join(split_thread, NULL);
+        split_running = 0;
+    }
+}
+
+#define NSPLITS     8
+#define MESH_SIZE   (1 << 22)
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/* stands for reading input and setting up the mesh */
+static double init_mesh(double *mesh, int me) {
+    double sum = 0.0;
+    long i;
+
+    for (i = 0; i < MESH_SIZE; i++) {
+        mesh[i] = sin((double) (i + me));
+        sum += mesh[i];
+    }
+    return sum;
+}
+
+static void destroy_teams(shmem_team_t teams[][3], int nteams) {
+    int i, j;
+
+    for (i = 0; i < nteams; i++) {
+        for (j = 0; j < 3; j++) {
+            if (teams[i][j] != SHMEM_TEAM_NULL) {
+                shmemx_team_destroy(&teams[i][j]);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int i;
+    int me, npes, provided;
+    int xrange, yrange, zrange;
+    int xrange3, yrange3;
+    double t_blocking, t_nonblocking, t_init, check;
+    double *mesh;
+    shmem_team_t teams[NSPLITS + 1][3];
+    team_split_req_t *req[NSPLITS + 1];
+
+    shmem_init_thread(SHMEM_THREAD_MULTIPLE, &provided);
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    if (provided != SHMEM_THREAD_MULTIPLE) {
+        if (me == 0) {
+            printf("SHMEM_THREAD_MULTIPLE not provided\n");
+        }
+        shmem_finalize();
+        return 0;
+    }
+
+    /* fault the mesh in, so that both runs initialize it at equal cost */
+    mesh = malloc(MESH_SIZE * sizeof(double));
+    memset(mesh, 0, MESH_SIZE * sizeof(double));
+    for (i = 0; i <= NSPLITS; i++) {
+        teams[i][0] = SHMEM_TEAM_NULL;
+        teams[i][1] = SHMEM_TEAM_NULL;
+        teams[i][2] = SHMEM_TEAM_NULL;
+    }
+
+    xrange  = (npes != 1) ? floor(log(npes)/log(2)) : 1;
+    yrange  = (npes != 1) ? floor(log(npes)/log(2)) : 1;
+    xrange3 = (npes > 4) ? floor(log(npes)/log(2))-1 : 1;
+    yrange3 = (npes > 4) ? floor(log(npes)/log(2))-1 : 1;
+    zrange  = (npes / (xrange3*yrange3));
+
+    /* blocking: create all teams, then initialize */
+    shmem_barrier_all();
+    t_blocking = wtime();
+    for (i = 0; i < NSPLITS; i++) {
+        shmemx_team_split_2d(SHMEM_TEAM_WORLD, xrange, yrange,
+                             &teams[i][0], &teams[i][1]);
+    }
+    shmemx_team_split_3d(SHMEM_TEAM_WORLD, xrange3, yrange3, zrange,
+                         &teams[NSPLITS][0], &teams[NSPLITS][1],
+                         &teams[NSPLITS][2]);
+    t_init = wtime();
+    check = init_mesh(mesh, me);
+    t_init = wtime() - t_init;
+    t_blocking = wtime() - t_blocking;
+
+    shmem_barrier_all();
+    destroy_teams(teams, NSPLITS + 1);
+
+    /* nonblocking: start all splits, initialize, then complete them */
+    shmem_barrier_all();
+    t_nonblocking = wtime();
+    for (i = 0; i < NSPLITS; i++) {
+        team_split_2d_nb(SHMEM_TEAM_WORLD, xrange, yrange,
+                         &teams[i][0], &teams[i][1], &req[i]);
+    }
+    team_split_3d_nb(SHMEM_TEAM_WORLD, xrange3, yrange3, zrange,
+                     &teams[NSPLITS][0], &teams[NSPLITS][1],
+                     &teams[NSPLITS][2], &req[NSPLITS]);
+    check -= init_mesh(mesh, me);
+    for (i = 0; i <= NSPLITS; i++) {
+        team_split_wait(&req[i]);
+    }
+    t_nonblocking = wtime() - t_nonblocking;
+
+    if (teams[0][0] != SHMEM_TEAM_NULL) {
+        printf("Global PE %d has team_pe of %d out of %d in xaxis_team\n",
+               me, shmemx_team_my_pe(teams[0][0]),
+               shmemx_team_n_pes(teams[0][0]));
+    }
+
+    shmem_barrier_all();
+    destroy_teams(teams, NSPLITS + 1);
+    team_split_finalize();
+
+    if (me == 0) {
+        printf("npes %d, %d split_2d and 1 split_3d, initialization "
+               "%.2f ms%s\n", npes, NSPLITS, t_init * 1.0e3,
+               (check != 0.0) ? " (mismatch)" : "");
+        printf("blocking splits:    %10.2f ms start up\n",
+               t_blocking * 1.0e3);
+        printf("nonblocking splits: %10.2f ms start up\n",
+               t_nonblocking * 1.0e3);
+    }
+
+    free(mesh);
+    shmem_barrier_all();
+    shmem_finalize();
+    return 0;
+}
@@ -0,0 +1,330 @@
+/*
+ * Example program to show an N-dimensional split into axis and plane teams
+ *
+ * SYNOPSIS:
+ * int  team_nd_subspaces( int            ndims,
+ *                         unsigned       kinds,
+ *                         unsigned      *subspaces )
+ *
+ * void team_split_nd(     shmem_team_t   parent_team,
+ *                         int            ndims,
+ *                         const int     *dims,
+ *                         int            nsubspaces,
+ *                         const unsigned *subspaces,
+ *                         int            leftover,
+ *                         shmem_team_t  *new_teams )
+ *
+ * DESCRIPTION:
+ * team_split_nd is a collective routine over the parent team. It lays
+ * out the parent team PEs on the cartesian space described by dims, with
+ * the first dimension varying fastest as in shmemx_team_split_2d and
+ * shmemx_team_split_3d, and creates one team for each requested
+ * subspace. A subspace is a bit mask of the dimensions it spans, for
+ * example TEAM_ND_DIM(0) for the x axis or TEAM_ND_DIM(0) | TEAM_ND_DIM(2)
+ * for the xz plane. The team of a PE for a subspace holds all the PEs
+ * that share its coordinates in the other dimensions, ranked by their
+ * position in the subspace with the lower dimensions varying fastest.
+ *
+ * All the teams are created in one call. The coordinates of every PE
+ * are known locally, so no information has to be exchanged: a subspace
+ * whose PEs form a single strided set in the parent team is created
+ * with shmemx_team_split_strided by its members alone, which covers all
+ * axes and every subspace made of adjacent dimensions. Only the other
+ * subspaces need a shmemx_team_split_color over the whole parent team.
+ *
+ * team_nd_subspaces fills subspaces with all the subspaces of an
+ * ndims-dimensional space whose number of dimensions is selected in
+ * kinds, and returns their number. TEAM_ND_AXES, TEAM_ND_PLANES and
+ * TEAM_ND_KIND(k) select 1, 2 and k dimensional subspaces. The array
+ * must hold up to 2^ndims entries.
+ *
+ * The team_split_nd routine supports the following options:
+ *
+ * parent_team
+ *          A valid PE team.
+ *
+ * ndims, dims
+ *          Number of dimensions, at most TEAM_ND_MAX_DIMS, and the
+ *          positive size of each of them.
+ *
+ * nsubspaces, subspaces
+ *          The subspaces to create teams for.
+ *
+ * leftover
+ *          What happens to the parent team PEs beyond the product of
+ *          dims. With TEAM_ND_LEFTOVER_NULL they get SHMEM_TEAM_NULL for
+ *          every subspace, as with shmemx_team_split_3d. With
+ *          TEAM_ND_LEFTOVER_EXTEND the last dimension is grown to hold
+ *          them, and the teams of the partial last slab are smaller.
+ *
+ * new_teams
+ *          The new team handles, one for each subspace.
+ *
+ * EXAMPLE DETAILS:
+ * The example program lays out all PEs on a balanced four dimensional
+ * grid and creates the 4 axis and 6 plane teams of every PE. This is
+ * done once with team_split_nd and once with one shmemx_team_split_color
+ * per team. The team sizes and ranks of both are compared, and PE 0
+ * prints the time taken by both.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+
+#define TEAM_ND_MAX_DIMS        16
+#define TEAM_ND_DIM(d)          (1u << (d))
+#define TEAM_ND_KIND(k)         (1u << (k))
+#define TEAM_ND_AXES            TEAM_ND_KIND(1)
+#define TEAM_ND_PLANES          TEAM_ND_KIND(2)
+
+#define TEAM_ND_LEFTOVER_NULL   0
+#define TEAM_ND_LEFTOVER_EXTEND 1
+
+static int team_nd_popcount(unsigned mask) {
+    int n = 0;
+
+    for (; mask; mask >>= 1) {
+        n += mask & 1;
+    }
+    return n;
+}
+
+int team_nd_subspaces(int ndims, unsigned kinds, unsigned *subspaces) {
+    unsigned s;
+    int n = 0;
+
+    for (s = 1; s < (1u << ndims); s++) {
+        if (kinds & TEAM_ND_KIND(team_nd_popcount(s))) {
+            subspaces[n++] = s;
+        }
+    }
+    return n;
+}
+
+void team_split_nd(shmem_team_t parent_team, int ndims, const int *dims,
+                   int nsubspaces, const unsigned *subspaces, int leftover,
+                   shmem_team_t *new_teams) {
+    int d, i, lo, hi, strided;
+    int p_pe = shmemx_team_my_pe(parent_team);
+    int p_size = shmemx_team_n_pes(parent_team);
+    int coord[TEAM_ND_MAX_DIMS], extent[TEAM_ND_MAX_DIMS];
+    long place[TEAM_ND_MAX_DIMS];
+    long box, start, color, key, scale;
+    int member, size;
+
+    if (ndims < 1 || ndims > TEAM_ND_MAX_DIMS) {
+        fprintf(stderr, "team_split_nd: invalid ndims %d\n", ndims);
+        shmem_global_exit(1);
+    }
+
+    box = 1;
+    for (d = 0; d < ndims; d++) {
+        if (dims[d] < 1) {
+            fprintf(stderr, "team_split_nd: invalid dims[%d] %d\n", d,
+                    dims[d]);
+            shmem_global_exit(1);
+        }
+        extent[d] = dims[d];
+        place[d] = box;
+        box *= dims[d];
+    }
+    if (box > p_size) {
+        fprintf(stderr, "team_split_nd: %ld PEs do not fit in a team of "
+                "%d\n", box, p_size);
+        shmem_global_exit(1);
+    }
+    if (leftover == TEAM_ND_LEFTOVER_EXTEND && box < p_size) {
+        extent[ndims - 1] += (p_size - box + place[ndims - 1] - 1) /
+                             place[ndims - 1];
+        box = place[ndims - 1] * extent[ndims - 1];
+    }
+    member = (p_pe < box);
+
+    for (d = 0; d < ndims; d++) {
+        coord[d] = (p_pe / place[d]) % extent[d];
+    }
+
+    for (i = 0; i < nsubspaces; i++) {
+        new_teams[i] = SHMEM_TEAM_NULL;
+
+        /* the subspace is strided if no dimension between its lowest
+         * and highest one is left out, apart from dimensions of size 1 */
+        lo = -1;
+        hi = -1;
+        for (d = 0; d < ndims; d++) {
+            if ((subspaces[i] & TEAM_ND_DIM(d)) && extent[d] > 1) {
+                if (lo < 0) {
+                    lo = d;
+                }
+                hi = d;
+            }
+        }
+        strided = 1;
+        for (d = lo + 1; lo >= 0 && d < hi; d++) {
+            if (!(subspaces[i] & TEAM_ND_DIM(d)) && extent[d] > 1) {
+                strided = 0;
+            }
+        }
+
+        if (strided) {
+            if (!member) {
+                continue;
+            }
+            start = 0;
+            for (d = 0; d < ndims; d++) {
+                if (!(subspaces[i] & TEAM_ND_DIM(d))) {
+                    start += coord[d] * place[d];
+                }
+            }
+            if (lo < 0) {
+                shmemx_team_split_strided(parent_team, start, 1, 1,
+                                          &new_teams[i]);
+                continue;
+            }
+            size = place[hi] * extent[hi] / place[lo];
+            if (start + (long) (size - 1) * place[lo] >= p_size) {
+                size = (p_size - 1 - start) / place[lo] + 1;
+            }
+            shmemx_team_split_strided(parent_team, start, place[lo], size,
+                                      &new_teams[i]);
+        } else {
+            color = 0;
+            key = 0;
+            scale = 1;
+            for (d = 0; d < ndims; d++) {
+                if (subspaces[i] & TEAM_ND_DIM(d)) {
+                    key += coord[d] * scale;
+                    scale *= extent[d];
+                } else {
+                    color += coord[d] * place[d];
+                }
+            }
+            shmemx_team_split_color(parent_team,
+                                    member ? color : SHMEM_COLOR_UNDEFINED,
+                                    key, &new_teams[i]);
+        }
+    }
+}
+
+#define NDIMS   4
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/* spread the prime factors of npes over the dimensions */
+static void dims_create(int npes, int ndims, int *dims) {
+    int d, f, smallest;
+
+    for (d = 0; d < ndims; d++) {
+        dims[d] = 1;
+    }
+    for (f = npes; f > 1; f--) {
+        while (npes % f == 0) {
+            int prime = 1, g;
+
+            for (g = 2; g * g <= f; g++) {
+                if (f % g == 0) {
+                    prime = 0;
+                }
+            }
+            if (!prime) {
+                break;
+            }
+            smallest = 0;
+            for (d = 1; d < ndims; d++) {
+                if (dims[d] < dims[smallest]) {
+                    smallest = d;
+                }
+            }
+            dims[smallest] *= f;
+            npes /= f;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int i, d;
+    int me, npes, nsub, errors = 0;
+    int dims[NDIMS], coord[NDIMS];
+    unsigned subspaces[1 << NDIMS];
+    shmem_team_t nd_teams[1 << NDIMS], color_teams[1 << NDIMS];
+    double t_nd, t_color;
+    long color, key, scale, place;
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    dims_create(npes, NDIMS, dims);
+    nsub = team_nd_subspaces(NDIMS, TEAM_ND_AXES | TEAM_ND_PLANES,
+                             subspaces);
+
+    /* one split_color per team */
+    shmem_barrier_all();
+    t_color = wtime();
+    place = 1;
+    for (d = 0; d < NDIMS; d++) {
+        coord[d] = (me / place) % dims[d];
+        place *= dims[d];
+    }
+    for (i = 0; i < nsub; i++) {
+        color = 0;
+        key = 0;
+        scale = 1;
+        place = 1;
+        for (d = 0; d < NDIMS; d++) {
+            if (subspaces[i] & TEAM_ND_DIM(d)) {
+                key += coord[d] * scale;
+                scale *= dims[d];
+            } else {
+                color += coord[d] * place;
+            }
+            place *= dims[d];
+        }
+        shmemx_team_split_color(SHMEM_TEAM_WORLD, color, key,
+                                &color_teams[i]);
+    }
+    t_color = wtime() - t_color;
+
+    /* all teams from one team_split_nd */
+    shmem_barrier_all();
+    t_nd = wtime();
+    team_split_nd(SHMEM_TEAM_WORLD, NDIMS, dims, nsub, subspaces,
+                  TEAM_ND_LEFTOVER_NULL, nd_teams);
+    t_nd = wtime() - t_nd;
+
+    for (i = 0; i < nsub; i++) {
+        if (shmemx_team_n_pes(nd_teams[i]) !=
+            shmemx_team_n_pes(color_teams[i]) ||
+            shmemx_team_my_pe(nd_teams[i]) !=
+            shmemx_team_my_pe(color_teams[i])) {
+            errors++;
+        }
+    }
+    if (errors) {
+        printf("Global PE %d has %d mismatched teams\n", me, errors);
+    }
+
+    shmem_barrier_all();
+    for (i = 0; i < nsub; i++) {
+        shmemx_team_destroy(&nd_teams[i]);
+        shmemx_team_destroy(&color_teams[i]);
+    }
+
+    if (me == 0) {
+        printf("npes %d, grid %d x %d x %d x %d, %d axis and plane teams\n",
+               npes, dims[0], dims[1], dims[2], dims[3], nsub);
+        printf("split_color per team: %10.2f us\n", t_color * 1.0e6);
+        printf("team_split_nd:        %10.2f us\n", t_nd * 1.0e6);
+    }
+
+    shmem_barrier_all();
+    shmem_finalize();
+    return 0;
+}
@@ -0,0 +1,299 @@
+/*
+ * Example program to show thread-safe team collectives for hybrid
+ * PE x threads execution
+ *
+ * SYNOPSIS:
+ * void team_mt_init(             void )
+ *
+ * void team_mt_split_2d(         shmem_team_t  parent_team,
+ *                                int           xrange,
+ *                                int           yrange,
+ *                                team_mt_t   **xaxis_team,
+ *                                team_mt_t   **yaxis_team )
+ *
+ * void team_mt_<datatype>_<op>_to_all( team_mt_t   *team,
+ *                                      <datatype>  *dest,
+ *                                      <datatype>  *source,
+ *                                      int          nreduce )
+ *
+ * void team_mt_destroy(          team_mt_t   **team )
+ *
+ * where <op> is one from sum, prod, max and min for <datatype> short,
+ * int, long, float, double, longdouble and longlong, and additionally
+ * and, or and xor for short, int, long and longlong.
+ *
+ * DESCRIPTION:
+ * The shmemx_team_<datatype>_<op>_to_all routines take their pWrk and
+ * pSync work arrays from the caller. Two threads of a PE may only call
+ * them at the same time if they pass different work arrays and do not
+ * use the same team, as the calls on a team have to be matched in the
+ * same order on all members. Codes therefore funnel all team reductions
+ * through one thread.
+ *
+ * The team_mt routines attach two pairs of pWrk and pSync arrays and a
+ * lock to each team; consecutive reductions on a team alternate between
+ * the pairs. Calls on the same team from different threads are serialized
+ * by the lock, calls on different teams proceed concurrently. The lock
+ * is held only for the duration of the reduction, so the order of
+ * reductions on one team is the order in which the threads acquire the
+ * lock. That order must be the same on all members; the simplest way to
+ * ensure it is to drive each team from a single thread, as done in this
+ * example.
+ *
+ * team_mt_init is called once by all PEs, after shmem_init_thread and
+ * before any split. It initializes the pSync arrays of every team and
+ * ends with a barrier over all PEs, so that no member of a new team
+ * reaches the pSync arrays of another PE before they are set up.
+ *
+ * team_mt_split_2d is a collective routine over the parent team, like
+ * shmemx_team_split_2d. Splits issued by several threads are serialized
+ * by a process-wide lock, and must be issued in the same order on all
+ * PEs of the parent team. Non-members get a NULL handle. The per-team
+ * state lives in a symmetric table, so every PE of the parent team uses
+ * the same table slots for the same split, member or not.
+ *
+ * The program must be initialized with shmem_init_thread and
+ * SHMEM_THREAD_MULTIPLE. The routines support the following options:
+ *
+ * parent_team, xrange, yrange
+ *          As for shmemx_team_split_2d.
+ *
+ * xaxis_team, yaxis_team
+ *          New thread-safe team handles, or NULL if the calling PE is not
+ *          a member.
+ *
+ * dest, source, nreduce
+ *          As for shmemx_team_<datatype>_<op>_to_all. nreduce must not
+ *          exceed MT_NREDUCE_MAX.
+ *
+ * EXAMPLE DETAILS:
+ * The example program creates one pair of split_2d axis teams per OpenMP
+ * thread. Each iteration performs one reduction on every team, first
+ * funneled through the master thread, then with every thread driving the
+ * reductions of its own pair of teams. The time per iteration of both
+ * modes is printed by PE 0. Run it with different PE counts and values of
+ * OMP_NUM_THREADS to vary both dimensions.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <omp.h>
+#include <shmem.h>
+#include <shmemx.h>
+
+#define MT_NREDUCE_MAX  1024
+#define MT_MAX_TEAMS    256
+
+#define MAX(a, b) ((a > b) ? a : b)
+#define PWRK_MAX_SIZE MAX(MT_NREDUCE_MAX/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE)
+
+typedef struct {
+    long         pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+    long double  pWrk[2][PWRK_MAX_SIZE];
+    shmem_team_t team;
+    omp_lock_t   lock;
+    int          sync_idx;
+} team_mt_t;
+
+/* symmetric table: slot i belongs to the same split on all PEs */
+team_mt_t mt_table[MT_MAX_TEAMS];
+static int mt_next_slot;
+
+void team_mt_init(void) {
+    int i, j;
+
+    for (i = 0; i < MT_MAX_TEAMS; i++) {
+        for (j = 0; j < SHMEM_REDUCE_SYNC_SIZE; j++) {
+            mt_table[i].pSync[0][j] = SHMEM_SYNC_VALUE;
+            mt_table[i].pSync[1][j] = SHMEM_SYNC_VALUE;
+        }
+    }
+    mt_next_slot = 0;
+    shmem_barrier_all();
+}
+
+/* the slot's pSync arrays were set up by team_mt_init */
+static team_mt_t *team_mt_attach(int slot, shmem_team_t team) {
+    team_mt_t *t = &mt_table[slot];
+
+    if (team == SHMEM_TEAM_NULL) {
+        return NULL;
+    }
+
+    t->team     = team;
+    t->sync_idx = 0;
+    omp_init_lock(&t->lock);
+    return t;
+}
+
+void team_mt_split_2d(shmem_team_t parent_team, int xrange, int yrange,
+                      team_mt_t **xaxis_team, team_mt_t **yaxis_team) {
+    shmem_team_t xteam, yteam;
+
+    #pragma omp critical (team_mt_split)
+    {
+        if (mt_next_slot + 2 > MT_MAX_TEAMS) {
+            fprintf(stderr, "team_mt_split_2d: more than %d teams\n",
+                    MT_MAX_TEAMS);
+            shmem_global_exit(1);
+        }
+
+        shmemx_team_split_2d(parent_team, xrange, yrange, &xteam, &yteam);
+        *xaxis_team = team_mt_attach(mt_next_slot, xteam);
+        *yaxis_team = team_mt_attach(mt_next_slot + 1, yteam);
+        mt_next_slot += 2;
+    }
+}
+
+#define DEFINE_MT(TYPE, NAME, OPNAME)                                        \
+void team_mt_##NAME##_##OPNAME##_to_all(team_mt_t *t, TYPE *dest,            \
+                                        TYPE *source, int nreduce) {         \
+    omp_set_lock(&t->lock);                                                  \
+    shmemx_team_##NAME##_##OPNAME##_to_all(t->team, dest, source, nreduce,   \
+                                           (TYPE *) t->pWrk[t->sync_idx],    \
+                                           t->pSync[t->sync_idx]);           \
+    t->sync_idx = !t->sync_idx;                                              \
+    omp_unset_lock(&t->lock);                                                \
+}
+
+#define DEFINE_MT_ARITH(TYPE, NAME)                                          \
+    DEFINE_MT(TYPE, NAME, sum)                                               \
+    DEFINE_MT(TYPE, NAME, prod)                                              \
+    DEFINE_MT(TYPE, NAME, max)                                               \
+    DEFINE_MT(TYPE, NAME, min)
+
+#define DEFINE_MT_BITWISE(TYPE, NAME)                                        \
+    DEFINE_MT(TYPE, NAME, and)                                               \
+    DEFINE_MT(TYPE, NAME, or)                                                \
+    DEFINE_MT(TYPE, NAME, xor)
+
+DEFINE_MT_ARITH(short, short)
+DEFINE_MT_ARITH(int, int)
+DEFINE_MT_ARITH(long, long)
+DEFINE_MT_ARITH(long long, longlong)
+DEFINE_MT_ARITH(float, float)
+DEFINE_MT_ARITH(double, double)
+DEFINE_MT_ARITH(long double, longdouble)
+
+DEFINE_MT_BITWISE(short, short)
+DEFINE_MT_BITWISE(int, int)
+DEFINE_MT_BITWISE(long, long)
+DEFINE_MT_BITWISE(long long, longlong)
+
+void team_mt_destroy(team_mt_t **t) {
+    if (*t == NULL) {
+        return;
+    }
+    omp_destroy_lock(&(*t)->lock);
+    shmemx_team_destroy(&(*t)->team);
+    *t = NULL;
+}
+
+#define MAX_THREADS 64
+#define NITER       1000
+#define N           3
+
+double dest[MAX_THREADS][2][N];
+double source[MAX_THREADS][2][N];
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+static void reduce_pair(team_mt_t *xt, team_mt_t *yt, int t) {
+    if (xt != NULL) {
+        team_mt_double_sum_to_all(xt, dest[t][0], source[t][0], N);
+    }
+    if (yt != NULL) {
+        team_mt_double_sum_to_all(yt, dest[t][1], source[t][1], N);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int i, t, iter;
+    int me, npes;
+    int provided, nthreads;
+    int xrange, yrange;
+    double t_funneled, t_multiple;
+    team_mt_t *xaxis_team[MAX_THREADS];
+    team_mt_t *yaxis_team[MAX_THREADS];
+
+    shmem_init_thread(SHMEM_THREAD_MULTIPLE, &provided);
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    if (provided != SHMEM_THREAD_MULTIPLE) {
+        if (me == 0) {
+            printf("SHMEM_THREAD_MULTIPLE not provided\n");
+        }
+        shmem_finalize();
+        return 0;
+    }
+
+    team_mt_init();
+
+    nthreads = omp_get_max_threads();
+    if (nthreads > MAX_THREADS) {
+        nthreads = MAX_THREADS;
+    }
+    omp_set_num_threads(nthreads);
+
+    xrange = (npes != 1) ? floor(log(npes)/log(2)) : 1;
+    yrange = (npes != 1) ? floor(log(npes)/log(2)) : 1;
+    for (t = 0; t < nthreads; t++) {
+        team_mt_split_2d(SHMEM_TEAM_WORLD, xrange, yrange,
+                         &xaxis_team[t], &yaxis_team[t]);
+        for (i = 0; i < N; i++) {
+            source[t][0][i] = me;
+            source[t][1][i] = me;
+        }
+    }
+
+    /* one thread issues the reductions of all threads */
+    shmem_barrier_all();
+    t_funneled = wtime();
+    for (iter = 0; iter < NITER; iter++) {
+        for (t = 0; t < nthreads; t++) {
+            reduce_pair(xaxis_team[t], yaxis_team[t], t);
+        }
+    }
+    t_funneled = (wtime() - t_funneled) / NITER;
+
+    /* every thread drives the reductions on its own pair of teams */
+    shmem_barrier_all();
+    t_multiple = wtime();
+    #pragma omp parallel private(iter)
+    {
+        int tid = omp_get_thread_num();
+
+        for (iter = 0; iter < NITER; iter++) {
+            reduce_pair(xaxis_team[tid], yaxis_team[tid], tid);
+        }
+    }
+    t_multiple = (wtime() - t_multiple) / NITER;
+
+    if (xaxis_team[0] != NULL) {
+        printf("[PE:%d] xaxis_team sum %g\n", me, dest[0][0][0]);
+    }
+
+    shmem_barrier_all();
+    if (me == 0) {
+        printf("npes %d, threads per PE %d, %d teams per thread\n",
+               npes, nthreads, 2);
+        printf("funneled: %10.2f us per iteration\n", t_funneled * 1.0e6);
+        printf("multiple: %10.2f us per iteration\n", t_multiple * 1.0e6);
+    }
+
+    for (t = 0; t < nthreads; t++) {
+        team_mt_destroy(&xaxis_team[t]);
+        team_mt_destroy(&yaxis_team[t]);
+    }
+
+    shmem_barrier_all();
+    shmem_finalize();
+    return 0;
+}
@@ -0,0 +1,442 @@
+/*
+ * Program to run team programs over a sweep of PE counts on one node
+ *
+ * SYNOPSIS:
+ * ./scale [-l launcher] [-n counts] [-p policy] [-r repeats] [-o prefix]
+ *         [-f] program [args]...
+ *
+ * ./scale -w policy program [args]...
+ *
+ * DESCRIPTION:
+ * Scaling curves of the team routines can be measured on a single large
+ * node long before a batch allocation of many nodes is granted, as long
+ * as the placement of the PEs is controlled: a PE which shares a core
+ * with another one, or which the kernel moves around, makes the timings
+ * meaningless. This program starts program with the SHMEM launcher once
+ * for every PE count of the sweep, pins every PE to a CPU of the node
+ * following a placement policy, and prints the wall clock time of each
+ * run. The output of each run is written to <prefix>.<npes>.out, which
+ * keeps the timings printed by the perf programs.
+ *
+ * Pinning is done by the program itself: the launcher starts a copy of
+ * it with -w on every PE, which reads the local rank of the PE from the
+ * environment set by the launcher, binds itself to the CPU the policy
+ * gives that rank, and then executes program. The launcher must
+ * therefore leave the binding alone. The placement policies are:
+ *
+ * core
+ *          One PE per physical core, using the first hardware thread of
+ *          each core, cores in order. This is the default.
+ *
+ * smt
+ *          One PE per hardware thread, the threads of a core next to
+ *          each other.
+ *
+ * numa
+ *          One PE per physical core, taken in turn from every NUMA node,
+ *          so that consecutive PEs are on different nodes.
+ *
+ * none
+ *          No pinning.
+ *
+ * Only the CPUs the program may run on are used, so the sweep respects
+ * the cpuset of the job. A PE count above the number of CPUs of the
+ * policy would put more than one PE on a CPU; such counts are skipped
+ * with a message unless -f is given, and the PEs report the
+ * oversubscription when they are started anyway.
+ *
+ * The options are:
+ *
+ * -l launcher
+ *          Command starting the PEs, with %d standing for the number of
+ *          PEs. The default is "aprun -n %d -cc none".
+ *
+ * -n counts
+ *          Comma separated PE counts. The default is 1, 2, 4 and so on
+ *          up to the number of CPUs of the policy.
+ *
+ * -p policy
+ *          core, smt, numa or none.
+ *
+ * -r repeats
+ *          Runs for every PE count, 1 by default. The fastest, mean and
+ *          slowest wall clock times are printed.
+ *
+ * -o prefix
+ *          Prefix of the output files, "scale" by default.
+ *
+ * -f
+ *          Also run PE counts above the number of CPUs.
+ *
+ * EXAMPLE DETAILS:
+ * Running ../perf/shmemx-team-grid.c compiled as grid on 1 to 256 PEs of
+ * one node, one PE per core:
+ *
+ *     ./scale -l "aprun -n %d -cc none" -n 1,16,64,256 -r 3 ./grid
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define SCALE_MAX_CPUS      4096
+#define SCALE_MAX_COUNTS    64
+#define SCALE_MAX_ARGS      256
+
+typedef struct {
+    int cpu;
+    int package;
+    int core;
+    int node;
+    int thread;
+} scale_cpu_t;
+
+/* local rank variables of common launchers, the first one set is used */
+static const char *scale_rank_vars[] = {
+    "ALPS_APP_PE", "OMPI_COMM_WORLD_LOCAL_RANK", "MPI_LOCALRANKID",
+    "PMI_LOCAL_RANK", "PMIX_LOCAL_RANK", "SLURM_LOCALID", NULL
+};
+
+static int scale_read_int(int cpu, const char *file) {
+    char path[256];
+    int value = 0;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s", cpu,
+             file);
+    f = fopen(path, "r");
+    if (f != NULL) {
+        if (fscanf(f, "%d", &value) != 1) {
+            value = 0;
+        }
+        fclose(f);
+    }
+    return value;
+}
+
+/* position of cpu among the hardware threads of its core */
+static int scale_thread(int cpu) {
+    char path[256], list[256], *s;
+    int a, b, n = 0, thread = 0;
+    FILE *f;
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list",
+             cpu);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+    if (fgets(list, sizeof(list), f) == NULL) {
+        list[0] = '\0';
+    }
+    fclose(f);
+
+    for (s = strtok(list, ",\n"); s != NULL; s = strtok(NULL, ",\n")) {
+        if (sscanf(s, "%d-%d", &a, &b) != 2) {
+            b = a = atoi(s);
+        }
+        if (cpu >= a && cpu <= b) {
+            thread = n + cpu - a;
+        }
+        n += b - a + 1;
+    }
+    return thread;
+}
+
+static int scale_node(int cpu) {
+    char path[256];
+    struct dirent *ent;
+    int node = 0;
+    DIR *dir;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    dir = opendir(path);
+    if (dir == NULL) {
+        return 0;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        if (sscanf(ent->d_name, "node%d", &node) == 1) {
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+static int scale_cmp_smt(const void *a, const void *b) {
+    const scale_cpu_t *s = a, *t = b;
+
+    if (s->package != t->package) {
+        return s->package - t->package;
+    }
+    if (s->core != t->core) {
+        return s->core - t->core;
+    }
+    return s->thread - t->thread;
+}
+
+static int scale_cmp_numa(const void *a, const void *b) {
+    const scale_cpu_t *s = a, *t = b;
+
+    if (s->node != t->node) {
+        return s->node - t->node;
+    }
+    return scale_cmp_smt(a, b);
+}
+
+/* CPUs in the order the policy hands them out, returns their number */
+static int scale_order(const char *policy, int *order) {
+    static scale_cpu_t cpus[SCALE_MAX_CPUS], by_node[SCALE_MAX_CPUS];
+    int first[SCALE_MAX_CPUS + 1];
+    int next[SCALE_MAX_CPUS + 1];
+    cpu_set_t set;
+    int i, n = 0, m, nnodes, left;
+
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return 0;
+    }
+    for (i = 0; i < CPU_SETSIZE && i < SCALE_MAX_CPUS; i++) {
+        if (!CPU_ISSET(i, &set)) {
+            continue;
+        }
+        cpus[n].cpu     = i;
+        cpus[n].package = scale_read_int(i, "topology/physical_package_id");
+        cpus[n].core    = scale_read_int(i, "topology/core_id");
+        cpus[n].node    = scale_node(i);
+        cpus[n].thread  = scale_thread(i);
+        n++;
+    }
+
+    qsort(cpus, n, sizeof(*cpus), scale_cmp_smt);
+    if (strcmp(policy, "smt") == 0 || strcmp(policy, "none") == 0) {
+        for (i = 0; i < n; i++) {
+            order[i] = cpus[i].cpu;
+        }
+        return n;
+    }
+
+    /* first hardware thread of each core */
+    for (i = 0, m = 0; i < n; i++) {
+        if (cpus[i].thread == 0) {
+            by_node[m++] = cpus[i];
+        }
+    }
+    if (strcmp(policy, "core") == 0) {
+        for (i = 0; i < m; i++) {
+            order[i] = by_node[i].cpu;
+        }
+        return m;
+    }
+
+    /* numa: one core of every node in turn */
+    qsort(by_node, m, sizeof(*by_node), scale_cmp_numa);
+    nnodes = 0;
+    for (i = 0; i < m; i++) {
+        if (i == 0 || by_node[i].node != by_node[i - 1].node) {
+            first[nnodes++] = i;
+        }
+    }
+    first[nnodes] = m;
+    for (i = 0; i < nnodes; i++) {
+        next[i] = first[i];
+    }
+    for (n = 0, left = m; left > 0; ) {
+        for (i = 0; i < nnodes; i++) {
+            if (next[i] < first[i + 1]) {
+                order[n++] = by_node[next[i]++].cpu;
+                left--;
+            }
+        }
+    }
+    return n;
+}
+
+static int scale_valid_policy(const char *policy) {
+    return strcmp(policy, "core") == 0 || strcmp(policy, "smt") == 0 ||
+           strcmp(policy, "numa") == 0 || strcmp(policy, "none") == 0;
+}
+
+/* started on every PE by the launcher: pin, then run the program */
+static int scale_wrap(const char *policy, char **argv) {
+    static int order[SCALE_MAX_CPUS];
+    const char *value = NULL;
+    cpu_set_t set;
+    int i, n, rank;
+
+    if (strcmp(policy, "none") != 0) {
+        for (i = 0; scale_rank_vars[i] != NULL && value == NULL; i++) {
+            value = getenv(scale_rank_vars[i]);
+        }
+        n = scale_order(policy, order);
+        if (value == NULL || n == 0) {
+            fprintf(stderr, "scale: cannot find the local rank or the CPUs "
+                    "of this PE, it is not pinned\n");
+        } else {
+            rank = atoi(value);
+            if (rank == n) {
+                fprintf(stderr, "scale: more PEs than the %d CPUs of the %s "
+                        "policy, CPUs are oversubscribed\n", n, policy);
+            }
+            CPU_ZERO(&set);
+            CPU_SET(order[rank % n], &set);
+            if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+                perror("scale: sched_setaffinity");
+            }
+        }
+    }
+
+    execvp(argv[0], argv);
+    perror(argv[0]);
+    return 127;
+}
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/* one run of the program on npes PEs, returns its exit status */
+static int scale_run(const char *launcher, int npes, const char *policy,
+                     char **program, const char *out) {
+    char command[4096], self[4096], *args[SCALE_MAX_ARGS], *s;
+    int n = 0, status;
+    ssize_t len;
+    pid_t pid;
+
+    len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        perror("scale: /proc/self/exe");
+        return -1;
+    }
+    self[len] = '\0';
+
+    snprintf(command, sizeof(command), launcher, npes);
+    for (s = strtok(command, " "); s != NULL && n < SCALE_MAX_ARGS - 4;
+         s = strtok(NULL, " ")) {
+        args[n++] = s;
+    }
+    args[n++] = self;
+    args[n++] = "-w";
+    args[n++] = (char *) policy;
+    for (; *program != NULL && n < SCALE_MAX_ARGS - 1; program++) {
+        args[n++] = *program;
+    }
+    args[n] = NULL;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) {
+        perror("scale: fork");
+        return -1;
+    }
+    if (pid == 0) {
+        if (freopen(out, "a", stdout) == NULL ||
+            dup2(fileno(stdout), fileno(stderr)) < 0) {
+            perror(out);
+            _exit(127);
+        }
+        execvp(args[0], args);
+        perror(args[0]);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0) {
+        return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: scale [-l launcher] [-n counts] [-p policy] "
+            "[-r repeats] [-o prefix] [-f] program [args]...\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    static int order[SCALE_MAX_CPUS];
+    const char *launcher = "aprun -n %d -cc none";
+    const char *policy = "core";
+    const char *prefix = "scale";
+    char *list = NULL, *s, out[4096];
+    int counts[SCALE_MAX_COUNTS];
+    int ncounts = 0, repeats = 1, force = 0;
+    int c, i, r, ncpus, status, failed;
+    double t, t_min, t_max, t_sum;
+
+    if (argc > 2 && strcmp(argv[1], "-w") == 0) {
+        if (!scale_valid_policy(argv[2]) || argc < 4) {
+            usage();
+        }
+        return scale_wrap(argv[2], argv + 3);
+    }
+
+    while ((c = getopt(argc, argv, "+l:n:p:r:o:f")) != -1) {
+        switch (c) {
+        case 'l': launcher = optarg; break;
+        case 'n': list = optarg; break;
+        case 'p': policy = optarg; break;
+        case 'r': repeats = atoi(optarg); break;
+        case 'o': prefix = optarg; break;
+        case 'f': force = 1; break;
+        default:  usage();
+        }
+    }
+    if (optind >= argc || !scale_valid_policy(policy) || repeats < 1) {
+        usage();
+    }
+
+    ncpus = scale_order(policy, order);
+    if (list != NULL) {
+        for (s = strtok(list, ","); s != NULL && ncounts < SCALE_MAX_COUNTS;
+             s = strtok(NULL, ",")) {
+            counts[ncounts++] = atoi(s);
+        }
+    } else {
+        for (c = 1; c <= ncpus && ncounts < SCALE_MAX_COUNTS; c *= 2) {
+            counts[ncounts++] = c;
+        }
+    }
+
+    printf("%d CPUs with policy %s, launcher \"%s\"\n", ncpus, policy,
+           launcher);
+    printf("%8s %8s %12s %12s %12s %8s\n", "npes", "per cpu", "min s",
+           "mean s", "max s", "status");
+
+    for (i = 0; i < ncounts; i++) {
+        if (counts[i] > ncpus && !force) {
+            printf("%8d oversubscribes %d CPUs, skipped (use -f)\n",
+                   counts[i], ncpus);
+            continue;
+        }
+        snprintf(out, sizeof(out), "%s.%d.out", prefix, counts[i]);
+        remove(out);
+
+        failed = 0;
+        t_min = 1.0e30;
+        t_max = t_sum = 0.0;
+        for (r = 0; r < repeats; r++) {
+            t = wtime();
+            status = scale_run(launcher, counts[i], policy, argv + optind,
+                               out);
+            t = wtime() - t;
+            if (status != 0) {
+                failed = status;
+            }
+            t_min = (t < t_min) ? t : t_min;
+            t_max = (t > t_max) ? t : t_max;
+            t_sum += t;
+        }
+        printf("%8d %8d %12.3f %12.3f %12.3f %8d\n", counts[i],
+               (counts[i] + ncpus - 1) / (ncpus ? ncpus : 1), t_min,
+               t_sum / repeats, t_max, failed);
+        fflush(stdout);
+    }
+    return 0;
+}
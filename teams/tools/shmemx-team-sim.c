@@ -0,0 +1,880 @@
+/*
+ * Program to predict the latency of team collectives at scale
+ *
+ * SYNOPSIS:
+ * ./sim fit [params]
+ *
+ * ./sim predict [-p params] [-a algorithm] [-n counts] [-b sizes]
+ *               [-s stride]
+ *
+ * ./sim trace   [-p params] -a algorithm -n npes -b bytes [-s stride]
+ *
+ * ./sim replay  [-p params] trace
+ *
+ * DESCRIPTION:
+ * The team collectives can only be timed on the machine sizes a test
+ * allocation provides, while the choice of algorithm and decomposition
+ * for a full system run depends on how they behave on 100,000 PEs and
+ * more. This program predicts that behavior from a model of the network
+ * fitted on a few PEs.
+ *
+ * The network is described by two sets of LogGP parameters, one for
+ * PEs on the same node and one for PEs on different nodes: the latency
+ * L, the CPU overhead o of sending or receiving a message, the gap g
+ * between two messages of a PE and the gap G per byte of a long message.
+ * A message of k bytes sent at time t occupies the sender until t + o,
+ * arrives at t + o + L + (k-1)G, and occupies the receiver for o once it
+ * has arrived and the receiver is ready. A PE starts a new message at
+ * the earliest g, and (k-1)G, after the previous one. Combining k bytes
+ * of a reduction costs k gamma. PEs are placed ppn to a node in order.
+ *
+ * fit measures these parameters and writes them to params, team_sim.txt
+ * unless another path is given. It is a SHMEM program and is started
+ * with the launcher on at least two nodes, or on one node to fit the
+ * same node parameters only. PE 0 and the nearest PE on its node, then
+ * on another node, exchange messages of 8 bytes to 64 KB with puts and
+ * a flag. Half the round trip time is fitted to L + 2o + (k-1)G, the
+ * issue rate of short puts gives o and g, and a local sum gives gamma.
+ *
+ * The other modes run on a single PE without the launcher. A collective
+ * is described by its schedule: the sequence of sends, receives and
+ * combines of every PE of the team, generated from the definitions of
+ * the algorithms below, the ones implemented in this directory and in
+ * ../perf. The schedule is replayed event by event with the model, and
+ * the latency is the time the last PE finishes. trace writes the
+ * schedule of one case as text, one operation per line:
+ *
+ *     pe send|recv|comp peer bytes
+ *
+ * so that schedules recorded from instrumented runs, or written by hand,
+ * can be replayed with replay. predict prints the predicted latency and
+ * message count of every algorithm, or of the one given, for every team
+ * size and message size. The team is made of every stride-th PE, 1 by
+ * default, which changes how many of its messages stay on a node.
+ *
+ * The algorithms are:
+ *
+ * rdbl
+ *          Recursive doubling all-reduce, with the PEs beyond the
+ *          largest power of two folded in pairs.
+ *
+ * ring
+ *          Ring reduce-scatter and allgather. Beyond SIM_MAX_OPS
+ *          operations, its schedule is evaluated in closed form.
+ *
+ * tree
+ *          Binomial tree reduction to team PE 0 and binomial broadcast.
+ *
+ * grid
+ *          Recursive doubling along the xaxis_team and then the
+ *          yaxis_team of a two dimensional grid whose x dimension is the
+ *          number of PEs per node, as in ../perf/shmemx-team-grid.c. When
+ *          that does not divide the team into several nodes, it is the
+ *          largest divisor of the team size not above its square root.
+ *
+ * barrier
+ *          Dissemination barrier, message size ignored.
+ *
+ * split
+ *          The exchange of color and key by shmemx_team_split_color,
+ *          modeled as a Bruck allgather of 8 bytes per PE followed by
+ *          sorting, message size ignored.
+ *
+ * The options are:
+ *
+ * -p params
+ *          Parameter file written by fit. Without it, typical values for
+ *          a current network are used.
+ *
+ * -a algorithm
+ *          One of the algorithms above, or all.
+ *
+ * -n counts, -b sizes
+ *          Comma separated team sizes and message sizes in bytes.
+ *
+ * -s stride
+ *          Distance between the PEs of the team.
+ *
+ * EXAMPLE DETAILS:
+ *     aprun -n 64 -N 32 ./sim fit team_sim.txt
+ *     ./sim predict -p team_sim.txt -n 1024,16384,131072 -b 8,65536
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+
+#define SIM_MAX_OPS     50000000L
+#define SIM_MAX_LIST    64
+#define SIM_FIT_MAX     65536
+#define SIM_FIT_ITER    200
+#define SIM_FIT_NPUT    1000
+
+enum { SIM_SEND, SIM_RECV, SIM_COMP };
+
+static const char *sim_op_names[] = { "send", "recv", "comp" };
+
+typedef struct {
+    double L, o, g, G;
+} sim_loggp_t;
+
+typedef struct {
+    sim_loggp_t intra;
+    sim_loggp_t inter;
+    double      gamma;
+    int         ppn;
+} sim_params_t;
+
+typedef struct {
+    int  type;
+    int  peer;
+    long bytes;
+} sim_op_t;
+
+typedef struct sim_msg {
+    int             src;
+    double          arrival;
+    struct sim_msg *next;
+} sim_msg_t;
+
+typedef struct {
+    int        npes;
+    int        stride;
+    long       nops;
+    int       *count;
+    int       *max;
+    sim_op_t **ops;
+} sim_sched_t;
+
+typedef struct {
+    double latency;
+    long   messages;
+    long   bytes;
+    int    analytic;
+} sim_result_t;
+
+static sim_params_t sim_params = {
+    { 0.3e-6, 0.1e-6, 0.1e-6, 0.05e-9 },
+    { 1.5e-6, 0.3e-6, 0.3e-6, 0.10e-9 },
+    0.1e-9,
+    32
+};
+
+/* ------------------------------------------------------------------ */
+/* schedules                                                          */
+
+static void sim_sched_init(sim_sched_t *s, int npes, int stride) {
+    s->npes   = npes;
+    s->stride = stride;
+    s->nops   = 0;
+    s->count  = calloc(npes, sizeof(int));
+    s->max    = calloc(npes, sizeof(int));
+    s->ops    = calloc(npes, sizeof(sim_op_t *));
+    if (s->count == NULL || s->max == NULL || s->ops == NULL) {
+        fprintf(stderr, "sim: out of memory for %d PEs\n", npes);
+        exit(1);
+    }
+}
+
+static void sim_sched_free(sim_sched_t *s) {
+    int i;
+
+    for (i = 0; i < s->npes; i++) {
+        free(s->ops[i]);
+    }
+    free(s->ops);
+    free(s->max);
+    free(s->count);
+}
+
+static void sim_add(sim_sched_t *s, int pe, int type, int peer, long bytes) {
+    sim_op_t *op;
+
+    if (s->count[pe] == s->max[pe]) {
+        s->max[pe] = s->max[pe] ? 2 * s->max[pe] : 16;
+        s->ops[pe] = realloc(s->ops[pe], s->max[pe] * sizeof(sim_op_t));
+        if (s->ops[pe] == NULL) {
+            fprintf(stderr, "sim: out of memory for the schedule\n");
+            exit(1);
+        }
+    }
+    op = &s->ops[pe][s->count[pe]++];
+    op->type  = type;
+    op->peer  = peer;
+    op->bytes = bytes;
+    s->nops++;
+}
+
+/* recursive doubling over the k team PEs in members */
+static void sim_gen_rdbl(sim_sched_t *s, const int *members, int k,
+                         long bytes) {
+    int i, p2, mask;
+
+    for (p2 = 1; p2 * 2 <= k; p2 *= 2)
+        ;
+    for (i = p2; i < k; i++) {
+        sim_add(s, members[i], SIM_SEND, members[i - p2], bytes);
+        sim_add(s, members[i - p2], SIM_RECV, members[i], bytes);
+        sim_add(s, members[i - p2], SIM_COMP, -1, bytes);
+    }
+    for (mask = 1; mask < p2; mask *= 2) {
+        for (i = 0; i < p2; i++) {
+            sim_add(s, members[i], SIM_SEND, members[i ^ mask], bytes);
+            sim_add(s, members[i], SIM_RECV, members[i ^ mask], bytes);
+            sim_add(s, members[i], SIM_COMP, -1, bytes);
+        }
+    }
+    for (i = p2; i < k; i++) {
+        sim_add(s, members[i - p2], SIM_SEND, members[i], bytes);
+        sim_add(s, members[i], SIM_RECV, members[i - p2], bytes);
+    }
+}
+
+static void sim_gen_ring(sim_sched_t *s, int k, long bytes) {
+    long chunk = (bytes + k - 1) / k;
+    int i, step;
+
+    for (step = 0; step < 2 * (k - 1); step++) {
+        for (i = 0; i < k; i++) {
+            sim_add(s, i, SIM_SEND, (i + 1) % k, chunk);
+            sim_add(s, i, SIM_RECV, (i + k - 1) % k, chunk);
+            if (step < k - 1) {
+                sim_add(s, i, SIM_COMP, -1, chunk);
+            }
+        }
+    }
+}
+
+static void sim_gen_tree(sim_sched_t *s, int k, long bytes) {
+    int i, mask;
+
+    for (i = 0; i < k; i++) {
+        for (mask = 1; mask < k; mask *= 2) {
+            if (i & mask) {
+                sim_add(s, i, SIM_SEND, i - mask, bytes);
+                break;
+            }
+            if (i + mask < k) {
+                sim_add(s, i, SIM_RECV, i + mask, bytes);
+                sim_add(s, i, SIM_COMP, -1, bytes);
+            }
+        }
+    }
+    for (mask = 1; mask < k; mask *= 2)
+        ;
+    for (mask /= 2; mask >= 1; mask /= 2) {
+        for (i = 0; i < k; i += 2 * mask) {
+            if (i + mask < k) {
+                sim_add(s, i, SIM_SEND, i + mask, bytes);
+                sim_add(s, i + mask, SIM_RECV, i, bytes);
+            }
+        }
+    }
+}
+
+static void sim_gen_grid(sim_sched_t *s, int k, long bytes, int ppn) {
+    int *members = malloc(k * sizeof(int));
+    int x, y, i, xrange = 1;
+
+    if (ppn > 1 && ppn < k && k % ppn == 0) {
+        xrange = ppn;
+    } else {
+        for (i = 1; i * i <= k; i++) {
+            if (k % i == 0) {
+                xrange = i;
+            }
+        }
+    }
+    for (y = 0; y < k / xrange; y++) {
+        for (x = 0; x < xrange; x++) {
+            members[x] = y * xrange + x;
+        }
+        sim_gen_rdbl(s, members, xrange, bytes);
+    }
+    for (x = 0; x < xrange; x++) {
+        for (y = 0; y < k / xrange; y++) {
+            members[y] = y * xrange + x;
+        }
+        sim_gen_rdbl(s, members, k / xrange, bytes);
+    }
+    free(members);
+}
+
+static void sim_gen_barrier(sim_sched_t *s, int k) {
+    int i, d;
+
+    for (d = 1; d < k; d *= 2) {
+        for (i = 0; i < k; i++) {
+            sim_add(s, i, SIM_SEND, (i + d) % k, 8);
+            sim_add(s, i, SIM_RECV, (i + k - d) % k, 8);
+        }
+    }
+}
+
+static void sim_gen_split(sim_sched_t *s, int k) {
+    int i, d;
+    long n;
+
+    for (d = 1; d < k; d *= 2) {
+        n = ((d < k - d) ? d : k - d) * 8L;
+        for (i = 0; i < k; i++) {
+            sim_add(s, i, SIM_SEND, (i + k - d) % k, n);
+            sim_add(s, i, SIM_RECV, (i + d) % k, n);
+        }
+    }
+    for (i = 0; i < k; i++) {
+        sim_add(s, i, SIM_COMP, -1, 8L * k);
+    }
+}
+
+/* estimated number of operations, to refuse schedules too large */
+static double sim_estimate(const char *alg, int k) {
+    double logk = 1;
+    int d;
+
+    for (d = 1; d < k; d *= 2) {
+        logk++;
+    }
+    if (strcmp(alg, "ring") == 0) {
+        return 6.0 * k * (k - 1);
+    }
+    return 6.0 * k * logk + k;
+}
+
+static int sim_generate(sim_sched_t *s, const char *alg, int k, long bytes) {
+    int *members, i;
+
+    if (strcmp(alg, "rdbl") == 0) {
+        members = malloc(k * sizeof(int));
+        for (i = 0; i < k; i++) {
+            members[i] = i;
+        }
+        sim_gen_rdbl(s, members, k, bytes);
+        free(members);
+    } else if (strcmp(alg, "ring") == 0) {
+        sim_gen_ring(s, k, bytes);
+    } else if (strcmp(alg, "tree") == 0) {
+        sim_gen_tree(s, k, bytes);
+    } else if (strcmp(alg, "grid") == 0) {
+        sim_gen_grid(s, k, bytes, sim_params.ppn);
+    } else if (strcmp(alg, "barrier") == 0) {
+        sim_gen_barrier(s, k);
+    } else if (strcmp(alg, "split") == 0) {
+        sim_gen_split(s, k);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* replay                                                             */
+
+static const sim_loggp_t *sim_link(const sim_sched_t *s, int a, int b) {
+    long pa = (long) a * s->stride, pb = (long) b * s->stride;
+
+    return (pa / sim_params.ppn == pb / sim_params.ppn) ? &sim_params.intra
+                                                        : &sim_params.inter;
+}
+
+static sim_result_t sim_replay(sim_sched_t *s) {
+    sim_result_t r = { 0.0, 0, 0, 0 };
+    double *clock = calloc(s->npes, sizeof(double));
+    double *nic   = calloc(s->npes, sizeof(double));
+    int    *next  = calloc(s->npes, sizeof(int));
+    int    *wait  = malloc(s->npes * sizeof(int));
+    int    *ready = malloc(s->npes * sizeof(int));
+    sim_msg_t **inbox = calloc(s->npes, sizeof(sim_msg_t *));
+    sim_msg_t *m, **pm;
+    const sim_loggp_t *p;
+    sim_op_t *op;
+    int i, pe, nready = 0, done = 0;
+    double start;
+
+    for (i = 0; i < s->npes; i++) {
+        wait[i] = -1;
+        ready[nready++] = i;
+    }
+
+    while (nready > 0) {
+        pe = ready[--nready];
+        while (next[pe] < s->count[pe]) {
+            op = &s->ops[pe][next[pe]];
+            if (op->type == SIM_SEND) {
+                p = sim_link(s, pe, op->peer);
+                start = (clock[pe] > nic[pe]) ? clock[pe] : nic[pe];
+                clock[pe] = start + p->o;
+                nic[pe] = start + ((p->g > p->o) ? p->g : p->o) +
+                          (op->bytes - 1) * p->G;
+
+                m = malloc(sizeof(*m));
+                m->src = pe;
+                m->arrival = start + p->o + p->L + (op->bytes - 1) * p->G;
+                m->next = NULL;
+                for (pm = &inbox[op->peer]; *pm != NULL; pm = &(*pm)->next)
+                    ;
+                *pm = m;
+                if (wait[op->peer] == pe) {
+                    wait[op->peer] = -1;
+                    ready[nready++] = op->peer;
+                }
+                r.messages++;
+                r.bytes += op->bytes;
+            } else if (op->type == SIM_RECV) {
+                for (pm = &inbox[pe]; *pm != NULL && (*pm)->src != op->peer;
+                     pm = &(*pm)->next)
+                    ;
+                if (*pm == NULL) {
+                    wait[pe] = op->peer;
+                    break;
+                }
+                m = *pm;
+                *pm = m->next;
+                p = sim_link(s, op->peer, pe);
+                clock[pe] = ((clock[pe] > m->arrival) ? clock[pe]
+                                                      : m->arrival) + p->o;
+                free(m);
+            } else {
+                clock[pe] += op->bytes * sim_params.gamma;
+            }
+            next[pe]++;
+        }
+        if (next[pe] == s->count[pe]) {
+            done++;
+            if (clock[pe] > r.latency) {
+                r.latency = clock[pe];
+            }
+        }
+    }
+
+    if (done < s->npes) {
+        fprintf(stderr, "sim: schedule deadlocks, %d of %d PEs finished\n",
+                done, s->npes);
+        r.latency = -1.0;
+    }
+    for (i = 0; i < s->npes; i++) {
+        while ((m = inbox[i]) != NULL) {
+            inbox[i] = m->next;
+            free(m);
+        }
+    }
+    free(inbox);
+    free(ready);
+    free(wait);
+    free(next);
+    free(nic);
+    free(clock);
+    return r;
+}
+
+/* the ring in closed form, every step paced by the slowest link */
+static sim_result_t sim_ring_analytic(int k, long bytes, int stride) {
+    sim_result_t r;
+    long chunk = (bytes + k - 1) / k;
+    const sim_loggp_t *p = ((long) k * stride > sim_params.ppn)
+                           ? &sim_params.inter : &sim_params.intra;
+    double step = 2 * p->o + p->L + (chunk - 1) * p->G;
+
+    if (p->g > step) {
+        step = p->g;
+    }
+    r.latency  = 2.0 * (k - 1) * step + (k - 1) * chunk * sim_params.gamma;
+    r.messages = 2L * (k - 1) * k;
+    r.bytes    = r.messages * chunk;
+    r.analytic = 1;
+    return r;
+}
+
+static sim_result_t sim_predict(const char *alg, int k, long bytes,
+                                int stride) {
+    sim_result_t r = { -1.0, 0, 0, 0 };
+    sim_sched_t s;
+
+    if (sim_estimate(alg, k) > SIM_MAX_OPS) {
+        if (strcmp(alg, "ring") == 0) {
+            return sim_ring_analytic(k, bytes, stride);
+        }
+        return r;
+    }
+    sim_sched_init(&s, k, stride);
+    if (sim_generate(&s, alg, k, bytes) == 0) {
+        r = sim_replay(&s);
+    }
+    sim_sched_free(&s);
+    return r;
+}
+
+/* ------------------------------------------------------------------ */
+/* parameters                                                         */
+
+static int sim_load(const char *path) {
+    char line[256], key[32];
+    sim_loggp_t p;
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#') {
+            continue;
+        }
+        if (sscanf(line, "%31s %lf %lf %lf %lf", key, &p.L, &p.o, &p.g,
+                   &p.G) == 5) {
+            if (strcmp(key, "intra") == 0) {
+                sim_params.intra = p;
+            } else if (strcmp(key, "inter") == 0) {
+                sim_params.inter = p;
+            }
+        } else if (sscanf(line, "gamma %lf", &sim_params.gamma) == 1) {
+            continue;
+        } else if (sscanf(line, "ppn %d", &sim_params.ppn) == 1) {
+            continue;
+        }
+    }
+    fclose(f);
+    if (sim_params.ppn < 1) {
+        sim_params.ppn = 1;
+    }
+    return 0;
+}
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+char sim_buf[SIM_FIT_MAX];
+long sim_flag;
+long sim_host;
+long sim_intra, sim_inter;
+
+/* keeps the timed local sum from being optimized away */
+static volatile double sim_sink;
+
+static long sim_host_id(void) {
+    char name[256];
+    unsigned long h = 5381;
+    char *c;
+
+    if (gethostname(name, sizeof(name)) != 0) {
+        return 0;
+    }
+    name[sizeof(name) - 1] = '\0';
+    for (c = name; *c; c++) {
+        h = h * 33 + (unsigned char) *c;
+    }
+    return (long) (h & 0x7fffffffffffL);
+}
+
+/* half round trip times between PE 0 and partner, fitted to a + b k */
+static void sim_fit_link(int partner, sim_loggp_t *p) {
+    int me = shmem_my_pe();
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, t, a, b, issue = 0.0;
+    long k, seq = 0;
+    int i, n = 0;
+
+    for (k = 8; k <= SIM_FIT_MAX; k *= 4) {
+        shmem_barrier_all();
+        t = wtime();
+        for (i = 0; i < SIM_FIT_ITER; i++) {
+            if (me == 0) {
+                shmem_putmem(sim_buf, sim_buf, k, partner);
+                shmem_fence();
+                shmem_long_p(&sim_flag, ++seq, partner);
+                shmem_long_wait_until(&sim_flag, SHMEM_CMP_EQ, seq);
+            } else if (me == partner) {
+                shmem_long_wait_until(&sim_flag, SHMEM_CMP_EQ, ++seq);
+                shmem_putmem(sim_buf, sim_buf, k, 0);
+                shmem_fence();
+                shmem_long_p(&sim_flag, seq, 0);
+            }
+        }
+        t = (wtime() - t) / SIM_FIT_ITER / 2;
+        sx += k;
+        sy += t;
+        sxx += (double) k * k;
+        sxy += k * t;
+        n++;
+    }
+    b = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    a = (sy - b * sx) / n;
+
+    shmem_barrier_all();
+    if (me == 0) {
+        t = wtime();
+        for (i = 0; i < SIM_FIT_NPUT; i++) {
+            shmem_putmem(sim_buf, sim_buf, 8, partner);
+        }
+        shmem_quiet();
+        issue = (wtime() - t) / SIM_FIT_NPUT;
+    }
+    shmem_barrier_all();
+
+    p->G = (b > 0) ? b : 0;
+    p->o = issue;
+    p->g = issue;
+    p->L = a - 2 * p->o + p->G;
+    if (p->L < 0) {
+        p->L = 0;
+    }
+}
+
+static int sim_fit(const char *path) {
+    int me, npes, i, intra = -1, inter = -1, ppn = 1;
+    double *x, t;
+    sim_loggp_t p;
+    FILE *f;
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+    if (npes < 2) {
+        if (me == 0) {
+            fprintf(stderr, "sim fit: needs at least 2 PEs\n");
+        }
+        shmem_finalize();
+        return 1;
+    }
+
+    sim_host = sim_host_id();
+    shmem_barrier_all();
+    if (me == 0) {
+        for (i = 1; i < npes; i++) {
+            if (shmem_long_g(&sim_host, i) == sim_host) {
+                ppn++;
+                if (intra < 0) {
+                    intra = i;
+                }
+            } else if (inter < 0) {
+                inter = i;
+            }
+        }
+    }
+    if (me == 0) {
+        sim_intra = intra;
+        sim_inter = inter;
+    }
+    shmem_barrier_all();
+    intra = (int) shmem_long_g(&sim_intra, 0);
+    inter = (int) shmem_long_g(&sim_inter, 0);
+
+    if (intra > 0) {
+        sim_fit_link(intra, &sim_params.intra);
+    }
+    if (inter > 0) {
+        sim_fit_link(inter, &sim_params.inter);
+    } else if (me == 0) {
+        printf("sim fit: all PEs on one node, inter node parameters not "
+               "fitted\n");
+    }
+
+    if (me == 0) {
+        x = malloc(SIM_FIT_MAX * sizeof(double));
+        for (i = 0; i < SIM_FIT_MAX; i++) {
+            x[i] = i;
+        }
+        t = wtime();
+        for (i = 1; i < SIM_FIT_MAX; i++) {
+            x[i] += x[i - 1];
+        }
+        sim_params.gamma = (wtime() - t) / (SIM_FIT_MAX * sizeof(double));
+        sim_sink = x[SIM_FIT_MAX - 1];
+        free(x);
+        sim_params.ppn = ppn;
+
+        f = fopen(path, "w");
+        if (f == NULL) {
+            perror(path);
+        } else {
+            fprintf(f, "# link L o g G, in seconds and seconds per byte\n");
+            p = sim_params.intra;
+            fprintf(f, "intra %.4e %.4e %.4e %.4e\n", p.L, p.o, p.g, p.G);
+            p = sim_params.inter;
+            fprintf(f, "inter %.4e %.4e %.4e %.4e\n", p.L, p.o, p.g, p.G);
+            fprintf(f, "gamma %.4e\n", sim_params.gamma);
+            fprintf(f, "ppn %d\n", sim_params.ppn);
+            fclose(f);
+            printf("parameters written to %s\n", path);
+        }
+    }
+
+    shmem_barrier_all();
+    shmem_finalize();
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* main                                                               */
+
+static int sim_list(char *arg, long *values, int max) {
+    int n = 0;
+    char *s;
+
+    for (s = strtok(arg, ","); s != NULL && n < max; s = strtok(NULL, ",")) {
+        values[n++] = atol(s);
+    }
+    return n;
+}
+
+static int sim_trace(const char *alg, int k, long bytes, int stride) {
+    sim_sched_t s;
+    int i, j;
+
+    sim_sched_init(&s, k, stride);
+    if (sim_generate(&s, alg, k, bytes) != 0) {
+        fprintf(stderr, "sim: unknown algorithm %s\n", alg);
+        return 1;
+    }
+    printf("# %s npes %d bytes %ld stride %d\n", alg, k, bytes, stride);
+    for (i = 0; i < k; i++) {
+        for (j = 0; j < s.count[i]; j++) {
+            printf("%d %s %d %ld\n", i, sim_op_names[s.ops[i][j].type],
+                   s.ops[i][j].peer, s.ops[i][j].bytes);
+        }
+    }
+    sim_sched_free(&s);
+    return 0;
+}
+
+static int sim_replay_file(const char *path, int stride) {
+    char line[256], op[16];
+    int pe, peer, npes = 0, type, pass;
+    long bytes;
+    sim_sched_t s;
+    sim_result_t r;
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL) {
+        perror(path);
+        return 1;
+    }
+    /* the first pass finds the number of PEs */
+    for (pass = 0; pass < 2; pass++) {
+        rewind(f);
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (line[0] == '#' ||
+                sscanf(line, "%d %15s %d %ld", &pe, op, &peer, &bytes) != 4) {
+                continue;
+            }
+            if (pass == 0) {
+                npes = (pe + 1 > npes) ? pe + 1 : npes;
+                npes = (peer + 1 > npes) ? peer + 1 : npes;
+                continue;
+            }
+            for (type = 0; type < 3; type++) {
+                if (strcmp(op, sim_op_names[type]) == 0) {
+                    sim_add(&s, pe, type, peer, bytes);
+                }
+            }
+        }
+        if (pass == 0) {
+            sim_sched_init(&s, npes, stride);
+        }
+    }
+    fclose(f);
+
+    r = sim_replay(&s);
+    printf("%s: %d PEs, %ld messages, %ld bytes, %.3f us\n", path, npes,
+           r.messages, r.bytes, r.latency * 1.0e6);
+    sim_sched_free(&s);
+    return r.latency < 0;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: sim fit [params]\n"
+            "       sim predict [-p params] [-a alg] [-n counts] [-b sizes] "
+            "[-s stride]\n"
+            "       sim trace [-p params] -a alg -n npes -b bytes "
+            "[-s stride]\n"
+            "       sim replay [-p params] [-s stride] trace\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    static const char *algs[] = {
+        "rdbl", "ring", "tree", "grid", "barrier", "split", NULL
+    };
+    long counts[SIM_MAX_LIST] = { 16, 1024, 16384, 131072 };
+    long sizes[SIM_MAX_LIST] = { 8, 1024, 65536 };
+    int ncounts = 4, nsizes = 3, stride = 1;
+    const char *alg = "all", *mode;
+    int c, a, i, j;
+    sim_result_t r;
+
+    if (argc < 2) {
+        usage();
+    }
+    mode = argv[1];
+    if (strcmp(mode, "fit") == 0) {
+        return sim_fit((argc > 2) ? argv[2] : "team_sim.txt");
+    }
+
+    optind = 2;
+    while ((c = getopt(argc, argv, "p:a:n:b:s:")) != -1) {
+        switch (c) {
+        case 'p':
+            if (sim_load(optarg) != 0) {
+                return 1;
+            }
+            break;
+        case 'a': alg = optarg; break;
+        case 'n': ncounts = sim_list(optarg, counts, SIM_MAX_LIST); break;
+        case 'b': nsizes = sim_list(optarg, sizes, SIM_MAX_LIST); break;
+        case 's': stride = atoi(optarg); break;
+        default:  usage();
+        }
+    }
+    if (stride < 1) {
+        usage();
+    }
+
+    if (strcmp(mode, "trace") == 0) {
+        if (strcmp(alg, "all") == 0) {
+            usage();
+        }
+        return sim_trace(alg, (int) counts[0], sizes[0], stride);
+    }
+    if (strcmp(mode, "replay") == 0) {
+        if (optind >= argc) {
+            usage();
+        }
+        return sim_replay_file(argv[optind], stride);
+    }
+    if (strcmp(mode, "predict") != 0) {
+        usage();
+    }
+
+    printf("%-8s %8s %10s %14s %12s\n", "alg", "npes", "bytes",
+           "latency us", "messages");
+    for (a = 0; algs[a] != NULL; a++) {
+        if (strcmp(alg, "all") != 0 && strcmp(alg, algs[a]) != 0) {
+            continue;
+        }
+        for (i = 0; i < ncounts; i++) {
+            for (j = 0; j < nsizes; j++) {
+                if (j > 0 && (strcmp(algs[a], "barrier") == 0 ||
+                              strcmp(algs[a], "split") == 0)) {
+                    break;
+                }
+                r = sim_predict(algs[a], (int) counts[i], sizes[j], stride);
+                if (r.latency < 0) {
+                    printf("%-8s %8ld %10ld %14s\n", algs[a], counts[i],
+                           sizes[j], "too large");
+                    continue;
+                }
+                printf("%-8s %8ld %10ld %14.3f %12ld%s\n", algs[a],
+                       counts[i], sizes[j], r.latency * 1.0e6, r.messages,
+                       r.analytic ? " closed form" : "");
+            }
+        }
+    }
+    return 0;
+}
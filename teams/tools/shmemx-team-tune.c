@@ -0,0 +1,610 @@
+/*
+ * Program to tune the algorithm choice of team collectives
+ *
+ * SYNOPSIS:
+ * ./tune [table]
+ *
+ * int         team_tune_load(     const char *path )
+ * int         team_tune_lookup(   const char *op,
+ *                                 const char *datatype,
+ *                                 int         npes,
+ *                                 size_t      nbytes )
+ * const char *team_tune_alg_name( int         alg )
+ *
+ * DESCRIPTION:
+ * The best algorithm for a team reduction or barrier depends on the team
+ * size, the message size, the number of PEs per node and the memory and
+ * network bandwidth of the machine, so the crossover points have to be
+ * measured on every new system. This program does the whole sweep in one
+ * run. It times every available algorithm of the team sum_to_all
+ * routines for int, long, float and double, and of the team barrier,
+ * over a grid of message sizes and team shapes: SHMEM_TEAM_WORLD, the
+ * team of every other PE created with shmemx_team_split_strided, and the
+ * xaxis and yaxis teams of shmemx_team_split_2d. The fastest algorithm
+ * for each case is written to the tuning table, team_tune.txt unless
+ * another path is given on the command line.
+ *
+ * The reduction algorithms are:
+ *
+ * library
+ *          shmemx_team_<datatype>_sum_to_all.
+ *
+ * rdbl
+ *          Recursive doubling, log2(n) exchanges of the whole vector, with
+ *          the PEs beyond the largest power of two folded in pairs.
+ *
+ * ring
+ *          Ring reduce-scatter followed by a ring allgather, 2(n-1) steps
+ *          moving 1/n of the vector each.
+ *
+ * The barrier algorithms are library, a one element
+ * shmemx_team_int_sum_to_all, and dissem, a dissemination barrier of
+ * ceil(log2(n)) rounds of flag puts.
+ *
+ * The table is a text file with one line per case:
+ *
+ *     op type shape npes nbytes best [algorithm usec]...
+ *
+ * Lines starting with # are comments. team_tune_load reads a table
+ * written by this program and returns the number of cases, or -1 if the
+ * file cannot be read. It is meant to be called once after shmem_init by
+ * the routines choosing an algorithm. team_tune_lookup returns the
+ * algorithm measured fastest for op ("to_all" or "barrier") and datatype
+ * on the team size nearest to npes, at the largest measured size not
+ * above nbytes. It returns TUNE_ALG_LIBRARY if nothing matches.
+ * team_tune_alg_name returns the name of an algorithm as written in the
+ * table.
+ *
+ * EXAMPLE DETAILS:
+ * PE 0 writes the table, reads it back with team_tune_load and prints
+ * the algorithm chosen on SHMEM_TEAM_WORLD for every datatype and
+ * message size.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <shmem.h>
+#include <shmemx.h>
+#include "../perf/shmemx-team-map.h"
+
+enum {
+    TUNE_ALG_LIBRARY,
+    TUNE_ALG_RDBL,
+    TUNE_ALG_RING,
+    TUNE_ALG_DISSEM,
+    TUNE_NALGS
+};
+
+static const char *tune_alg_names[TUNE_NALGS] = {
+    "library", "rdbl", "ring", "dissem"
+};
+
+const char *team_tune_alg_name(int alg) {
+    return (alg >= 0 && alg < TUNE_NALGS) ? tune_alg_names[alg] : "unknown";
+}
+
+typedef struct {
+    char   op[16];
+    char   type[16];
+    int    npes;
+    size_t nbytes;
+    int    alg;
+} tune_entry_t;
+
+static tune_entry_t *tune_table;
+static int           tune_entries;
+
+int team_tune_load(const char *path) {
+    char line[512], alg[16];
+    int  a, capacity = 0;
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL) {
+        return -1;
+    }
+    free(tune_table);
+    tune_table   = NULL;
+    tune_entries = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        tune_entry_t e;
+
+        if (line[0] == '#' ||
+            sscanf(line, "%15s %15s %*s %d %zu %15s", e.op, e.type, &e.npes,
+                   &e.nbytes, alg) != 5) {
+            continue;
+        }
+        for (a = 0; a < TUNE_NALGS; a++) {
+            if (strcmp(alg, tune_alg_names[a]) == 0) {
+                break;
+            }
+        }
+        if (a == TUNE_NALGS) {
+            continue;
+        }
+        e.alg = a;
+        if (tune_entries == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            tune_table = realloc(tune_table, capacity * sizeof(*tune_table));
+        }
+        tune_table[tune_entries++] = e;
+    }
+    fclose(f);
+    return tune_entries;
+}
+
+int team_tune_lookup(const char *op, const char *datatype, int npes,
+                     size_t nbytes) {
+    int i, near = -1, best = -1;
+    double dist, near_dist = 0.0;
+
+    /* the measured team size nearest to npes on a log scale */
+    for (i = 0; i < tune_entries; i++) {
+        tune_entry_t *e = &tune_table[i];
+
+        if (strcmp(e->op, op) != 0 ||
+            (strcmp(e->type, "-") != 0 && strcmp(e->type, datatype) != 0)) {
+            continue;
+        }
+        dist = fabs(log((double) e->npes / npes));
+        if (near < 0 || dist < near_dist) {
+            near = e->npes;
+            near_dist = dist;
+        }
+    }
+
+    /* the largest size not above nbytes, or else the smallest size */
+    for (i = 0; i < tune_entries; i++) {
+        tune_entry_t *e = &tune_table[i];
+        tune_entry_t *b = &tune_table[best < 0 ? i : best];
+
+        if (strcmp(e->op, op) != 0 || e->npes != near ||
+            (strcmp(e->type, "-") != 0 && strcmp(e->type, datatype) != 0)) {
+            continue;
+        }
+        if (best < 0 ||
+            (e->nbytes <= nbytes && (b->nbytes > nbytes ||
+                                     e->nbytes > b->nbytes)) ||
+            (e->nbytes > nbytes && b->nbytes > nbytes &&
+             e->nbytes < b->nbytes)) {
+            best = i;
+        }
+    }
+    return (best < 0) ? TUNE_ALG_LIBRARY : tune_table[best].alg;
+}
+
+#define TUNE_MAX_BYTES  (1 << 18)
+#define TUNE_NREP       10
+#define TUNE_NWARM      2
+#define TUNE_NTYPES     4
+#define TUNE_NSHAPES    4
+
+#define MAX(a, b) ((a > b) ? a : b)
+
+typedef void (*team_combine_fn)(void *inout, const void *in, int n);
+
+#define DEFINE_SUM(TYPE, NAME)                                               \
+static void NAME##_sum_combine(void *inout, const void *in, int n) {        \
+    TYPE *a = inout;                                                         \
+    const TYPE *b = in;                                                      \
+    int i;                                                                   \
+    for (i = 0; i < n; i++) {                                                \
+        a[i] += b[i];                                                        \
+    }                                                                        \
+}
+
+DEFINE_SUM(int, int)
+DEFINE_SUM(long, long)
+DEFINE_SUM(float, float)
+DEFINE_SUM(double, double)
+
+static struct {
+    const char     *name;
+    size_t          size;
+    team_combine_fn combine;
+} tune_types[TUNE_NTYPES] = {
+    { "int",    sizeof(int),    int_sum_combine },
+    { "long",   sizeof(long),   long_sum_combine },
+    { "float",  sizeof(float),  float_sum_combine },
+    { "double", sizeof(double), double_sum_combine }
+};
+
+/*
+ * Flags and receive slots of the tuned algorithms, one set per call
+ * parity. Every step of a call has its own slot, so a PE can never be
+ * overwritten by a partner running ahead: the partner cannot finish the
+ * next call of the same parity before this PE has joined the call in
+ * between.
+ */
+static char  *tune_buf;
+static size_t tune_half;
+static long  *tune_flags;
+static int    tune_nflags;
+static long   tune_seq;
+
+#define TUNE_FLAG(par, slot)        (&tune_flags[(par) * tune_nflags + (slot)])
+#define TUNE_SLOT(par, slot, bytes) \
+    (tune_buf + (par) * tune_half + (size_t) (slot) * (bytes))
+
+long tune_pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+static int tune_pSync_idx;
+
+static void tune_send(void *dest, const void *src, size_t bytes, int par,
+                      int slot, int pe) {
+    shmem_putmem(dest, src, bytes, pe);
+    shmem_fence();
+    shmem_long_p(TUNE_FLAG(par, slot), tune_seq, pe);
+}
+
+static void tune_wait(int par, int slot) {
+    shmem_long_wait_until(TUNE_FLAG(par, slot), SHMEM_CMP_EQ, tune_seq);
+}
+
+static void tune_rdbl(int *pe_map, int t_pe, int t_size, void *dest,
+                      const void *source, int nelem, size_t esize,
+                      team_combine_fn combine) {
+    size_t bytes = nelem * esize;
+    int    par   = (int) (++tune_seq & 1);
+    int    p2, rem, v, k, nsteps;
+
+    for (p2 = 1, nsteps = 0; 2 * p2 <= t_size; p2 *= 2) {
+        nsteps++;
+    }
+    rem = t_size - p2;
+    memcpy(dest, source, bytes);
+
+    if (t_pe < 2 * rem && t_pe % 2 == 0) {
+        tune_send(TUNE_SLOT(par, nsteps, bytes), dest, bytes, par, nsteps,
+                  pe_map[t_pe + 1]);
+        tune_wait(par, nsteps);
+        memcpy(dest, TUNE_SLOT(par, nsteps, bytes), bytes);
+        return;
+    }
+    if (t_pe < 2 * rem) {
+        tune_wait(par, nsteps);
+        combine(dest, TUNE_SLOT(par, nsteps, bytes), nelem);
+        v = t_pe / 2;
+    } else {
+        v = t_pe - rem;
+    }
+
+    for (k = 0; k < nsteps; k++) {
+        int pv = v ^ (1 << k);
+        int pe = pe_map[(pv < rem) ? 2 * pv + 1 : pv + rem];
+
+        tune_send(TUNE_SLOT(par, k, bytes), dest, bytes, par, k, pe);
+        tune_wait(par, k);
+        combine(dest, TUNE_SLOT(par, k, bytes), nelem);
+    }
+
+    if (t_pe < 2 * rem) {
+        tune_send(TUNE_SLOT(par, nsteps, bytes), dest, bytes, par, nsteps,
+                  pe_map[t_pe - 1]);
+    }
+}
+
+static void tune_ring(int *pe_map, int t_pe, int t_size, void *dest,
+                      const void *source, int nelem, size_t esize,
+                      team_combine_fn combine) {
+    int    right = pe_map[(t_pe + 1) % t_size];
+    int    base  = nelem / t_size;
+    int    extra = nelem % t_size;
+    size_t slot_bytes = (base + (extra ? 1 : 0)) * esize;
+    int    par   = (int) (++tune_seq & 1);
+    char  *acc   = dest;
+    int    s;
+
+#define BLOCK_COUNT(b)  (base + ((b) < extra ? 1 : 0))
+#define BLOCK_DISPL(b)  ((b) * base + ((b) < extra ? (b) : extra))
+
+    memcpy(dest, source, nelem * esize);
+
+    for (s = 0; s < t_size - 1; s++) {
+        int send_blk = (t_pe - s + t_size) % t_size;
+        int recv_blk = (t_pe - s - 1 + t_size) % t_size;
+
+        tune_send(TUNE_SLOT(par, s, slot_bytes),
+                  acc + BLOCK_DISPL(send_blk) * esize,
+                  BLOCK_COUNT(send_blk) * esize, par, s, right);
+        tune_wait(par, s);
+        combine(acc + BLOCK_DISPL(recv_blk) * esize,
+                TUNE_SLOT(par, s, slot_bytes), BLOCK_COUNT(recv_blk));
+    }
+
+    for (s = 0; s < t_size - 1; s++) {
+        int send_blk = (t_pe + 1 - s + t_size) % t_size;
+        int recv_blk = (t_pe - s + t_size) % t_size;
+        int slot     = t_size - 1 + s;
+
+        tune_send(TUNE_SLOT(par, slot, slot_bytes),
+                  acc + BLOCK_DISPL(send_blk) * esize,
+                  BLOCK_COUNT(send_blk) * esize, par, slot, right);
+        tune_wait(par, slot);
+        memcpy(acc + BLOCK_DISPL(recv_blk) * esize,
+               TUNE_SLOT(par, slot, slot_bytes),
+               BLOCK_COUNT(recv_blk) * esize);
+    }
+
+#undef BLOCK_COUNT
+#undef BLOCK_DISPL
+}
+
+static void tune_dissem(int *pe_map, int t_pe, int t_size) {
+    int par = (int) (++tune_seq & 1);
+    int k, dist;
+
+    for (k = 0, dist = 1; dist < t_size; k++, dist *= 2) {
+        shmem_long_p(TUNE_FLAG(par, k), tune_seq,
+                     pe_map[(t_pe + dist) % t_size]);
+        tune_wait(par, k);
+    }
+}
+
+/* clear all flags between cases, teams of a case may have skipped calls */
+static void tune_reset(void) {
+    shmem_barrier_all();
+    memset(tune_flags, 0, 2 * tune_nflags * sizeof(long));
+    tune_seq = 0;
+    shmem_barrier_all();
+}
+
+long   lib_pSync[2][SHMEM_REDUCE_SYNC_SIZE];
+char  *lib_pWrk[2];
+char  *src_buf, *dst_buf;
+double time_src[TUNE_NALGS], time_dst[TUNE_NALGS];
+double time_pWrk[MAX(TUNE_NALGS/2+1, SHMEM_REDUCE_MIN_WRKDATA_SIZE)];
+int    bar_src, bar_dst;
+int    bar_pWrk[2][SHMEM_REDUCE_MIN_WRKDATA_SIZE];
+
+static void library_to_all(shmem_team_t team, int type, void *dest,
+                           void *source, int nelem, int iter) {
+    long *pSync = lib_pSync[iter % 2];
+    char *pWrk  = lib_pWrk[iter % 2];
+
+    switch (type) {
+    case 0:
+        shmemx_team_int_sum_to_all(team, dest, source, nelem,
+                                   (int *) pWrk, pSync);
+        break;
+    case 1:
+        shmemx_team_long_sum_to_all(team, dest, source, nelem,
+                                    (long *) pWrk, pSync);
+        break;
+    case 2:
+        shmemx_team_float_sum_to_all(team, dest, source, nelem,
+                                     (float *) pWrk, pSync);
+        break;
+    case 3:
+        shmemx_team_double_sum_to_all(team, dest, source, nelem,
+                                      (double *) pWrk, pSync);
+        break;
+    }
+}
+
+static double wtime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/*
+ * Time the algorithms of one case on the team of the calling PE, with
+ * type -1 for the barrier, and return the slowest time of all teams of
+ * the shape for every algorithm in time_dst.
+ */
+static void tune_case(shmem_team_t team, int *pe_map, int type,
+                      size_t nbytes) {
+    int t_pe   = (team != SHMEM_TEAM_NULL) ? shmemx_team_my_pe(team) : -1;
+    int t_size = (team != SHMEM_TEAM_NULL) ? shmemx_team_n_pes(team) : 0;
+    int alg, iter;
+    double t = 0.0;
+
+    tune_reset();
+    for (alg = 0; alg < TUNE_NALGS; alg++) {
+        time_src[alg] = 0.0;
+    }
+
+    if (team != SHMEM_TEAM_NULL) {
+        for (alg = 0; alg < TUNE_NALGS; alg++) {
+            if ((type < 0) ? (alg != TUNE_ALG_LIBRARY &&
+                              alg != TUNE_ALG_DISSEM)
+                           : (alg == TUNE_ALG_DISSEM)) {
+                time_src[alg] = HUGE_VAL;
+                continue;
+            }
+            for (iter = 0; iter < TUNE_NWARM + TUNE_NREP; iter++) {
+                if (iter == TUNE_NWARM) {
+                    t = wtime();
+                }
+                if (type < 0 && alg == TUNE_ALG_LIBRARY) {
+                    shmemx_team_int_sum_to_all(team, &bar_dst, &bar_src, 1,
+                                               bar_pWrk[iter % 2],
+                                               lib_pSync[iter % 2]);
+                } else if (type < 0) {
+                    tune_dissem(pe_map, t_pe, t_size);
+                } else if (alg == TUNE_ALG_LIBRARY) {
+                    library_to_all(team, type, dst_buf, src_buf,
+                                   nbytes / tune_types[type].size, iter);
+                } else if (alg == TUNE_ALG_RDBL) {
+                    tune_rdbl(pe_map, t_pe, t_size, dst_buf, src_buf,
+                              nbytes / tune_types[type].size,
+                              tune_types[type].size,
+                              tune_types[type].combine);
+                } else {
+                    tune_ring(pe_map, t_pe, t_size, dst_buf, src_buf,
+                              nbytes / tune_types[type].size,
+                              tune_types[type].size,
+                              tune_types[type].combine);
+                }
+            }
+            time_src[alg] = (wtime() - t) / TUNE_NREP;
+        }
+    }
+
+    shmem_barrier_all();
+    shmem_double_max_to_all(time_dst, time_src, TUNE_NALGS, 0, 0,
+                            shmem_n_pes(), time_pWrk,
+                            tune_pSync[tune_pSync_idx]);
+    tune_pSync_idx = !tune_pSync_idx;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = (argc > 1) ? argv[1] : "team_tune.txt";
+    const char *shape_names[TUNE_NSHAPES] = {
+        "world", "strided", "xaxis", "yaxis"
+    };
+    shmem_team_t teams[TUNE_NSHAPES];
+    int *pe_maps[TUNE_NSHAPES];
+    int  i, s, type, alg, best, nsteps;
+    int  me, npes, xrange, yrange;
+    size_t nbytes;
+    FILE *table = NULL;
+
+    shmem_init();
+    me = shmem_my_pe();
+    npes = shmem_n_pes();
+
+    if (npes > TEAM_MAP_MAX_PES) {
+        if (me == 0) {
+            printf("tune: at most %d PEs are supported\n", TEAM_MAP_MAX_PES);
+        }
+        shmem_finalize();
+        return 1;
+    }
+
+    for (i = 0; i < SHMEM_REDUCE_SYNC_SIZE; i++) {
+        tune_pSync[0][i] = SHMEM_SYNC_VALUE;
+        tune_pSync[1][i] = SHMEM_SYNC_VALUE;
+        lib_pSync[0][i]  = SHMEM_SYNC_VALUE;
+        lib_pSync[1][i]  = SHMEM_SYNC_VALUE;
+    }
+    team_map_init();
+
+    for (nsteps = 0; (1 << nsteps) < npes; nsteps++)
+        ;
+    tune_nflags = MAX(2 * npes, nsteps + 1);
+    tune_half   = MAX((size_t) (nsteps + 1) * TUNE_MAX_BYTES,
+                      (size_t) 2 * npes * (TUNE_MAX_BYTES / npes + 16));
+    tune_buf    = shmem_malloc(2 * tune_half);
+    tune_flags  = shmem_malloc(2 * tune_nflags * sizeof(long));
+    src_buf     = shmem_malloc(TUNE_MAX_BYTES);
+    dst_buf     = shmem_malloc(TUNE_MAX_BYTES);
+    for (i = 0; i < 2; i++) {
+        lib_pWrk[i] = shmem_malloc(MAX(TUNE_MAX_BYTES / 2 + sizeof(long),
+                                       SHMEM_REDUCE_MIN_WRKDATA_SIZE *
+                                       sizeof(long double)));
+    }
+    if (tune_buf == NULL || tune_flags == NULL || src_buf == NULL ||
+        dst_buf == NULL || lib_pWrk[0] == NULL || lib_pWrk[1] == NULL) {
+        if (me == 0) {
+            printf("tune: cannot allocate the symmetric buffers\n");
+        }
+        shmem_global_exit(1);
+    }
+    memset(src_buf, 1, TUNE_MAX_BYTES);
+
+    xrange = (npes != 1) ? floor(log(npes)/log(2)) : 1;
+    yrange = (npes != 1) ? floor(log(npes)/log(2)) : 1;
+
+    teams[0] = SHMEM_TEAM_WORLD;
+    teams[1] = SHMEM_TEAM_NULL;
+    if (me % 2 == 0) {
+        shmemx_team_split_strided(SHMEM_TEAM_WORLD, 0, 2, (npes + 1) / 2,
+                                  &teams[1]);
+    }
+    shmemx_team_split_2d(SHMEM_TEAM_WORLD, xrange, yrange, &teams[2],
+                         &teams[3]);
+    for (s = 0; s < TUNE_NSHAPES; s++) {
+        pe_maps[s] = (teams[s] != SHMEM_TEAM_NULL) ? team_pe_map(teams[s])
+                                                   : NULL;
+    }
+
+    if (me == 0) {
+        table = fopen(path, "w");
+        if (table == NULL) {
+            printf("tune: cannot open %s\n", path);
+            shmem_global_exit(1);
+        }
+        fprintf(table, "# team collective tuning table, %d PEs, %d "
+                "repetitions\n", npes, TUNE_NREP);
+        fprintf(table, "# op type shape npes nbytes best "
+                "[algorithm usec]...\n");
+    }
+
+    for (s = 0; s < TUNE_NSHAPES; s++) {
+        int t_size = (teams[s] != SHMEM_TEAM_NULL) ?
+                     shmemx_team_n_pes(teams[s]) : 0;
+
+        for (type = -1; type < TUNE_NTYPES; type++) {
+            for (nbytes = 8; nbytes <= TUNE_MAX_BYTES; nbytes *= 4) {
+                if (type < 0 && nbytes > 8) {
+                    break;
+                }
+                tune_case(teams[s], pe_maps[s], type, nbytes);
+                if (me != 0) {
+                    continue;
+                }
+
+                best = -1;
+                for (alg = 0; alg < TUNE_NALGS; alg++) {
+                    if (time_dst[alg] != HUGE_VAL &&
+                        (best < 0 || time_dst[alg] < time_dst[best])) {
+                        best = alg;
+                    }
+                }
+                fprintf(table, "%-7s %-6s %-7s %5d %7zu %-7s",
+                        (type < 0) ? "barrier" : "to_all",
+                        (type < 0) ? "-" : tune_types[type].name,
+                        shape_names[s], t_size, (type < 0) ? 0 : nbytes,
+                        tune_alg_names[best]);
+                for (alg = 0; alg < TUNE_NALGS; alg++) {
+                    if (time_dst[alg] != HUGE_VAL) {
+                        fprintf(table, " %s %.2f", tune_alg_names[alg],
+                                time_dst[alg] * 1.0e6);
+                    }
+                }
+                fprintf(table, "\n");
+            }
+        }
+    }
+
+    if (me == 0) {
+        fclose(table);
+        printf("wrote %d cases to %s\n", team_tune_load(path), path);
+        printf("%-8s", "nbytes");
+        for (type = 0; type < TUNE_NTYPES; type++) {
+            printf(" %-8s", tune_types[type].name);
+        }
+        printf("\n");
+        for (nbytes = 8; nbytes <= TUNE_MAX_BYTES; nbytes *= 4) {
+            printf("%-8zu", nbytes);
+            for (type = 0; type < TUNE_NTYPES; type++) {
+                printf(" %-8s", team_tune_alg_name(
+                       team_tune_lookup("to_all", tune_types[type].name,
+                                        npes, nbytes)));
+            }
+            printf("\n");
+        }
+        printf("barrier  %s\n", team_tune_alg_name(
+               team_tune_lookup("barrier", "-", npes, 0)));
+    }
+
+    for (s = 1; s < TUNE_NSHAPES; s++) {
+        if (teams[s] != SHMEM_TEAM_NULL) {
+            team_map_destroy(&teams[s]);
+        }
+    }
+
+    shmem_barrier_all();
+    shmem_free(lib_pWrk[1]);
+    shmem_free(lib_pWrk[0]);
+    shmem_free(dst_buf);
+    shmem_free(src_buf);
+    shmem_free(tune_flags);
+    shmem_free(tune_buf);
+    shmem_finalize();
+    return 0;
+}